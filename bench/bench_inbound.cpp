@@ -0,0 +1,85 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// inbound monitor messages, see onNewWebsocketMessage
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "inbound_message.hpp"
+
+namespace {
+
+const char* const control_messages[] = {
+   "{\"type\":\"SettingsRequestPacket\"}",
+   "{\"type\":\"ScenarioRequestPacket\"}",
+   "{\"type\": \"ScenarioCurrentStatePacket\",\"scenarioState\": 2,\"scenarioData\": {\"scenarioId\": \"\","
+      "\"scenarioType\": \"Vital Signs\",\"scenarioName\": \"\",\"scenarioTime\": 600,\"scenarioMonitorType\": 3}}",
+   "{\"type\":\"DisconnectPacket\"}",
+};
+
+// debrief log as sent by the monitor at the end of a scenario
+std::string debrief_message(std::size_t events) {
+   std::string m = "{\"type\": \"DebriefPacket\",\"scenarioId\": \"\",\"events\": [";
+   for (std::size_t i = 0; i < events; ++i) {
+      if (i) m += ',';
+      m += "{\"time\": " + std::to_string(i * 1.5) +
+           ",\"eventType\": \"ChangeAction\",\"description\": \"HR 72 BP 118/76 SpO2 97 EtCO2 35 RR 14\""
+           ",\"values\": {\"hr\": 72,\"bpSys\": 118,\"bpDia\": 76,\"spo2\": 97}}";
+   }
+   m += "]}";
+   return m;
+}
+
+void BM_ScanType_Control(benchmark::State& state) {
+   std::size_t bytes = 0;
+   for (auto _ : state) {
+      for (const char* m : control_messages) {
+         const std::size_t n = std::strlen(m);
+         benchmark::DoNotOptimize(scan_message_type(m, n));
+         bytes += n;
+      }
+   }
+   state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_ScanType_Control);
+
+// what a DebriefPacket costs now: the type is found and the body skipped
+void BM_ScanType_Debrief(benchmark::State& state) {
+   const std::string m = debrief_message(static_cast<std::size_t>(state.range(0)));
+   for (auto _ : state) {
+      benchmark::DoNotOptimize(scan_message_type(m.data(), m.size()));
+   }
+   state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * m.size()));
+}
+BENCHMARK(BM_ScanType_Debrief)->Arg(32)->Arg(1024);
+
+// ScenarioCurrentStatePacket is the only message still parsed; includes the copy
+// into the read buffer that in situ parsing needs here
+void BM_ParseInsitu_Control(benchmark::State& state) {
+   const std::string m = control_messages[2];
+   std::vector<char> buffer(m.size() + 1);
+   for (auto _ : state) {
+      std::memcpy(buffer.data(), m.c_str(), m.size() + 1);
+      benchmark::DoNotOptimize(parse_current_state(buffer.data()).valid);
+   }
+   state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * m.size()));
+}
+BENCHMARK(BM_ParseInsitu_Control);
+
+// full parse of a DebriefPacket, the cost the type pre-scan avoids
+void BM_ParseInsitu_Debrief(benchmark::State& state) {
+   const std::string m = debrief_message(static_cast<std::size_t>(state.range(0)));
+   std::vector<char> buffer(m.size() + 1);
+   for (auto _ : state) {
+      std::memcpy(buffer.data(), m.c_str(), m.size() + 1);
+      benchmark::DoNotOptimize(parse_current_state(buffer.data()).valid);
+   }
+   state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * m.size()));
+}
+BENCHMARK(BM_ParseInsitu_Debrief)->Arg(32)->Arg(1024);
+
+}
@@ -0,0 +1,62 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// PhysiologyValue ingestion, see OnPhysiologyValue
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "isimulate_packets.hpp"
+#include "send_policy.hpp"
+#include "vitals_store.hpp"
+#include "websocket_session.hpp"
+#include "engine_frame.hpp"
+
+namespace {
+
+// filter only: the early return for names the monitor does not show
+void BM_ResolveName(benchmark::State& state) {
+   const auto& names = engine_frame();
+   vital slot;
+   for (auto _ : state) {
+      for (const auto& name : names) {
+         benchmark::DoNotOptimize(vitals_store::resolve(name, slot));
+      }
+   }
+   state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * names.size()));
+}
+BENCHMARK(BM_ResolveName);
+
+// full callback path as OnPhysiologyValue, onVital and writeChangeActionPacket
+// take it: filter, store, and on SIM_TIME the send decision and the rendered message
+void BM_PhysiologyValueFrame(benchmark::State& state) {
+   const auto& names = engine_frame();
+   vitals_store vitals;
+   send_policy policy;
+   packet_template changeAction(change_action_packet);
+   packet_buffer buffer;
+   auto now = send_policy::clock::now();
+   double v = 0;
+   for (auto _ : state) {
+      for (const auto& name : names) {
+         vital slot;
+         if (!vitals_store::accept(name, v += 0.37, slot)) continue;
+         vitals.update(slot, v);
+         if (slot != vital::sim_time) continue;
+         packet_values values;
+         values.set_vitals(vitals);
+         now += std::chrono::milliseconds(200);
+         if (policy.evaluate(values, now) != send_reason::none) {
+            benchmark::DoNotOptimize(make_shared_message(changeAction.render(buffer, values)));
+         }
+      }
+   }
+   state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * names.size()));
+   state.counters["sent"] = static_cast<double>(policy.sent());
+   state.counters["suppressed"] = static_cast<double>(policy.suppressed());
+}
+BENCHMARK(BM_PhysiologyValueFrame);
+
+}
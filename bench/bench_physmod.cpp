@@ -0,0 +1,65 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// PhysiologyModification XML handling, see OnNewPhysiologyModification
+
+#include <cstring>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "physmod_parser.hpp"
+#include "waveform_rules.hpp"
+
+namespace {
+
+const char* const physmod_messages[] = {
+   "<?xml version=\"1.0\" encoding=\"UTF-8\"?><PhysiologyModification type=\"AirwayObstruction\">"
+      "<Severity>0.5</Severity></PhysiologyModification>",
+   "<?xml version=\"1.0\" encoding=\"UTF-8\"?><PhysiologyModification type=\"Hemorrhage\">"
+      "<Location>LeftLeg</Location><Flow>0.25</Flow></PhysiologyModification>",
+   "<?xml version=\"1.0\" encoding=\"UTF-8\"?><PhysiologyModification type=\"TensionPneumothorax\">"
+      "<Type>Closed</Type><Side>Left</Side><Severity>0.3</Severity></PhysiologyModification>",
+};
+
+// streaming parse on its own
+void BM_PhysiologyModificationParse(benchmark::State& state) {
+   const char* message = physmod_messages[state.range(0)];
+   const std::size_t size = std::strlen(message);
+   for (auto _ : state) {
+      physmod_fields fields;
+      benchmark::DoNotOptimize(parse_physmod(message, size, fields));
+      benchmark::DoNotOptimize(fields.severity);
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PhysiologyModificationParse)->DenseRange(0, 2);
+
+// the bridge's handling of a payload seen for the first time: parse, rule
+// lookup and a new cache entry
+void BM_PhysiologyModificationFirst(benchmark::State& state) {
+   const std::string message = physmod_messages[state.range(0)];
+   waveform_rules rules;
+   physmod_cache cache(rules);
+   for (auto _ : state) {
+      cache.clear();
+      benchmark::DoNotOptimize(cache.lookup(message).band);
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PhysiologyModificationFirst)->DenseRange(0, 2);
+
+// the bridge's handling of a repeated payload: hash and cache lookup
+void BM_PhysiologyModificationCached(benchmark::State& state) {
+   const std::string message = physmod_messages[state.range(0)];
+   waveform_rules rules;
+   physmod_cache cache(rules);
+   cache.lookup(message);
+   for (auto _ : state) {
+      benchmark::DoNotOptimize(cache.lookup(message).band);
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PhysiologyModificationCached)->DenseRange(0, 2);
+
+}
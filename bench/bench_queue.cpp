@@ -0,0 +1,140 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// outbound queue under contention: the lock-free ring on its own and
+// websocket_session::do_write feeding a loopback monitor
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "isimulate_packets.hpp"
+#include "mpsc_ring.hpp"
+#include "websocket_session.hpp"
+
+namespace {
+
+void BM_MpscRingPush(benchmark::State& state) {
+   static mpsc_ring<std::size_t> ring(256);
+   static std::atomic<bool> consuming{false};
+   static std::thread consumer;
+
+   // runs before the start barrier, so the consumer is up before timing starts
+   if (state.thread_index() == 0) {
+      consuming = true;
+      consumer = std::thread([] {
+         std::size_t v;
+         while (consuming.load(std::memory_order_relaxed)) {
+            while (ring.try_pop(v)) {}
+         }
+         while (ring.try_pop(v)) {}
+      });
+   }
+
+   std::size_t retries = 0;
+   std::size_t i = 0;
+   for (auto _ : state) {
+      std::size_t v = i++;
+      while (!ring.try_push(std::move(v))) {
+         ++retries;
+         std::this_thread::yield();
+      }
+   }
+   state.SetItemsProcessed(state.iterations());
+   state.counters["full_retries"] = benchmark::Counter(static_cast<double>(retries), benchmark::Counter::kAvgThreads);
+
+   if (state.thread_index() == 0) {
+      consuming = false;
+      consumer.join();
+   }
+}
+BENCHMARK(BM_MpscRingPush)->ThreadRange(1, 8)->UseRealTime();
+
+/**
+ * @brief Loopback Class is a websocket server draining everything a websocket_session writes
+ */
+class loopback
+{
+   net::io_context server_ioc_;
+   net::io_context client_ioc_;
+   net::executor_work_guard<net::io_context::executor_type> client_work_;
+   tcp::acceptor acceptor_;
+   std::vector<std::thread> threads_;
+
+   void accept() {
+      acceptor_.async_accept([this](error_code ec, tcp::socket socket) {
+         if (ec) return;
+         auto ws = std::make_shared<websocket::stream<beast::tcp_stream>>(std::move(socket));
+         ws->async_accept([this, ws](error_code ec) {
+            if (!ec) read(ws, std::make_shared<beast::flat_buffer>());
+         });
+      });
+   }
+
+   void read(std::shared_ptr<websocket::stream<beast::tcp_stream>> ws, std::shared_ptr<beast::flat_buffer> buffer) {
+      ws->async_read(*buffer, [this, ws, buffer](error_code ec, std::size_t) {
+         if (ec) return;
+         buffer->consume(buffer->size());
+         received.fetch_add(1, std::memory_order_relaxed);
+         read(ws, buffer);
+      });
+   }
+
+public:
+   std::shared_ptr<websocket_session> session;
+   std::atomic<uint64_t> received{0};
+
+   loopback()
+      : client_work_(net::make_work_guard(client_ioc_))
+      , acceptor_(server_ioc_, tcp::endpoint(net::ip::make_address("127.0.0.1"), 0))
+   {
+      accept();
+      threads_.emplace_back([this] { server_ioc_.run(); });
+      threads_.emplace_back([this] { client_ioc_.run(); });
+
+      auto ready = std::make_shared<std::promise<void>>();
+      session = std::make_shared<websocket_session>(client_ioc_);
+      session->registerHandshakeCallback([ready](std::string) { ready->set_value(); });
+      session->run("127.0.0.1", std::to_string(acceptor_.local_endpoint().port()), "/");
+      ready->get_future().wait();
+   }
+
+   // kept for the life of the process, the benchmark threads share it
+   static loopback& instance() {
+      static loopback* lb = new loopback();
+      return *lb;
+   }
+};
+
+// producers racing on one session; arg selects the message class
+void BM_SessionDoWrite(benchmark::State& state) {
+   loopback& lb = loopback::instance();
+   const message_class cls = state.range(0) == 0 ? message_class::vitals : message_class::waveform;
+
+   packet_template changeAction(change_action_packet);
+   packet_buffer buffer;
+   const shared_message message = make_shared_message(changeAction.render(buffer, packet_values()));
+
+   const uint64_t received = lb.received.load();
+   const uint64_t coalesced = lb.session->coalesced();
+   const uint64_t dropped = lb.session->dropped();
+   for (auto _ : state) {
+      benchmark::DoNotOptimize(lb.session->do_write(message, cls));
+   }
+   state.SetItemsProcessed(state.iterations());
+   state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * message->size()));
+   if (state.thread_index() == 0) {
+      // shared session: totals over all threads of this run
+      state.counters["written"] = static_cast<double>(lb.received.load() - received);
+      state.counters["coalesced"] = static_cast<double>(lb.session->coalesced() - coalesced);
+      state.counters["dropped"] = static_cast<double>(lb.session->dropped() - dropped);
+   }
+}
+BENCHMARK(BM_SessionDoWrite)->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
+
+}
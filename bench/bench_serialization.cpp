@@ -0,0 +1,86 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// outbound packet rendering, see writeChangeActionPacket and the startup packets
+
+#include <benchmark/benchmark.h>
+
+#include "isimulate_packets.hpp"
+
+namespace {
+
+packet_values sample_values() {
+   packet_values values;
+   values[packet_field::heart_rate] = 72.3456;
+   values[packet_field::bp_systolic] = 118.25;
+   values[packet_field::bp_diastolic] = 76.5;
+   values[packet_field::spo2] = 97.123;
+   values[packet_field::etco2] = 35.8;
+   values[packet_field::resp_rate] = 14.0;
+   values[packet_field::temperature] = 37.04;
+   values[packet_field::sim_time] = 1234.5;
+   values[packet_field::ecg_waveform] = 9;
+   values[packet_field::monitor_type] = 3;
+   values[packet_field::connection_type] = 1;
+   values[packet_field::requested_state] = 1;
+   return values;
+}
+
+void BM_ChangeActionPacket(benchmark::State& state) {
+   packet_template changeAction(change_action_packet);
+   const int precision = static_cast<int>(state.range(0));
+   for (std::size_t i = 0; i < vital_count; ++i) {
+      if (static_cast<vital>(i) == vital::sim_time) continue;
+      changeAction.set_precision(static_cast<packet_field>(i), precision);
+   }
+   packet_buffer buffer;
+   packet_values values = sample_values();
+   std::size_t bytes = 0;
+   for (auto _ : state) {
+      // vary one vital so the formatter cannot be hoisted out of the loop
+      values[packet_field::heart_rate] += 0.01;
+      const std::string& message = changeAction.render(buffer, values);
+      benchmark::DoNotOptimize(message.data());
+      bytes += message.size();
+   }
+   state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_ChangeActionPacket)->Arg(0)->Arg(vital_precision)->Arg(-1);
+
+// connection handshake as sent to a freshly connected monitor
+void BM_StartupPackets(benchmark::State& state) {
+   packet_template connectionType(connection_type_packet);
+   packet_template settings(settings_packet);
+   packet_template scenario(scenario_packet);
+   packet_template syncTimes(sync_times_packet);
+   packet_template scenarioChangeState(scenario_change_state_packet);
+   packet_template powerOn(power_on_packet);
+   packet_template visibility(visibility_packet);
+   packet_buffer buffer;
+   const packet_values values = sample_values();
+   std::size_t bytes = 0;
+   for (auto _ : state) {
+      for (const packet_template* t : {&connectionType, &settings, &scenario, &syncTimes,
+                                       &scenarioChangeState, &powerOn, &visibility}) {
+         const std::string& message = t->render(buffer, values);
+         benchmark::DoNotOptimize(message.data());
+         bytes += message.size();
+      }
+   }
+   state.SetBytesProcessed(static_cast<int64_t>(bytes));
+}
+BENCHMARK(BM_StartupPackets);
+
+void BM_FormatNumber(benchmark::State& state) {
+   const int precision = static_cast<int>(state.range(0));
+   char out[max_number_length];
+   double v = 98.7654321;
+   for (auto _ : state) {
+      v += 0.001;
+      benchmark::DoNotOptimize(format_number(out, v, precision));
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FormatNumber)->Arg(0)->Arg(vital_precision)->Arg(-1);
+
+}
@@ -0,0 +1,132 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// PhysiologyValue subscriber side with allocation counts. A separate binary:
+// the counting operator new replaces the global one for every benchmark in it
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "vitals_store.hpp"
+#include "engine_frame.hpp"
+
+namespace {
+std::atomic<uint64_t> allocations{0};
+}
+
+void* operator new(std::size_t size) {
+   allocations.fetch_add(1, std::memory_order_relaxed);
+   if (void* p = std::malloc(size ? size : 1)) return p;
+   throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+// synthetic publisher: one engine frame padded to the few hundred names the
+// physiology engine publishes, as CDR records (length, name, NUL, padding, value)
+const std::vector<char>& published_frame(std::size_t& samples) {
+   static std::size_t count = 0;
+   static const std::vector<char> wire = [] {
+      std::vector<std::string> names = engine_frame();
+      for (std::size_t i = 0; names.size() < 300; ++i) {
+         names.push_back("Substance_Compound" + std::to_string(i) + "_PlasmaConcentration");
+      }
+      std::vector<char> w;
+      double value = 0;
+      for (const auto& name : names) {
+         const uint32_t length = static_cast<uint32_t>(name.size() + 1);
+         w.insert(w.end(), reinterpret_cast<const char*>(&length), reinterpret_cast<const char*>(&length) + 4);
+         w.insert(w.end(), name.c_str(), name.c_str() + length);
+         w.resize((w.size() + 7) & ~std::size_t(7), 0);
+         value += 1.25;
+         w.insert(w.end(), reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + 8);
+      }
+      count = names.size();
+      return w;
+   }();
+   samples = count;
+   return wire;
+}
+
+// what the generated PhysiologyValue type holds after deserialization
+struct physiology_sample {
+   std::string name;
+   double value = 0;
+};
+
+// walk the records of a frame, on_record(name, length, value offset)
+template <typename Record>
+void read_frame(const std::vector<char>& wire, Record on_record) {
+   std::size_t at = 0;
+   while (at < wire.size()) {
+      uint32_t length;
+      std::memcpy(&length, &wire[at], 4);
+      const char* name = &wire[at + 4];
+      at = (at + 4 + length + 7) & ~std::size_t(7);
+      on_record(name, length - 1, at);
+      at += 8;
+   }
+}
+
+// subscriber side of one frame: every sample deserialized, then handed to
+// store(sample) as the DDS listener hands it to OnPhysiologyValue; store returns
+// whether the bridge kept the value
+template <typename Store>
+void subscribe_frame(benchmark::State& state, Store store) {
+   std::size_t samples = 0;
+   const auto& wire = published_frame(samples);
+   physiology_sample sample;
+   uint64_t used = 0;
+   const uint64_t before = allocations.load(std::memory_order_relaxed);
+   for (auto _ : state) {
+      read_frame(wire, [&](const char* name, std::size_t length, std::size_t value_at) {
+         // a fresh sample per record, like the DDS listener takes it
+         physiology_sample s{std::string(name, length), 0};
+         std::memcpy(&s.value, &wire[value_at], 8);
+         if (!store(s)) return;
+         ++used;
+         benchmark::DoNotOptimize(sample = std::move(s));
+      });
+   }
+   const uint64_t allocated = allocations.load(std::memory_order_relaxed) - before;
+   const double processed = static_cast<double>(state.iterations() * samples);
+   state.SetItemsProcessed(static_cast<int64_t>(processed));
+   state.counters["allocs/sample"] = static_cast<double>(allocated) / processed;
+   state.counters["used/sample"] = static_cast<double>(used) / processed;
+}
+
+// before: every value stored by name as text, as OnPhysiologyValue did before
+// the vitals store
+void BM_SubscribeFrameMap(benchmark::State& state) {
+   std::map<std::string, std::string> node_data;
+   subscribe_frame(state, [&node_data](const physiology_sample& s) {
+      node_data[s.name] = std::to_string(s.value);
+      return true;
+   });
+}
+BENCHMARK(BM_SubscribeFrameMap);
+
+// now: names rejected by the length filter, the used ones stored as doubles
+void BM_SubscribeFrameFiltered(benchmark::State& state) {
+   vitals_store vitals;
+   subscribe_frame(state, [&vitals](const physiology_sample& s) {
+      vital slot;
+      if (!vitals_store::resolve(s.name, slot)) return false;
+      vitals.update(slot, s.value);
+      return true;
+   });
+}
+BENCHMARK(BM_SubscribeFrameFiltered);
+
+}
@@ -0,0 +1,95 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// waveform forwarding and derived vitals, see OnPhysiologyWaveform
+
+#include <cmath>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "derived_vitals.hpp"
+#include "waveform_pipeline.hpp"
+
+namespace {
+
+// synthetic ECG, arterial pressure and capnogram at 72 bpm and 15 breaths/min
+float synthetic_sample(waveform_channel channel, double t) {
+   const double beat = t * 72 / 60 - std::floor(t * 72 / 60);
+   const double breath = t * 15 / 60 - std::floor(t * 15 / 60);
+   switch (channel) {
+      case waveform_channel::ecg:
+         return static_cast<float>(0.1 * std::sin(6.283 * beat) + (beat < 0.02 ? 1.5 * std::sin(157.08 * beat) : 0));
+      case waveform_channel::abp:
+      case waveform_channel::pleth:
+         return static_cast<float>(80 + 40 * (1 + 0.1 * std::sin(6.283 * breath)) * std::max(0.0, std::sin(6.283 * beat)));
+      default:
+         return breath < 0.5 ? 38.f : 0.f;
+   }
+}
+
+// one second of 4 channels at arg Hz pushed and flushed at 25 frames/s,
+// a rate counter above 1 means faster than real time
+void BM_WaveformPipeline(benchmark::State& state) {
+   const int rate = static_cast<int>(state.range(0));
+   const int frames = 25;
+   const int per_frame = rate / frames;
+
+   // precomputed so the benchmark measures the pipeline, not std::sin
+   std::vector<float> signal[waveform_channel_count];
+   for (std::size_t c = 0; c < waveform_channel_count; ++c) {
+      for (int i = 0; i < rate; ++i) signal[c].push_back(synthetic_sample(static_cast<waveform_channel>(c), double(i) / rate));
+   }
+
+   waveform_pipeline pipeline;
+   packet_buffer buffer(16384);
+   auto t = waveform_pipeline::clock::now();
+   const auto period = std::chrono::microseconds(1000000 / rate);
+   std::size_t bytes = 0;
+   for (auto _ : state) {
+      for (int f = 0; f < frames; ++f) {
+         for (int i = f * per_frame; i < (f + 1) * per_frame; ++i) {
+            t += period;
+            for (std::size_t c = 0; c < waveform_channel_count; ++c) {
+               pipeline.push(static_cast<waveform_channel>(c), signal[c][i], t);
+            }
+         }
+         if (pipeline.flush(buffer, t)) bytes += buffer.str().size();
+      }
+   }
+   state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * rate * waveform_channel_count));
+   state.SetBytesProcessed(static_cast<int64_t>(bytes));
+   state.counters["realtime"] = benchmark::Counter(static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+   state.counters["overruns"] = static_cast<double>(pipeline.overruns());
+}
+BENCHMARK(BM_WaveformPipeline)->Arg(500)->Arg(1000);
+
+// derived vitals on 40 ms blocks of ECG, ABP and CO2 at arg Hz
+void BM_DerivedVitals(benchmark::State& state) {
+   const int rate = static_cast<int>(state.range(0));
+   const int block = rate / 25;
+   const int seconds = 10;
+   const waveform_channel channels[] = {waveform_channel::ecg, waveform_channel::abp, waveform_channel::co2};
+
+   std::vector<float> signal[3];
+   std::vector<int64_t> times;
+   for (int i = 0; i < rate * seconds; ++i) {
+      for (int c = 0; c < 3; ++c) signal[c].push_back(synthetic_sample(channels[c], double(i) / rate));
+      times.push_back(int64_t(i) * 1000000 / rate);
+   }
+
+   derived_vitals engine;
+   for (auto _ : state) {
+      for (int i = 0; i + block <= rate * seconds; i += block) {
+         for (int c = 0; c < 3; ++c) engine.process(channels[c], signal[c].data() + i, times.data() + i, block);
+      }
+      // keep time moving forward across iterations
+      for (auto& t : times) t += int64_t(seconds) * 1000000;
+   }
+   state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * rate * seconds * 3);
+   state.SetLabel(derived_vitals::simd_name());
+   state.counters["beats"] = static_cast<double>(engine.beats());
+}
+BENCHMARK(BM_DerivedVitals)->Arg(500)->Arg(1000);
+
+}
@@ -0,0 +1,55 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef ENGINE_FRAME_HPP
+#define ENGINE_FRAME_HPP
+
+#include <string>
+#include <vector>
+
+// one 5 Hz frame of the physiology engine: a few shown vitals among many others
+inline const std::vector<std::string>& engine_frame() {
+   static const std::vector<std::string> names = {
+      "SIM_TIME",
+      "Cardiovascular_HeartRate",
+      "Cardiovascular_Arterial_Systolic_Pressure",
+      "Cardiovascular_Arterial_Diastolic_Pressure",
+      "Cardiovascular_Arterial_Mean_Pressure",
+      "Cardiovascular_CentralVenous_Mean_Pressure",
+      "Cardiovascular_CardiacOutput",
+      "Cardiovascular_BloodVolume",
+      "Cardiovascular_StrokeVolume",
+      "BloodChemistry_Oxygen_Saturation",
+      "BloodChemistry_BloodPH",
+      "BloodChemistry_Arterial_CarbonDioxide_Pressure",
+      "BloodChemistry_Arterial_Oxygen_Pressure",
+      "BloodChemistry_Hemoglobin_Concentration",
+      "BloodChemistry_WhiteBloodCell_Count",
+      "Respiration_EndTidalCarbonDioxide",
+      "Respiratory_Respiration_Rate",
+      "Respiratory_TidalVolume",
+      "Respiratory_TotalLungVolume",
+      "Respiratory_LeftPleuralCavity_Volume",
+      "Respiratory_RightPleuralCavity_Volume",
+      "Respiratory_LeftLung_Volume",
+      "Respiratory_RightLung_Volume",
+      "Respiratory_InspiratoryExpiratory_Ratio",
+      "Energy_Core_Temperature",
+      "Energy_Skin_Temperature",
+      "Renal_UrineProductionRate",
+      "Renal_GlomerularFiltrationRate",
+      "Substance_Sodium",
+      "Substance_Potassium",
+      "Substance_Glucose_Concentration",
+      "Substance_Lactate_Concentration",
+      "MetabolicPanel_Bicarbonate",
+      "MetabolicPanel_CarbonDioxide",
+      "CompleteBloodCount_Hematocrit",
+      "CompleteBloodCount_Platelet",
+      "Patient_Weight",
+      "Patient_Pain_Level",
+   };
+   return names;
+}
+
+#endif
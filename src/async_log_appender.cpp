@@ -0,0 +1,142 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "amm/BaseLogger.h"
+#include "async_log_appender.hpp"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+constexpr std::size_t flush_size = 64 * 1024;
+// the writer looks for new lines at least this often, producers never wake it
+constexpr std::chrono::milliseconds poll_period(10);
+
+const char* color_of(plog::Severity severity) {
+   switch (severity) {
+      case plog::fatal:   return "\x1B[97m\x1B[41m";
+      case plog::error:   return "\x1B[91m";
+      case plog::warning: return "\x1B[93m";
+      case plog::debug:
+      case plog::verbose: return "\x1B[96m";
+      default:            return nullptr;
+   }
+}
+
+const char color_reset[] = "\x1B[0m\x1B[0K";
+
+}
+
+async_log_appender::async_log_appender(std::size_t capacity)
+   : ring_(capacity)
+   , color_(isatty(fileno(stdout)) != 0)
+{
+}
+
+async_log_appender::~async_log_appender() {
+   stop();
+}
+
+void async_log_appender::start() {
+   if (running_.exchange(true)) return;
+   writer_ = std::thread(&async_log_appender::run, this);
+}
+
+void async_log_appender::stop() {
+   if (!running_.exchange(false)) return;
+   wake_.notify_one();
+   writer_.join();
+
+   // the writer is gone, lines queued meanwhile are written here
+   std::string out;
+   line l;
+   while (ring_.try_pop(l)) format(l, out);
+   report_drops(out);
+   std::lock_guard<std::mutex> lock(mutex_);
+   flush(out);
+}
+
+async_log_appender::line async_log_appender::make_line(const plog::Record& record) {
+   line l;
+   l.severity = record.getSeverity();
+   l.time = record.getTime();
+   l.tid = record.getTid();
+   const char* func = record.getFunc();
+   const char* message = record.getMessage();
+   const std::string at = std::to_string(record.getLine());
+   const std::size_t func_size = std::strlen(func);
+   const std::size_t message_size = std::strlen(message);
+   l.text.reserve(func_size + at.size() + message_size + 4);
+   l.text += '[';
+   l.text.append(func, func_size);
+   l.text += '@';
+   l.text += at;
+   l.text += "] ";
+   l.text.append(message, message_size);
+   return l;
+}
+
+void async_log_appender::write(const plog::Record& record) {
+   if (!running_.load(std::memory_order_acquire)) {
+      std::string out;
+      format(make_line(record), out);
+      std::lock_guard<std::mutex> lock(mutex_);
+      flush(out);
+      return;
+   }
+   if (!ring_.try_push(make_line(record))) dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+// same layout as plog::TxtFormatter
+void async_log_appender::format(const line& l, std::string& out) {
+   std::tm t;
+   localtime_r(&l.time.time, &t);
+   char prefix[64];
+   std::snprintf(prefix, sizeof(prefix), "%04d-%02d-%02d %02d:%02d:%02d.%03u %-5s [%u] ",
+                 t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
+                 static_cast<unsigned>(l.time.millitm), plog::severityToString(l.severity), l.tid);
+
+   const char* color = color_ ? color_of(l.severity) : nullptr;
+   if (color) out += color;
+   out += prefix;
+   out += l.text;
+   if (color) out += color_reset;
+   out += '\n';
+   written_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void async_log_appender::flush(std::string& out) {
+   if (out.empty()) return;
+   std::fwrite(out.data(), 1, out.size(), stdout);
+   std::fflush(stdout);
+   out.clear();
+}
+
+void async_log_appender::report_drops(std::string& out) {
+   const uint64_t drops = dropped_.load(std::memory_order_relaxed);
+   if (drops == reported_drops_) return;
+   out += "Log queue full, " + std::to_string(drops - reported_drops_) + " lines dropped\n";
+   reported_drops_ = drops;
+}
+
+void async_log_appender::run() {
+   std::string out;
+   out.reserve(flush_size + 4096);
+   line l;
+   while (running_.load(std::memory_order_acquire)) {
+      while (ring_.try_pop(l)) {
+         format(l, out);
+         if (out.size() >= flush_size) flush(out);
+      }
+      report_drops(out);
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      flush(out);
+      wake_.wait_for(lock, poll_period);
+   }
+}
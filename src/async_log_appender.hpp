@@ -0,0 +1,73 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef ASYNC_LOG_APPENDER_HPP
+#define ASYNC_LOG_APPENDER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <plog/Appenders/IAppender.h>
+#include <plog/Record.h>
+
+#include "mpsc_ring.hpp"
+
+/**
+ * @brief Async_Log_Appender Class moves console logging off the calling threads.
+ *
+ * write() copies the record into a bounded lock-free ring and returns; a
+ * writer thread formats the lines like plog's TxtFormatter and writes them
+ * to stdout, colored like ColorConsoleAppender when stdout is a terminal.
+ * When the ring is full the record is dropped and counted, a logging thread
+ * never waits for the console. Before start() and after stop() records are
+ * written synchronously.
+ */
+class async_log_appender : public plog::IAppender
+{
+public:
+   explicit async_log_appender(std::size_t capacity = 8192);
+   ~async_log_appender();
+   async_log_appender(const async_log_appender&) = delete;
+   async_log_appender& operator=(const async_log_appender&) = delete;
+
+   void start();
+   // write everything queued and join the writer
+   void stop();
+
+   void write(const plog::Record& record) override;
+
+   uint64_t written() const { return written_.load(std::memory_order_relaxed); }
+   uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+   std::size_t capacity() const { return ring_.capacity(); }
+
+private:
+   struct line {
+      plog::Severity severity = plog::none;
+      plog::util::Time time;
+      unsigned int tid = 0;
+      std::string text;          // "[func@line] message"
+   };
+
+   static line make_line(const plog::Record& record);
+   void format(const line& l, std::string& out);
+   void flush(std::string& out);
+   void report_drops(std::string& out);
+   void run();
+
+   mpsc_ring<line> ring_;
+   std::thread writer_;
+   std::atomic<bool> running_{false};
+   std::mutex mutex_;               // stdout, producers only take it before start()
+   std::condition_variable wake_;
+   const bool color_;
+
+   std::atomic<uint64_t> written_{0};
+   std::atomic<uint64_t> dropped_{0};
+   uint64_t reported_drops_ = 0;
+};
+
+#endif
@@ -0,0 +1,180 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "avahi_asio_poll.hpp"
+
+#include <sys/time.h>
+
+#include <chrono>
+#include <memory>
+
+namespace net = boost::asio;
+using error_code = boost::system::error_code;
+
+namespace {
+
+struct watch_state {
+   watch_state(avahi_asio_poll::strand_type& strand, int fd)
+      : descriptor(strand, fd), fd(fd) {}
+
+   net::posix::stream_descriptor descriptor;
+   AvahiWatch* owner = nullptr;
+   int fd;
+   AvahiWatchEvent events = static_cast<AvahiWatchEvent>(0);    // requested by avahi
+   AvahiWatchEvent revents = static_cast<AvahiWatchEvent>(0);   // reported in the last callback
+   AvahiWatchCallback callback = nullptr;
+   void* userdata = nullptr;
+   bool dead = false;
+   bool failed = false;        // descriptor error reported to avahi, never waited on again
+   bool read_pending = false;
+   bool write_pending = false;
+};
+
+struct timeout_state {
+   explicit timeout_state(avahi_asio_poll::strand_type& strand)
+      : timer(strand) {}
+
+   net::steady_timer timer;
+   AvahiTimeout* owner = nullptr;
+   AvahiTimeoutCallback callback = nullptr;
+   void* userdata = nullptr;
+   bool dead = false;
+   unsigned generation = 0;    // bumped on every update, stale expiries are ignored
+};
+
+void arm(const std::shared_ptr<watch_state>& st);
+
+void on_ready(const std::shared_ptr<watch_state>& st, error_code ec, AvahiWatchEvent event) {
+   if (st->dead || st->failed || ec == net::error::operation_aborted) return;
+   if (ec) {
+      // a broken descriptor completes every wait at once: report it a single
+      // time and stop the watch instead of spinning the io_context
+      st->failed = true;
+      error_code ignored;
+      st->descriptor.cancel(ignored);
+      st->revents = AVAHI_WATCH_ERR;
+      st->callback(st->owner, st->fd, AVAHI_WATCH_ERR, st->userdata);
+      st->revents = static_cast<AvahiWatchEvent>(0);
+      return;
+   }
+   if (st->events & event) {
+      st->revents = event;
+      st->callback(st->owner, st->fd, event, st->userdata);
+      st->revents = static_cast<AvahiWatchEvent>(0);
+   }
+   // avahi expects level triggered polling: wait again while still interested
+   arm(st);
+}
+
+void arm(const std::shared_ptr<watch_state>& st) {
+   if (st->dead || st->failed) return;
+   if ((st->events & AVAHI_WATCH_IN) && !st->read_pending) {
+      st->read_pending = true;
+      st->descriptor.async_wait(net::posix::descriptor_base::wait_read, [st](error_code ec) {
+         st->read_pending = false;
+         on_ready(st, ec, AVAHI_WATCH_IN);
+      });
+   }
+   if ((st->events & AVAHI_WATCH_OUT) && !st->write_pending) {
+      st->write_pending = true;
+      st->descriptor.async_wait(net::posix::descriptor_base::wait_write, [st](error_code ec) {
+         st->write_pending = false;
+         on_ready(st, ec, AVAHI_WATCH_OUT);
+      });
+   }
+}
+
+void schedule(const std::shared_ptr<timeout_state>& st, const struct timeval* tv) {
+   ++st->generation;
+   st->timer.cancel();
+   if (!tv) return;   // disabled
+
+   // avahi passes an absolute wall clock time
+   struct timeval now;
+   gettimeofday(&now, nullptr);
+   long long usec = (static_cast<long long>(tv->tv_sec) - now.tv_sec) * 1000000LL
+                  + (static_cast<long long>(tv->tv_usec) - now.tv_usec);
+   if (usec < 0) usec = 0;
+
+   st->timer.expires_after(std::chrono::microseconds(usec));
+   const unsigned generation = st->generation;
+   st->timer.async_wait([st, generation](error_code ec) {
+      if (ec || st->dead || generation != st->generation) return;
+      st->callback(st->owner, st->userdata);
+   });
+}
+
+}
+
+struct AvahiWatch {
+   std::shared_ptr<watch_state> state;
+};
+
+struct AvahiTimeout {
+   std::shared_ptr<timeout_state> state;
+};
+
+avahi_asio_poll::avahi_asio_poll(net::io_context& ioc)
+   : strand_(net::make_strand(ioc))
+{
+   api_.userdata = this;
+   api_.watch_new = &avahi_asio_poll::watch_new;
+   api_.watch_update = &avahi_asio_poll::watch_update;
+   api_.watch_get_events = &avahi_asio_poll::watch_get_events;
+   api_.watch_free = &avahi_asio_poll::watch_free;
+   api_.timeout_new = &avahi_asio_poll::timeout_new;
+   api_.timeout_update = &avahi_asio_poll::timeout_update;
+   api_.timeout_free = &avahi_asio_poll::timeout_free;
+}
+
+AvahiWatch* avahi_asio_poll::watch_new(const AvahiPoll* api, int fd, AvahiWatchEvent event, AvahiWatchCallback callback, void* userdata) {
+   auto self = static_cast<avahi_asio_poll*>(api->userdata);
+   auto w = new AvahiWatch;
+   w->state = std::make_shared<watch_state>(self->strand_, fd);
+   w->state->owner = w;
+   w->state->events = event;
+   w->state->callback = callback;
+   w->state->userdata = userdata;
+   arm(w->state);
+   return w;
+}
+
+void avahi_asio_poll::watch_update(AvahiWatch* w, AvahiWatchEvent event) {
+   w->state->events = event;
+   arm(w->state);
+}
+
+AvahiWatchEvent avahi_asio_poll::watch_get_events(AvahiWatch* w) {
+   return w->state->revents;
+}
+
+void avahi_asio_poll::watch_free(AvahiWatch* w) {
+   auto& st = w->state;
+   st->dead = true;
+   error_code ec;
+   st->descriptor.cancel(ec);
+   // the socket belongs to avahi, do not close it
+   st->descriptor.release();
+   delete w;
+}
+
+AvahiTimeout* avahi_asio_poll::timeout_new(const AvahiPoll* api, const struct timeval* tv, AvahiTimeoutCallback callback, void* userdata) {
+   auto self = static_cast<avahi_asio_poll*>(api->userdata);
+   auto t = new AvahiTimeout;
+   t->state = std::make_shared<timeout_state>(self->strand_);
+   t->state->owner = t;
+   t->state->callback = callback;
+   t->state->userdata = userdata;
+   schedule(t->state, tv);
+   return t;
+}
+
+void avahi_asio_poll::timeout_update(AvahiTimeout* t, const struct timeval* tv) {
+   schedule(t->state, tv);
+}
+
+void avahi_asio_poll::timeout_free(AvahiTimeout* t) {
+   t->state->dead = true;
+   t->state->timer.cancel();
+   delete t;
+}
@@ -0,0 +1,44 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef AVAHI_ASIO_POLL_HPP
+#define AVAHI_ASIO_POLL_HPP
+
+#include <boost/asio.hpp>
+
+#include <avahi-common/watch.h>
+
+/**
+ * @brief Avahi_Asio_Poll Class implements the AvahiPoll API on top of an io_context.
+ *
+ * Avahi's sockets become stream_descriptor waits and its timeouts steady_timers,
+ * so Avahi callbacks run as ordinary handlers on the bridge's event loop.
+ * All handlers run on one strand because the Avahi client is not thread safe;
+ * Avahi objects created with this poll must only be used from that strand.
+ */
+class avahi_asio_poll
+{
+public:
+   using strand_type = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+   explicit avahi_asio_poll(boost::asio::io_context& ioc);
+   avahi_asio_poll(const avahi_asio_poll&) = delete;
+   avahi_asio_poll& operator=(const avahi_asio_poll&) = delete;
+
+   const AvahiPoll* get() const { return &api_; }
+   strand_type& strand() { return strand_; }
+
+private:
+   static AvahiWatch* watch_new(const AvahiPoll* api, int fd, AvahiWatchEvent event, AvahiWatchCallback callback, void* userdata);
+   static void watch_update(AvahiWatch* w, AvahiWatchEvent event);
+   static AvahiWatchEvent watch_get_events(AvahiWatch* w);
+   static void watch_free(AvahiWatch* w);
+   static AvahiTimeout* timeout_new(const AvahiPoll* api, const struct timeval* tv, AvahiTimeoutCallback callback, void* userdata);
+   static void timeout_update(AvahiTimeout* t, const struct timeval* tv);
+   static void timeout_free(AvahiTimeout* t);
+
+   strand_type strand_;
+   AvahiPoll api_;
+};
+
+#endif
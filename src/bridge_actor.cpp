@@ -0,0 +1,98 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "bridge_actor.hpp"
+#include "bridge_metrics.hpp"
+
+namespace {
+
+const char* const kind_names[bridge_event_kind_count] = {
+   "sim_control", "tick", "vital", "waveform_rule", "monitor_connected", "monitor_message", "monitor_closed"
+};
+
+}
+
+const char* to_string(scenario_state state) {
+   switch (state) {
+      case scenario_state::initial: return "initial";
+      case scenario_state::running: return "running";
+      case scenario_state::paused: return "paused";
+   }
+   return "?";
+}
+
+const char* to_string(bridge_event::kind kind) {
+   const std::size_t i = static_cast<std::size_t>(kind);
+   return i < bridge_event_kind_count ? kind_names[i] : "?";
+}
+
+bridge_event bridge_event::sim_control(int32_t control_type) {
+   bridge_event ev;
+   ev.type = kind::sim_control;
+   ev.code = control_type;
+   return ev;
+}
+
+bridge_event bridge_event::tick(int64_t frame, clock::time_point received) {
+   bridge_event ev;
+   ev.type = kind::tick;
+   ev.frame = frame;
+   ev.received = received;
+   return ev;
+}
+
+bridge_event bridge_event::vital(::vital slot, double value, clock::time_point received) {
+   bridge_event ev;
+   ev.type = kind::vital;
+   ev.code = static_cast<int32_t>(slot);
+   ev.value = value;
+   ev.received = received;
+   return ev;
+}
+
+bridge_event bridge_event::waveform_rule(const rule_band* band) {
+   bridge_event ev;
+   ev.type = kind::waveform_rule;
+   ev.band = band;
+   return ev;
+}
+
+bridge_event bridge_event::monitor_connected(std::shared_ptr<monitor_session> session) {
+   bridge_event ev;
+   ev.type = kind::monitor_connected;
+   ev.session = std::move(session);
+   return ev;
+}
+
+bridge_event bridge_event::monitor_message(std::shared_ptr<monitor_session> session, inbound_type type, int64_t scenario_state) {
+   bridge_event ev;
+   ev.type = kind::monitor_message;
+   ev.code = static_cast<int32_t>(type);
+   ev.frame = scenario_state;
+   ev.session = std::move(session);
+   return ev;
+}
+
+bridge_event bridge_event::monitor_closed(std::shared_ptr<monitor_session> session) {
+   bridge_event ev;
+   ev.type = kind::monitor_closed;
+   ev.session = std::move(session);
+   return ev;
+}
+
+bridge_actor::bridge_actor(net::io_context& ioc)
+   : strand_(net::make_strand(ioc))
+{
+}
+
+void bridge_actor::post(bridge_event ev) {
+   if (delay_) ev.posted = bridge_event::clock::now();
+   // the strand runs handlers in the order they were posted, across threads
+   net::post(strand_, [this, ev]() mutable { handle(ev); });
+}
+
+void bridge_actor::handle(bridge_event& ev) {
+   if (delay_) delay_->record(bridge_event::clock::now() - ev.posted);
+   handled_[static_cast<std::size_t>(ev.type)].fetch_add(1, std::memory_order_relaxed);
+   if (handler_) handler_(ev);
+}
@@ -0,0 +1,119 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef BRIDGE_ACTOR_HPP
+#define BRIDGE_ACTOR_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "session_manager.hpp"
+#include "vitals_store.hpp"
+#include "inbound_message.hpp"
+#include "waveform_rules.hpp"
+
+class latency_histogram;
+
+/**
+ * @brief Scenario states of the bridge, the requestedState values of ScenarioChangeStatePacket
+ */
+enum class scenario_state {
+   initial = 0,   // reset, monitor shows the scenario paused
+   running = 1,
+   paused = 2
+};
+
+const char* to_string(scenario_state state);
+
+/**
+ * @brief Input of the bridge state machine.
+ *
+ * Payloads are decoded by the thread that receives them (DDS listener,
+ * replay, websocket session); an event only carries the result, a few
+ * words that are cheap to copy into the strand.
+ */
+struct bridge_event {
+   using clock = std::chrono::steady_clock;
+
+   enum class kind : uint8_t {
+      sim_control,         // code: AMM::ControlType
+      tick,                // frame, received
+      vital,               // code: vital slot, value, received
+      waveform_rule,       // band, null if no band matched
+      monitor_connected,   // session: websocket handshake done
+      monitor_message,     // session, code: inbound_type, frame: scenarioState or -1
+      monitor_closed,      // session
+      count
+   };
+
+   kind type = kind::tick;
+   int32_t code = 0;
+   int64_t frame = 0;
+   double value = 0;
+   const rule_band* band = nullptr;
+   std::shared_ptr<monitor_session> session;
+   clock::time_point received;     // when the data arrived, origin of the latency metrics
+   clock::time_point posted;       // set by bridge_actor::post while metrics are recorded
+
+   static bridge_event sim_control(int32_t control_type);
+   static bridge_event tick(int64_t frame, clock::time_point received);
+   static bridge_event vital(::vital slot, double value, clock::time_point received);
+   static bridge_event waveform_rule(const rule_band* band);
+   static bridge_event monitor_connected(std::shared_ptr<monitor_session> session);
+   static bridge_event monitor_message(std::shared_ptr<monitor_session> session, inbound_type type, int64_t scenario_state = -1);
+   static bridge_event monitor_closed(std::shared_ptr<monitor_session> session);
+};
+
+constexpr std::size_t bridge_event_kind_count = static_cast<std::size_t>(bridge_event::kind::count);
+
+const char* to_string(bridge_event::kind kind);
+
+/**
+ * @brief Bridge_Actor Class owns the bridge state machine.
+ *
+ * Every event is handled on one strand, one at a time, so the state behind
+ * the handler (scenario state, last tick, send policy, monitor handshakes)
+ * needs no locks. post() may be called from any thread; events are handled
+ * in the order they were posted, which is the order SimulationControl,
+ * Tick and vitals samples arrived in. Timers that touch the state run on
+ * executor().
+ */
+class bridge_actor
+{
+public:
+   using executor_type = net::strand<net::io_context::executor_type>;
+   using handler = std::function<void(bridge_event&)>;
+
+   explicit bridge_actor(net::io_context& ioc);
+   bridge_actor(const bridge_actor&) = delete;
+   bridge_actor& operator=(const bridge_actor&) = delete;
+
+   // set before the first post()
+   void set_handler(handler on_event) { handler_ = std::move(on_event); }
+   // time events wait for the strand, set before the first post()
+   void set_delay_histogram(latency_histogram* delay) { delay_ = delay; }
+
+   void post(bridge_event ev);
+
+   executor_type executor() const { return strand_; }
+   bool running_in_this_thread() const { return strand_.running_in_this_thread(); }
+
+   uint64_t handled(bridge_event::kind kind) const {
+      return handled_[static_cast<std::size_t>(kind)].load(std::memory_order_relaxed);
+   }
+
+private:
+   void handle(bridge_event& ev);
+
+   executor_type strand_;
+   handler handler_;
+   latency_histogram* delay_ = nullptr;
+   std::array<std::atomic<uint64_t>, bridge_event_kind_count> handled_{};
+};
+
+#endif
@@ -0,0 +1,206 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "bridge_metrics.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+namespace {
+
+const char* const class_names[message_class_count] = {
+   "control",
+   "vitals",
+   "sync",
+   "waveform",
+};
+
+const char* const stage_names[latency_stage_count] = {
+   "build",
+   "queue",
+   "write",
+   "total",
+};
+
+// Prometheus buckets: 2^4 us .. 2^26 us (67 s)
+constexpr int first_bucket_magnitude = 4;
+constexpr int last_bucket_magnitude = 26;
+
+const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+std::string join_labels(const std::string& labels, const char* extra) {
+   if (labels.empty()) return extra;
+   return labels + "," + extra;
+}
+
+}
+
+void append_metric_help(std::string& out, const char* name, const char* type, const char* help) {
+   out += "# HELP ";
+   out += name;
+   out += ' ';
+   out += help;
+   out += "\n# TYPE ";
+   out += name;
+   out += ' ';
+   out += type;
+   out += '\n';
+}
+
+void append_metric(std::string& out, const char* name, const std::string& labels, double value) {
+   char digits[32];
+   std::snprintf(digits, sizeof(digits), "%.9g", value);
+   out += name;
+   if (!labels.empty()) {
+      out += '{';
+      out += labels;
+      out += '}';
+   }
+   out += ' ';
+   out += digits;
+   out += '\n';
+}
+
+std::size_t latency_histogram::index(uint64_t us) {
+   constexpr uint64_t exact = uint64_t(2) << sub_bucket_bits;
+   if (us < exact) return static_cast<std::size_t>(us);
+   constexpr uint64_t cap = (uint64_t(1) << max_magnitude) - 1;
+   if (us > cap) us = cap;
+   const int magnitude = 63 - __builtin_clzll(us);
+   const int shift = magnitude - sub_bucket_bits;
+   return (static_cast<std::size_t>(shift) << sub_bucket_bits) + static_cast<std::size_t>(us >> shift);
+}
+
+uint64_t latency_histogram::upper_bound(std::size_t index) {
+   constexpr std::size_t exact = std::size_t(2) << sub_bucket_bits;
+   if (index < exact) return index;
+   const std::size_t shift = (index >> sub_bucket_bits) - 1;
+   const uint64_t sub = index - (shift << sub_bucket_bits);
+   return ((sub + 1) << shift) - 1;
+}
+
+void latency_histogram::record(std::chrono::steady_clock::duration d) {
+   const auto us = duration_cast<microseconds>(d).count();
+   record_us(us > 0 ? static_cast<uint64_t>(us) : 0);
+}
+
+void latency_histogram::record_us(uint64_t us) {
+   buckets_[index(us)].fetch_add(1, std::memory_order_relaxed);
+   count_.fetch_add(1, std::memory_order_relaxed);
+   sum_us_.fetch_add(us, std::memory_order_relaxed);
+   uint64_t max = max_us_.load(std::memory_order_relaxed);
+   while (us > max && !max_us_.compare_exchange_weak(max, us, std::memory_order_relaxed)) {}
+}
+
+uint64_t latency_histogram::quantile_us(double q) const {
+   const uint64_t total = count();
+   if (total == 0) return 0;
+   const uint64_t rank = static_cast<uint64_t>(q * (total - 1)) + 1;
+   uint64_t seen = 0;
+   for (std::size_t i = 0; i < bucket_count; ++i) {
+      seen += buckets_[i].load(std::memory_order_relaxed);
+      if (seen >= rank) return std::min(upper_bound(i), max_us());
+   }
+   return max_us();
+}
+
+void latency_histogram::render(std::string& out, const char* name, const std::string& labels) const {
+   const std::string bucket_name = std::string(name) + "_bucket";
+   uint64_t cumulative = 0;
+   std::size_t i = 0;
+   for (int magnitude = first_bucket_magnitude; magnitude <= last_bucket_magnitude; ++magnitude) {
+      // values up to 2^magnitude us
+      const std::size_t end = index(uint64_t(1) << magnitude);
+      for (; i < end; ++i) cumulative += buckets_[i].load(std::memory_order_relaxed);
+      char le[40];
+      std::snprintf(le, sizeof(le), "le=\"%.9g\"", (uint64_t(1) << magnitude) / 1e6);
+      append_metric(out, bucket_name.c_str(), join_labels(labels, le), static_cast<double>(cumulative));
+   }
+   // count is read once, the +Inf bucket must not be smaller than the others
+   const uint64_t total = std::max(count(), cumulative);
+   append_metric(out, bucket_name.c_str(), join_labels(labels, "le=\"+Inf\""), static_cast<double>(total));
+   append_metric(out, (std::string(name) + "_sum").c_str(), labels, sum_us() / 1e6);
+   append_metric(out, (std::string(name) + "_count").c_str(), labels, static_cast<double>(total));
+}
+
+const char* bridge_metrics::class_name(message_class cls) {
+   return class_names[static_cast<std::size_t>(cls)];
+}
+
+void bridge_metrics::on_written(message_class cls, std::size_t bytes) {
+   const std::size_t i = static_cast<std::size_t>(cls);
+   written_bytes_[i].fetch_add(bytes, std::memory_order_relaxed);
+   written_messages_[i].fetch_add(1, std::memory_order_relaxed);
+}
+
+void bridge_metrics::on_wire(message_class cls, uint64_t bytes) {
+   wire_bytes_[static_cast<std::size_t>(cls)].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void bridge_metrics::on_framed(message_class cls, std::chrono::nanoseconds cpu) {
+   framing_cpu_ns_[static_cast<std::size_t>(cls)].fetch_add(static_cast<uint64_t>(cpu.count()), std::memory_order_relaxed);
+}
+
+void bridge_metrics::render(std::string& out) const {
+   append_metric_help(out, "isimulate_bridge_latency_seconds", "histogram",
+                      "Outbound message latency by class and stage (build, queue, write, total)");
+   for (std::size_t c = 0; c < message_class_count; ++c) {
+      for (std::size_t s = 0; s < latency_stage_count; ++s) {
+         const latency_histogram& h = latency_[c][s];
+         if (h.count() == 0) continue;
+         const std::string labels = std::string("class=\"") + class_names[c] + "\",stage=\"" + stage_names[s] + "\"";
+         h.render(out, "isimulate_bridge_latency_seconds", labels);
+      }
+   }
+
+   append_metric_help(out, "isimulate_bridge_latency_quantile_seconds", "gauge",
+                      "Outbound message latency quantiles since start");
+   for (std::size_t c = 0; c < message_class_count; ++c) {
+      for (std::size_t s = 0; s < latency_stage_count; ++s) {
+         const latency_histogram& h = latency_[c][s];
+         if (h.count() == 0) continue;
+         const std::string labels = std::string("class=\"") + class_names[c] + "\",stage=\"" + stage_names[s] + "\"";
+         for (double q : quantiles) {
+            char quantile[32];
+            std::snprintf(quantile, sizeof(quantile), "quantile=\"%g\"", q);
+            append_metric(out, "isimulate_bridge_latency_quantile_seconds", join_labels(labels, quantile),
+                          h.quantile_us(q) / 1e6);
+         }
+      }
+   }
+
+   append_metric_help(out, "isimulate_bridge_parse_seconds", "histogram",
+                      "Time to handle inbound websocket messages and PhysiologyModifications");
+   websocket_parse.render(out, "isimulate_bridge_parse_seconds", "source=\"websocket\"");
+   physmod_parse.render(out, "isimulate_bridge_parse_seconds", "source=\"physiology_modification\"");
+
+   append_metric_help(out, "isimulate_bridge_event_delay_seconds", "histogram",
+                      "Time events wait to be handled by the bridge state machine");
+   event_delay.render(out, "isimulate_bridge_event_delay_seconds", "");
+
+   append_metric_help(out, "isimulate_bridge_written_bytes_total", "counter", "Bytes written to monitors by class");
+   for (std::size_t c = 0; c < message_class_count; ++c) {
+      append_metric(out, "isimulate_bridge_written_bytes_total", std::string("class=\"") + class_names[c] + "\"",
+                    static_cast<double>(written_bytes_[c].load(std::memory_order_relaxed)));
+   }
+   append_metric_help(out, "isimulate_bridge_written_messages_total", "counter", "Messages written to monitors by class");
+   for (std::size_t c = 0; c < message_class_count; ++c) {
+      append_metric(out, "isimulate_bridge_written_messages_total", std::string("class=\"") + class_names[c] + "\"",
+                    static_cast<double>(written_messages_[c].load(std::memory_order_relaxed)));
+   }
+   append_metric_help(out, "isimulate_bridge_wire_bytes_total", "counter",
+                      "Socket bytes written to monitors by class, after compression and framing");
+   for (std::size_t c = 0; c < message_class_count; ++c) {
+      append_metric(out, "isimulate_bridge_wire_bytes_total", std::string("class=\"") + class_names[c] + "\"",
+                    static_cast<double>(wire_bytes_[c].load(std::memory_order_relaxed)));
+   }
+   append_metric_help(out, "isimulate_bridge_framing_cpu_seconds_total", "counter",
+                      "CPU time spent compressing and framing outbound messages by class");
+   for (std::size_t c = 0; c < message_class_count; ++c) {
+      append_metric(out, "isimulate_bridge_framing_cpu_seconds_total", std::string("class=\"") + class_names[c] + "\"",
+                    framing_cpu_ns_[c].load(std::memory_order_relaxed) / 1e9);
+   }
+}
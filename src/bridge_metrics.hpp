@@ -0,0 +1,111 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef BRIDGE_METRICS_HPP
+#define BRIDGE_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "websocket_session.hpp"
+
+/**
+ * @brief Latency_Histogram Class is a log-linear (HDR style) histogram of durations.
+ *
+ * Durations are counted in microseconds: exactly below 32 us, above in 16
+ * sub-buckets per power of two, so every bucket is within 6% of its value
+ * from 32 us up to the 2^36 us cap. record() is a few relaxed atomic adds
+ * and may be called from any thread; readers see a consistent enough view
+ * for monitoring.
+ */
+class latency_histogram
+{
+public:
+   static constexpr int sub_bucket_bits = 4;
+   static constexpr int max_magnitude = 36;
+   static constexpr std::size_t bucket_count = (max_magnitude - sub_bucket_bits + 1) << sub_bucket_bits;
+
+   void record(std::chrono::steady_clock::duration d);
+   void record_us(uint64_t us);
+
+   uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+   uint64_t sum_us() const { return sum_us_.load(std::memory_order_relaxed); }
+   uint64_t max_us() const { return max_us_.load(std::memory_order_relaxed); }
+   // upper bound of the bucket holding quantile q (0..1), 0 while empty
+   uint64_t quantile_us(double q) const;
+
+   // Prometheus histogram series, buckets at powers of two from 16 us;
+   // labels without braces, may be empty
+   void render(std::string& out, const char* name, const std::string& labels) const;
+
+   static std::size_t index(uint64_t us);
+   static uint64_t upper_bound(std::size_t index);
+
+private:
+   std::array<std::atomic<uint64_t>, bucket_count> buckets_{};
+   std::atomic<uint64_t> count_{0};
+   std::atomic<uint64_t> sum_us_{0};
+   std::atomic<uint64_t> max_us_{0};
+};
+
+/**
+ * @brief Points an outbound message passes, measured from its origin
+ */
+enum class latency_stage : std::size_t {
+   build = 0,     // origin (AMM sample received) -> do_write
+   queue,         // do_write -> async_write started
+   write,         // async_write started -> completed
+   total,         // origin -> write completed
+   count
+};
+
+constexpr std::size_t latency_stage_count = static_cast<std::size_t>(latency_stage::count);
+constexpr std::size_t message_class_count = 4;
+
+/**
+ * @brief Bridge_Metrics Class collects latencies, parse times and write counters.
+ *
+ * Latencies are kept per message class and stage; the sessions record them
+ * on their strands, the parse times are recorded by the callbacks. render()
+ * writes everything in the Prometheus text format and may run on any thread.
+ */
+class bridge_metrics
+{
+public:
+   latency_histogram& latency(message_class cls, latency_stage stage) {
+      return latency_[static_cast<std::size_t>(cls)][static_cast<std::size_t>(stage)];
+   }
+   void on_written(message_class cls, std::size_t bytes);
+   // socket bytes of a written message, after compression and framing
+   void on_wire(message_class cls, uint64_t bytes);
+   // CPU time to compress and frame a message
+   void on_framed(message_class cls, std::chrono::nanoseconds cpu);
+
+   // inbound websocket messages (routing, parsing and response)
+   latency_histogram websocket_parse;
+   // PhysiologyModification XML
+   latency_histogram physmod_parse;
+   // events waiting for the bridge state machine
+   latency_histogram event_delay;
+
+   void render(std::string& out) const;
+
+   static const char* class_name(message_class cls);
+
+private:
+   std::array<std::array<latency_histogram, latency_stage_count>, message_class_count> latency_;
+   std::array<std::atomic<uint64_t>, message_class_count> written_bytes_{};
+   std::array<std::atomic<uint64_t>, message_class_count> written_messages_{};
+   std::array<std::atomic<uint64_t>, message_class_count> wire_bytes_{};
+   std::array<std::atomic<uint64_t>, message_class_count> framing_cpu_ns_{};
+};
+
+// Prometheus text format helpers; labels without braces, may be empty
+void append_metric_help(std::string& out, const char* name, const char* type, const char* help);
+void append_metric(std::string& out, const char* name, const std::string& labels, double value);
+
+#endif
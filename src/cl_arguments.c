@@ -1,12 +1,80 @@
 
 #include <argp.h>
 
+#define MAX_MONITORS 8
+#define MAX_LOG_RULES 16
+
+// --log-sample TYPE=EVERY[/PER_SECOND]
+struct log_rule {
+   const char *type;                // packet type, * for all
+   int every;                       // log one in every messages
+   int per_second;                  // at most this many per second, 0: no limit
+};
+
 struct arguments {
-   int monitor;
+   int monitor;                     // first monitor model ID
+   int monitors[MAX_MONITORS];      // model IDs, assigned to monitors in discovery order
+   int monitor_count;
+   int threads;
    bool verbose;
    bool autostart;
+   int precision;
+   int min_interval;
+   int max_interval;
+   int keyframe_period;
+   int high_water;
+   const char *endpoint_cache;      // last monitor endpoints, empty to disable
+   bool waveforms;                  // forward AMM waveforms in WaveformPackets
+   int waveform_fps;
+   int waveform_rate;               // output samples/s of every channel, -1 keeps the defaults
+   bool derived_vitals;             // HR and RR computed from the waveforms
+   const char *record;              // input log written from the AMM samples
+   const char *replay;              // input log replayed instead of subscribing to AMM
+   double replay_speed;             // 1 real time, 0 as fast as possible
+   int metrics_port;                // local HTTP port of the Prometheus metrics, 0 to disable
+   const char *flight_recorder;     // dump file prefix of the flight recorder, null to disable
+   int flight_entries;
+   int log_queue;                   // lines buffered for the log writer thread, 0 logs synchronously
+   struct log_rule log_rules[MAX_LOG_RULES];
+   int log_rule_count;
+   const char *waveform_rules;      // event to waveform rule table, empty for the built-in rules
+   int deflate_window;              // permessage-deflate window bits, 0 to disable
+   int deflate_mem_level;
+   int deflate_threshold;           // smallest message compressed, in bytes
+   int cadence;                     // ms between vitals send slots, 0 sends as SIM_TIME arrives
+   int sync_period;                 // ms between SyncTimesPackets, 0 never
+   int tick_timeout;                // ms without a Tick before the timer drives the slots
 } arguments;
 
+// long-only options
+enum {
+   OPT_MIN_INTERVAL = 1000,
+   OPT_MAX_INTERVAL,
+   OPT_KEYFRAME,
+   OPT_HIGH_WATER,
+   OPT_THREADS,
+   OPT_ENDPOINT_CACHE,
+   OPT_WAVEFORMS,
+   OPT_WAVEFORM_FPS,
+   OPT_WAVEFORM_RATE,
+   OPT_DERIVED_VITALS,
+   OPT_RECORD,
+   OPT_REPLAY,
+   OPT_REPLAY_SPEED,
+   OPT_METRICS_PORT,
+   OPT_FLIGHT_RECORDER,
+   OPT_FLIGHT_ENTRIES,
+   OPT_LOG_QUEUE,
+   OPT_LOG_SAMPLE,
+   OPT_WAVEFORM_RULES,
+   OPT_DEFLATE_WINDOW,
+   OPT_DEFLATE_MEM_LEVEL,
+   OPT_DEFLATE_THRESHOLD,
+   OPT_CADENCE,
+   OPT_SYNC_PERIOD,
+   OPT_TICK_TIMEOUT
+};
+
 // set up command line option checking using argp.h
 const char *argp_program_version = "mohses_isimulate_bridge v1.2.0";
 const char *argp_program_bug_address = "<rainer@uw.edu>";
@@ -30,9 +98,35 @@ static char doc[] =
 
 static char args_doc[] = "";
 static struct argp_option options[] = {
-    { "monitor",  'm', "MONITOR", 0, "Select monitor model by ID"},
+    { "monitor",  'm', "MONITOR", 0, "Select monitor model by ID, comma separated for several monitors (e.g. 3,20)"},
     { "autostart",'a', 0, 0, "Autostart monitor"},
     { "verbose",  'v', 0, 0, "Print extra data"},
+    { "precision",'p', "DIGITS", 0, "Max decimal places of vitals sent to monitor (-1: shortest round trip)"},
+    { "min-interval", OPT_MIN_INTERVAL, "MS", 0, "Min time between vitals packets when values change (up to --max-interval)"},
+    { "max-interval", OPT_MAX_INTERVAL, "MS", 0, "Max time between vitals packets when nothing changes"},
+    { "keyframe", OPT_KEYFRAME, "MS", 0, "Period of forced full vitals packets"},
+    { "cadence", OPT_CADENCE, "MS", 0, "Vitals send slots, locked to AMM Ticks (0: send as SIM_TIME arrives)"},
+    { "sync-period", OPT_SYNC_PERIOD, "MS", 0, "Period of SyncTimesPackets while running (0: only on run)"},
+    { "tick-timeout", OPT_TICK_TIMEOUT, "MS", 0, "Time without Ticks before a timer drives the send slots"},
+    { "high-water", OPT_HIGH_WATER, "COUNT", 0, "Outbound queue depth that signals backpressure (at least 1)"},
+    { "threads", OPT_THREADS, "COUNT", 0, "Number of websocket I/O threads"},
+    { "deflate-window", OPT_DEFLATE_WINDOW, "BITS", 0, "Offer permessage-deflate with this window, 9-15 (0: no compression)"},
+    { "deflate-mem-level", OPT_DEFLATE_MEM_LEVEL, "LEVEL", 0, "zlib memory level of the compressor, 1-9"},
+    { "deflate-threshold", OPT_DEFLATE_THRESHOLD, "BYTES", 0, "Send smaller messages uncompressed (Boost 1.76 and later)"},
+    { "waveforms", OPT_WAVEFORMS, 0, 0, "Forward AMM waveforms to the monitor"},
+    { "waveform-fps", OPT_WAVEFORM_FPS, "HZ", 0, "WaveformPackets per second (1-1000)"},
+    { "waveform-rate", OPT_WAVEFORM_RATE, "HZ", 0, "Decimate every waveform channel to this sample rate (0: forward all samples)"},
+    { "waveform-rules", OPT_WAVEFORM_RULES, "FILE", 0, "Rules mapping AMM events to monitor waveforms (empty: built-in rules)"},
+    { "derived-vitals", OPT_DERIVED_VITALS, 0, 0, "Send HR and RR computed from the ECG and CO2 waveforms"},
+    { "endpoint-cache", OPT_ENDPOINT_CACHE, "FILE", 0, "File keeping the last monitor endpoints across restarts (default in config/, empty: off)"},
+    { "record", OPT_RECORD, "FILE", 0, "Record all AMM input samples to FILE"},
+    { "replay", OPT_REPLAY, "FILE", 0, "Replay a recorded input log instead of subscribing to AMM, exit at its end"},
+    { "replay-speed", OPT_REPLAY_SPEED, "FACTOR", 0, "Replay speed (1: real time, 0: as fast as possible)"},
+    { "metrics-port", OPT_METRICS_PORT, "PORT", 0, "Serve latency and queue metrics at http://127.0.0.1:PORT/metrics"},
+    { "flight-recorder", OPT_FLIGHT_RECORDER, "PREFIX", 0, "Trace frames and state changes, dump to PREFIX-*.bin on SIGUSR1, disconnect and crash"},
+    { "flight-entries", OPT_FLIGHT_ENTRIES, "COUNT", 0, "Events kept by the flight recorder (default 16384)"},
+    { "log-queue", OPT_LOG_QUEUE, "COUNT", 0, "Log lines buffered for the console writer thread, dropped when full (0: log synchronously)"},
+    { "log-sample", OPT_LOG_SAMPLE, "TYPE=N[/RATE]", 0, "Log one in N messages of a packet type, at most RATE per second (TYPE * for all)"},
     { 0 }
 };
 
@@ -42,11 +136,17 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
    switch (key) {
       case 'm':
          char *out;
-         arguments->monitor = strtol(arg, &out, 10);
-         if (*out) {
-            argp_usage (state);
-            return ARGP_ERR_UNKNOWN;
+         arguments->monitor_count = 0;
+         for (char *p = arg;; p = out + 1) {
+            int id = strtol(p, &out, 10);
+            if (out == p || (*out && *out != ',') || arguments->monitor_count == MAX_MONITORS) {
+               argp_usage (state);
+               return ARGP_ERR_UNKNOWN;
+            }
+            arguments->monitors[arguments->monitor_count++] = id;
+            if (!*out) break;
          }
+         arguments->monitor = arguments->monitors[0];
          break;
       case 'a':
          arguments->autostart = true;
@@ -54,9 +154,113 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
       case 'v':
          arguments->verbose = true;
          break;
+      case 'p':
+         arguments->precision = strtol(arg, &out, 10);
+         // -1: shortest round trip, lower values are serializer formats (boolean_format)
+         if (out == arg || *out || arguments->precision < -1) {
+            argp_usage (state);
+            return ARGP_ERR_UNKNOWN;
+         }
+         break;
+      case OPT_MIN_INTERVAL:
+      case OPT_MAX_INTERVAL:
+      case OPT_KEYFRAME:
+      case OPT_HIGH_WATER:
+      case OPT_THREADS:
+      case OPT_WAVEFORM_FPS:
+      case OPT_WAVEFORM_RATE:
+      case OPT_METRICS_PORT:
+      case OPT_FLIGHT_ENTRIES:
+      case OPT_LOG_QUEUE:
+      case OPT_DEFLATE_WINDOW:
+      case OPT_DEFLATE_MEM_LEVEL:
+      case OPT_DEFLATE_THRESHOLD:
+      case OPT_CADENCE:
+      case OPT_SYNC_PERIOD:
+      case OPT_TICK_TIMEOUT: {
+         int ms = strtol(arg, &out, 10);
+         if (out == arg || *out || ms < 0 || (key == OPT_HIGH_WATER && ms == 0)
+             || (key == OPT_METRICS_PORT && ms > 65535)
+             || (key == OPT_DEFLATE_WINDOW && ms != 0 && (ms < 9 || ms > 15))
+             || (key == OPT_DEFLATE_MEM_LEVEL && (ms < 1 || ms > 9))) {
+            argp_usage (state);
+            return ARGP_ERR_UNKNOWN;
+         }
+         if (key == OPT_MIN_INTERVAL) arguments->min_interval = ms;
+         else if (key == OPT_MAX_INTERVAL) arguments->max_interval = ms;
+         else if (key == OPT_KEYFRAME) arguments->keyframe_period = ms;
+         else if (key == OPT_HIGH_WATER) arguments->high_water = ms;
+         else if (key == OPT_WAVEFORM_FPS) arguments->waveform_fps = ms < 1 ? 1 : ms > 1000 ? 1000 : ms;
+         else if (key == OPT_WAVEFORM_RATE) arguments->waveform_rate = ms;
+         else if (key == OPT_METRICS_PORT) arguments->metrics_port = ms;
+         else if (key == OPT_FLIGHT_ENTRIES) arguments->flight_entries = ms > 0 ? ms : 1;
+         else if (key == OPT_LOG_QUEUE) arguments->log_queue = ms;
+         else if (key == OPT_DEFLATE_WINDOW) arguments->deflate_window = ms;
+         else if (key == OPT_DEFLATE_MEM_LEVEL) arguments->deflate_mem_level = ms;
+         else if (key == OPT_DEFLATE_THRESHOLD) arguments->deflate_threshold = ms;
+         else if (key == OPT_CADENCE) arguments->cadence = ms;
+         else if (key == OPT_SYNC_PERIOD) arguments->sync_period = ms;
+         else if (key == OPT_TICK_TIMEOUT) arguments->tick_timeout = ms > 0 ? ms : 1;
+         else arguments->threads = ms > 0 ? ms : 1;
+         break;
+      }
+      case OPT_WAVEFORMS:
+         arguments->waveforms = true;
+         break;
+      case OPT_DERIVED_VITALS:
+         arguments->derived_vitals = true;
+         break;
+      case OPT_ENDPOINT_CACHE:
+         arguments->endpoint_cache = arg;
+         break;
+      case OPT_WAVEFORM_RULES:
+         arguments->waveform_rules = arg;
+         break;
+      case OPT_FLIGHT_RECORDER:
+         arguments->flight_recorder = arg;
+         break;
+      case OPT_LOG_SAMPLE: {
+         struct log_rule *rule = &arguments->log_rules[arguments->log_rule_count];
+         char *eq = strchr(arg, '=');
+         if (!eq || eq == arg || arguments->log_rule_count == MAX_LOG_RULES) {
+            argp_usage (state);
+            return ARGP_ERR_UNKNOWN;
+         }
+         *eq = '\0';
+         rule->type = arg;
+         rule->every = strtol(eq + 1, &out, 10);
+         rule->per_second = 0;
+         if (*out == '/') rule->per_second = strtol(out + 1, &out, 10);
+         if (out == eq + 1 || *out || rule->every < 0 || rule->per_second < 0) {
+            argp_usage (state);
+            return ARGP_ERR_UNKNOWN;
+         }
+         arguments->log_rule_count++;
+         break;
+      }
+      case OPT_RECORD:
+         arguments->record = arg;
+         break;
+      case OPT_REPLAY:
+         arguments->replay = arg;
+         break;
+      case OPT_REPLAY_SPEED:
+         arguments->replay_speed = strtod(arg, &out);
+         if (out == arg || *out || arguments->replay_speed < 0) {
+            argp_usage (state);
+            return ARGP_ERR_UNKNOWN;
+         }
+         break;
       case ARGP_KEY_ARG: 
          argp_usage (state);
          break;
+      case ARGP_KEY_END:
+         // options may come in any order, so the pair is checked once all are read
+         if (arguments->min_interval > arguments->max_interval) {
+            argp_error (state, "--min-interval (%d ms) must not exceed --max-interval (%d ms)",
+                        arguments->min_interval, arguments->max_interval);
+         }
+         break;
       default: 
          return ARGP_ERR_UNKNOWN;
    }
@@ -0,0 +1,361 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "derived_vitals.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DERIVED_VITALS_X86 1
+#include <immintrin.h>
+#endif
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+namespace {
+
+// block kernels, one implementation per instruction set
+
+// out[i] = (x[i] - x[i-1])^2, x[-1] = prev
+void diff_square_scalar(const float* x, float prev, float* out, std::size_t n) {
+   for (std::size_t i = 0; i < n; ++i) {
+      const float d = x[i] - prev;
+      out[i] = d * d;
+      prev = x[i];
+   }
+}
+
+void min_max_scalar(const float* x, std::size_t n, float& lo, float& hi) {
+   for (std::size_t i = 0; i < n; ++i) {
+      lo = std::min(lo, x[i]);
+      hi = std::max(hi, x[i]);
+   }
+}
+
+// index of the first sample above (below) level, n if there is none
+std::size_t find_above_scalar(const float* x, std::size_t n, float level) {
+   for (std::size_t i = 0; i < n; ++i) {
+      if (x[i] > level) return i;
+   }
+   return n;
+}
+
+std::size_t find_below_scalar(const float* x, std::size_t n, float level) {
+   for (std::size_t i = 0; i < n; ++i) {
+      if (x[i] < level) return i;
+   }
+   return n;
+}
+
+#if defined(DERIVED_VITALS_X86)
+
+void diff_square_sse2(const float* x, float prev, float* out, std::size_t n) {
+   if (n == 0) return;
+   out[0] = (x[0] - prev) * (x[0] - prev);
+   std::size_t i = 1;
+   for (; i + 4 <= n; i += 4) {
+      const __m128 d = _mm_sub_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(x + i - 1));
+      _mm_storeu_ps(out + i, _mm_mul_ps(d, d));
+   }
+   diff_square_scalar(x + i, x[i - 1], out + i, n - i);
+}
+
+void min_max_sse2(const float* x, std::size_t n, float& lo, float& hi) {
+   std::size_t i = 0;
+   if (n >= 4) {
+      __m128 vlo = _mm_set1_ps(lo);
+      __m128 vhi = _mm_set1_ps(hi);
+      for (; i + 4 <= n; i += 4) {
+         const __m128 v = _mm_loadu_ps(x + i);
+         vlo = _mm_min_ps(vlo, v);
+         vhi = _mm_max_ps(vhi, v);
+      }
+      float l[4], h[4];
+      _mm_storeu_ps(l, vlo);
+      _mm_storeu_ps(h, vhi);
+      lo = std::min(std::min(l[0], l[1]), std::min(l[2], l[3]));
+      hi = std::max(std::max(h[0], h[1]), std::max(h[2], h[3]));
+   }
+   min_max_scalar(x + i, n - i, lo, hi);
+}
+
+std::size_t find_above_sse2(const float* x, std::size_t n, float level) {
+   const __m128 vlevel = _mm_set1_ps(level);
+   std::size_t i = 0;
+   for (; i + 4 <= n; i += 4) {
+      const int mask = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(x + i), vlevel));
+      if (mask) return i + __builtin_ctz(mask);
+   }
+   return i + find_above_scalar(x + i, n - i, level);
+}
+
+std::size_t find_below_sse2(const float* x, std::size_t n, float level) {
+   const __m128 vlevel = _mm_set1_ps(level);
+   std::size_t i = 0;
+   for (; i + 4 <= n; i += 4) {
+      const int mask = _mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(x + i), vlevel));
+      if (mask) return i + __builtin_ctz(mask);
+   }
+   return i + find_below_scalar(x + i, n - i, level);
+}
+
+// AVX versions are compiled for the target only, selected at run time
+__attribute__((target("avx")))
+void diff_square_avx(const float* x, float prev, float* out, std::size_t n) {
+   if (n == 0) return;
+   out[0] = (x[0] - prev) * (x[0] - prev);
+   std::size_t i = 1;
+   for (; i + 8 <= n; i += 8) {
+      const __m256 d = _mm256_sub_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(x + i - 1));
+      _mm256_storeu_ps(out + i, _mm256_mul_ps(d, d));
+   }
+   diff_square_scalar(x + i, x[i - 1], out + i, n - i);
+}
+
+__attribute__((target("avx")))
+void min_max_avx(const float* x, std::size_t n, float& lo, float& hi) {
+   std::size_t i = 0;
+   if (n >= 8) {
+      __m256 vlo = _mm256_set1_ps(lo);
+      __m256 vhi = _mm256_set1_ps(hi);
+      for (; i + 8 <= n; i += 8) {
+         const __m256 v = _mm256_loadu_ps(x + i);
+         vlo = _mm256_min_ps(vlo, v);
+         vhi = _mm256_max_ps(vhi, v);
+      }
+      float l[8], h[8];
+      _mm256_storeu_ps(l, vlo);
+      _mm256_storeu_ps(h, vhi);
+      lo = *std::min_element(l, l + 8);
+      hi = *std::max_element(h, h + 8);
+   }
+   min_max_scalar(x + i, n - i, lo, hi);
+}
+
+__attribute__((target("avx")))
+std::size_t find_above_avx(const float* x, std::size_t n, float level) {
+   const __m256 vlevel = _mm256_set1_ps(level);
+   std::size_t i = 0;
+   for (; i + 8 <= n; i += 8) {
+      const int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(x + i), vlevel, _CMP_GT_OQ));
+      if (mask) return i + __builtin_ctz(mask);
+   }
+   return i + find_above_scalar(x + i, n - i, level);
+}
+
+__attribute__((target("avx")))
+std::size_t find_below_avx(const float* x, std::size_t n, float level) {
+   const __m256 vlevel = _mm256_set1_ps(level);
+   std::size_t i = 0;
+   for (; i + 8 <= n; i += 8) {
+      const int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(x + i), vlevel, _CMP_LT_OQ));
+      if (mask) return i + __builtin_ctz(mask);
+   }
+   return i + find_below_scalar(x + i, n - i, level);
+}
+
+#endif
+
+struct kernel_set {
+   const char* name;
+   void (*diff_square)(const float*, float, float*, std::size_t);
+   void (*min_max)(const float*, std::size_t, float&, float&);
+   std::size_t (*find_above)(const float*, std::size_t, float);
+   std::size_t (*find_below)(const float*, std::size_t, float);
+};
+
+const kernel_set& kernels() {
+   static const kernel_set selected = [] {
+#if defined(DERIVED_VITALS_X86)
+      if (__builtin_cpu_supports("avx")) {
+         return kernel_set{"avx", diff_square_avx, min_max_avx, find_above_avx, find_below_avx};
+      }
+      if (__builtin_cpu_supports("sse2")) {
+         return kernel_set{"sse2", diff_square_sse2, min_max_sse2, find_above_sse2, find_below_sse2};
+      }
+#endif
+      return kernel_set{"scalar", diff_square_scalar, min_max_scalar, find_above_scalar, find_below_scalar};
+   }();
+   return selected;
+}
+
+int64_t to_us(derived_vitals::clock::time_point t) {
+   return duration_cast<microseconds>(t.time_since_epoch()).count();
+}
+
+// mean of the last n intervals (microseconds) as a rate per minute
+template <typename History>
+double rate_per_minute(const History& h, int n) {
+   const std::size_t count = std::min<std::size_t>({h.count, static_cast<std::size_t>(n), h.value.size()});
+   double sum = 0;
+   for (std::size_t k = 1; k <= count; ++k) sum += h.value[(h.count - k) % h.value.size()];
+   return 60e6 * count / sum;
+}
+
+}
+
+derived_vitals::derived_vitals(derived_vitals_config config)
+   : config_(config)
+{
+   ecg_.config = &config_.ecg;
+   abp_.config = &config_.abp;
+   co2_.config = &config_.co2;
+}
+
+const char* derived_vitals::simd_name() {
+   return kernels().name;
+}
+
+template <typename Handler>
+void derived_vitals::detect(detector& d, const float* x, const int64_t* t, std::size_t n, Handler on_event) {
+   const kernel_set& k = kernels();
+   const detector_config& cfg = *d.config;
+
+   float lo = x[0], hi = x[0];
+   k.min_max(x, n, lo, hi);
+   if (!d.initialized) {
+      d.initialized = true;
+      d.env_min = lo;
+      d.env_max = hi;
+   } else {
+      // the envelope jumps out to new extremes and relaxes toward the block's range
+      const double dt = std::max<int64_t>(t[n - 1] - d.last_time_us, 0) / 1e6;
+      const float alpha = static_cast<float>(1.0 - std::exp(-dt / cfg.envelope_tau));
+      d.env_max = std::max(hi, d.env_max + (hi - d.env_max) * alpha);
+      d.env_min = std::min(lo, d.env_min + (lo - d.env_min) * alpha);
+   }
+   d.last_time_us = t[n - 1];
+
+   const float range = d.env_max - d.env_min;
+   if (range < cfg.min_range) return;
+   const float level = d.env_min + cfg.level * range;
+   const float rearm = d.env_min + 0.5f * cfg.level * range;
+   const int64_t refractory_us = duration_cast<microseconds>(cfg.refractory).count();
+
+   std::size_t i = 0;
+   while (i < n) {
+      // hysteresis: the signal has to drop below rearm before the next trigger
+      if (!d.armed) {
+         i += k.find_below(x + i, n - i, rearm);
+         if (i >= n) break;
+         d.armed = true;
+      }
+      i += k.find_above(x + i, n - i, level);
+      if (i >= n) break;
+      d.armed = false;
+      if (t[i] - d.last_event_us >= refractory_us) {
+         d.last_event_us = t[i];
+         on_event(i);
+      }
+   }
+}
+
+void derived_vitals::process(waveform_channel channel, const float* values, const int64_t* times_us, std::size_t n) {
+   if (n == 0) return;
+   switch (channel) {
+      case waveform_channel::ecg: {
+         // QRS complexes stand out in the squared slope
+         if (scratch_.size() < n) scratch_.resize(n);
+         kernels().diff_square(values, ecg_prev_, scratch_.data(), n);
+         ecg_prev_ = values[n - 1];
+         detect(ecg_, scratch_.data(), times_us, n, [&](std::size_t i) { on_beat(times_us[i]); });
+         break;
+      }
+      case waveform_channel::abp: {
+         // a pulse runs from one upstroke to the next, its pressure range is the pulse pressure
+         std::size_t start = 0;
+         detect(abp_, values, times_us, n, [&](std::size_t i) {
+            if (pulse_open_) {
+               kernels().min_max(values + start, i - start, pulse_min_, pulse_max_);
+               on_pulse(times_us[i], pulse_max_ - pulse_min_);
+            }
+            pulse_open_ = true;
+            pulse_min_ = pulse_max_ = values[i];
+            start = i;
+         });
+         if (pulse_open_) kernels().min_max(values + start, n - start, pulse_min_, pulse_max_);
+         break;
+      }
+      case waveform_channel::co2:
+         detect(co2_, values, times_us, n, [&](std::size_t i) { on_breath(times_us[i]); });
+         break;
+      default:
+         break;
+   }
+}
+
+void derived_vitals::on_beat(int64_t t) {
+   const int64_t interval = t - last_beat_us_;
+   last_beat_us_ = t;
+   beats_.fetch_add(1, std::memory_order_relaxed);
+   if (interval < duration_cast<microseconds>(config_.ecg.min_interval).count() ||
+       interval > duration_cast<microseconds>(config_.ecg.max_interval).count()) return;
+   beat_intervals_.push(t, static_cast<double>(interval));
+   store(beat_heart_rate_, 60e6 / interval, t);
+   store(heart_rate_, rate_per_minute(beat_intervals_, config_.hr_average), t);
+}
+
+void derived_vitals::on_pulse(int64_t t, float pulse_pressure) {
+   const int64_t interval = t - last_pulse_us_;
+   last_pulse_us_ = t;
+   if (interval > duration_cast<microseconds>(config_.abp.max_interval).count()) return;
+   pulse_pressures_.push(t, pulse_pressure);
+
+   // PPV = (PPmax - PPmin) / mean(PPmax, PPmin) over the last few breaths
+   double rr = 0;
+   int64_t window_us = 10000000;
+   if (read(resp_rate_, rr, clock::time_point(microseconds(t)), config_.co2.max_interval) && rr > 0) window_us = static_cast<int64_t>(config_.ppv_breaths * 60e6 / rr);
+   double lo = pulse_pressure, hi = pulse_pressure;
+   std::size_t used = 0;
+   const std::size_t size = pulse_pressures_.value.size();
+   for (std::size_t k = 1; k <= std::min(pulse_pressures_.count, size); ++k) {
+      const std::size_t slot = (pulse_pressures_.count - k) % size;
+      if (t - pulse_pressures_.time_us[slot] > window_us) break;
+      lo = std::min(lo, pulse_pressures_.value[slot]);
+      hi = std::max(hi, pulse_pressures_.value[slot]);
+      ++used;
+   }
+   if (used < 4 || hi + lo <= 0) return;
+   store(ppv_, 100.0 * (hi - lo) / ((hi + lo) / 2), t);
+}
+
+void derived_vitals::on_breath(int64_t t) {
+   const int64_t interval = t - last_breath_us_;
+   last_breath_us_ = t;
+   breaths_.fetch_add(1, std::memory_order_relaxed);
+   if (interval < duration_cast<microseconds>(config_.co2.min_interval).count() ||
+       interval > duration_cast<microseconds>(config_.co2.max_interval).count()) return;
+   breath_intervals_.push(t, static_cast<double>(interval));
+   store(resp_rate_, rate_per_minute(breath_intervals_, config_.rr_average), t);
+}
+
+void derived_vitals::store(result& r, double value, int64_t t) {
+   r.value.store(value, std::memory_order_relaxed);
+   r.time_us.store(t, std::memory_order_release);
+}
+
+bool derived_vitals::read(const result& r, double& value, clock::time_point now, milliseconds max_age) {
+   const int64_t t = r.time_us.load(std::memory_order_acquire);
+   if (t == 0 || to_us(now) - t > duration_cast<microseconds>(max_age).count()) return false;
+   value = r.value.load(std::memory_order_relaxed);
+   return true;
+}
+
+bool derived_vitals::heart_rate(double& bpm, clock::time_point now) const {
+   return read(heart_rate_, bpm, now, config_.ecg.max_interval);
+}
+
+bool derived_vitals::beat_heart_rate(double& bpm, clock::time_point now) const {
+   return read(beat_heart_rate_, bpm, now, config_.ecg.max_interval);
+}
+
+bool derived_vitals::pulse_pressure_variation(double& percent, clock::time_point now) const {
+   return read(ppv_, percent, now, config_.co2.max_interval);
+}
+
+bool derived_vitals::resp_rate(double& per_minute, clock::time_point now) const {
+   return read(resp_rate_, per_minute, now, config_.co2.max_interval);
+}
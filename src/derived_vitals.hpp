@@ -0,0 +1,138 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef DERIVED_VITALS_HPP
+#define DERIVED_VITALS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "waveform_pipeline.hpp"
+
+/**
+ * @brief Tuning of one event detector
+ */
+struct detector_config {
+   float level;               // trigger level as fraction of the envelope range
+   float min_range;           // smaller envelope ranges are treated as a flat line
+   double envelope_tau;       // seconds for the envelope to follow a lower signal
+   std::chrono::milliseconds refractory;
+   std::chrono::milliseconds min_interval;   // accepted event spacing
+   std::chrono::milliseconds max_interval;
+};
+
+struct derived_vitals_config {
+   detector_config ecg{0.3f, 1e-6f, 2.0, std::chrono::milliseconds(250),
+                       std::chrono::milliseconds(250), std::chrono::milliseconds(3000)};
+   detector_config abp{0.5f, 5.0f, 3.0, std::chrono::milliseconds(250),
+                       std::chrono::milliseconds(250), std::chrono::milliseconds(3000)};
+   detector_config co2{0.5f, 3.0f, 8.0, std::chrono::milliseconds(1000),
+                       std::chrono::milliseconds(1000), std::chrono::milliseconds(20000)};
+   int hr_average = 4;         // beats averaged into the heart rate
+   int rr_average = 3;         // breaths averaged into the respiration rate
+   int ppv_breaths = 3;        // PPV window in breaths, 10 s while RR is unknown
+};
+
+/**
+ * @brief Derived_Vitals Class computes HR, PPV and RR from raw waveform blocks.
+ *
+ * Heart beats are detected on the ECG slope energy, pulses and breaths on
+ * threshold crossings of the arterial pressure and capnogram, each against
+ * an adaptive envelope. Block kernels (slope energy, min/max, threshold
+ * search) use AVX or SSE2 where the CPU has it and plain loops elsewhere, so
+ * the per-sample work is a few vector instructions and the scalar state
+ * machine only runs around detected events.
+ *
+ * process() is called from one thread (the waveform frame timer); the
+ * results may be read from any thread.
+ */
+class derived_vitals
+{
+public:
+   using clock = std::chrono::steady_clock;
+
+   explicit derived_vitals(derived_vitals_config config = derived_vitals_config());
+
+   // feed a block of raw samples, times in steady clock microseconds
+   void process(waveform_channel channel, const float* values, const int64_t* times_us, std::size_t n);
+
+   // latest results; false while there is no recent value
+   bool heart_rate(double& bpm, clock::time_point now) const;
+   bool beat_heart_rate(double& bpm, clock::time_point now) const;   // last beat only
+   bool pulse_pressure_variation(double& percent, clock::time_point now) const;
+   bool resp_rate(double& per_minute, clock::time_point now) const;
+
+   uint64_t beats() const { return beats_.load(std::memory_order_relaxed); }
+   uint64_t breaths() const { return breaths_.load(std::memory_order_relaxed); }
+
+   // instruction set the kernels run on: "avx", "sse2" or "scalar"
+   static const char* simd_name();
+
+private:
+   struct detector {
+      const detector_config* config = nullptr;
+      bool initialized = false;
+      bool armed = false;
+      float env_min = 0;
+      float env_max = 0;
+      int64_t last_time_us = 0;
+      int64_t last_event_us = 0;
+   };
+
+   // fixed size history of event intervals or pulse pressures
+   struct history {
+      std::array<double, 64> value{};
+      std::array<int64_t, 64> time_us{};
+      std::size_t count = 0;     // total pushed
+      void push(int64_t t, double v) {
+         value[count % value.size()] = v;
+         time_us[count % value.size()] = t;
+         ++count;
+      }
+   };
+
+   struct result {
+      std::atomic<double> value{0};
+      std::atomic<int64_t> time_us{0};    // 0 while there is no value
+   };
+
+   template <typename Handler>
+   void detect(detector& d, const float* x, const int64_t* t, std::size_t n, Handler on_event);
+
+   void on_beat(int64_t t);
+   void on_pulse(int64_t t, float pulse_pressure);
+   void on_breath(int64_t t);
+
+   static bool read(const result& r, double& value, clock::time_point now, std::chrono::milliseconds max_age);
+   static void store(result& r, double value, int64_t t);
+
+   derived_vitals_config config_;
+   detector ecg_;
+   detector abp_;
+   detector co2_;
+   std::vector<float> scratch_;     // ECG slope energy
+
+   history beat_intervals_;
+   history breath_intervals_;
+   history pulse_pressures_;
+   int64_t last_beat_us_ = 0;
+   int64_t last_breath_us_ = 0;
+   int64_t last_pulse_us_ = 0;
+   float pulse_min_ = 0;            // extremes of the pulse being measured
+   float pulse_max_ = 0;
+   bool pulse_open_ = false;
+   float ecg_prev_ = 0;
+
+   result heart_rate_;
+   result beat_heart_rate_;
+   result ppv_;
+   result resp_rate_;
+   std::atomic<uint64_t> beats_{0};
+   std::atomic<uint64_t> breaths_{0};
+};
+
+#endif
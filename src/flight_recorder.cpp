@@ -0,0 +1,158 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "amm/BaseLogger.h"
+#include "flight_recorder.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace flight_log;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::nanoseconds;
+
+namespace {
+
+// the recorder dumped by the crash handler
+flight_recorder* crash_recorder = nullptr;
+
+const int crash_signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+int64_t steady_ns() {
+   return duration_cast<nanoseconds>(flight_recorder::clock::now().time_since_epoch()).count();
+}
+
+bool write_all(int fd, const void* data, std::size_t size) {
+   const char* p = static_cast<const char*>(data);
+   while (size) {
+      const ssize_t n = ::write(fd, p, size);
+      if (n < 0) {
+         if (errno == EINTR) continue;
+         return false;
+      }
+      p += n;
+      size -= static_cast<std::size_t>(n);
+   }
+   return true;
+}
+
+}
+
+void flight_recorder::start(const std::string& prefix, std::size_t capacity) {
+   std::size_t size = 2;
+   while (size < capacity) size <<= 1;
+   slots_.reset(new slot[size]);
+   mask_ = size - 1;
+   prefix_ = prefix;
+   std::snprintf(crash_file_, sizeof(crash_file_), "%s-%d-crash.bin", prefix_.c_str(), static_cast<int>(getpid()));
+}
+
+void flight_recorder::record(event kind, uint16_t session, uint32_t arg, const char* data, std::size_t size, uint8_t cls) {
+   if (!slots_) return;
+   const uint64_t n = next_.fetch_add(1, std::memory_order_relaxed);
+   slot& s = slots_[n & mask_];
+   // seqlock: readers ignore the slot until seq is set again
+   s.seq.store(0, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+   s.time_ns = steady_ns();
+   s.kind = static_cast<uint8_t>(kind);
+   s.cls = cls;
+   s.session = session;
+   s.size = static_cast<uint32_t>(size);
+   s.arg = arg;
+   // write events pass only the size
+   const std::size_t head = data ? std::min(size, head_size) : 0;
+   if (head) std::memcpy(s.head, data, head);
+   if (head < head_size) std::memset(s.head + head, 0, head_size - head);
+   s.seq.store(n + 1, std::memory_order_release);
+}
+
+file_header flight_recorder::header(dump_reason reason) const {
+   file_header h;
+   std::memcpy(h.magic, magic, sizeof(magic));
+   h.version = version;
+   h.entry_size = sizeof(entry);
+   h.capacity = mask_ + 1;
+   h.next = next_.load(std::memory_order_relaxed);
+   h.dump_steady_ns = steady_ns();
+   h.dump_system_us = duration_cast<microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+   h.reason = static_cast<uint32_t>(reason);
+   h.pid = static_cast<uint32_t>(getpid());
+   return h;
+}
+
+std::string flight_recorder::dump(dump_reason reason) {
+   if (!slots_) return std::string();
+   record(event::dump, 0, static_cast<uint32_t>(reason));
+
+   // consistent copy of every slot, torn ones are cleared
+   const std::size_t capacity = mask_ + 1;
+   std::vector<entry> snapshot(capacity);
+   for (std::size_t i = 0; i < capacity; ++i) {
+      const slot& s = slots_[i];
+      entry& e = snapshot[i];
+      const uint64_t before = s.seq.load(std::memory_order_acquire);
+      e.time_ns = s.time_ns;
+      e.kind = s.kind;
+      e.cls = s.cls;
+      e.session = s.session;
+      e.size = s.size;
+      e.arg = s.arg;
+      std::memcpy(e.head, s.head, head_size);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const uint64_t after = s.seq.load(std::memory_order_relaxed);
+      e.seq = before == after ? before : 0;
+   }
+   const file_header h = header(reason);
+
+   char name[320];
+   std::snprintf(name, sizeof(name), "%s-%u-%u-%s.bin", prefix_.c_str(), h.pid,
+                 dumps_.fetch_add(1, std::memory_order_relaxed) + 1, reason_name(h.reason));
+   std::FILE* f = std::fopen(name, "wb");
+   if (!f) {
+      LOG_ERROR << "Could not write flight recorder dump " << name;
+      return std::string();
+   }
+   const bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1
+                   && std::fwrite(snapshot.data(), sizeof(entry), capacity, f) == capacity;
+   if (std::fclose(f) != 0 || !ok) {
+      LOG_ERROR << "Could not write flight recorder dump " << name;
+      return std::string();
+   }
+   return name;
+}
+
+void flight_recorder::install_crash_handler() {
+   if (!slots_) return;
+   crash_recorder = this;
+   struct sigaction sa;
+   std::memset(&sa, 0, sizeof(sa));
+   sa.sa_handler = crash_handler;
+   sigemptyset(&sa.sa_mask);
+   // the default action is back in place when the signal is raised again
+   sa.sa_flags = SA_RESETHAND;
+   for (int sig : crash_signals) sigaction(sig, &sa, nullptr);
+}
+
+void flight_recorder::crash_handler(int sig) {
+   flight_recorder* r = crash_recorder;
+   crash_recorder = nullptr;
+   if (r) {
+      // the raw ring, the decoder sorts out entries that were being written
+      const int fd = ::open(r->crash_file_, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if (fd >= 0) {
+         const file_header h = r->header(dump_reason::crash);
+         if (write_all(fd, &h, sizeof(h))) write_all(fd, r->slots_.get(), (r->mask_ + 1) * sizeof(slot));
+         ::close(fd);
+      }
+   }
+   raise(sig);
+}
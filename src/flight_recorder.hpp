@@ -0,0 +1,148 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef FLIGHT_RECORDER_HPP
+#define FLIGHT_RECORDER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * @brief Flight recorder dump layout, shared with the flight_decode tool.
+ *
+ * A file header followed by the raw ring: capacity entries of 64 bytes in
+ * slot order. An entry is valid if its seq is not 0 and belongs to its
+ * slot ((seq - 1) % capacity == slot); sorting valid entries by seq gives
+ * the event order.
+ */
+namespace flight_log {
+
+constexpr char magic[8] = {'A', 'M', 'M', 'F', 'L', 'I', 'G', 'H'};
+constexpr uint32_t version = 1;
+constexpr std::size_t head_size = 36;
+
+enum class event : uint8_t {
+   ws_connected = 1,    // websocket handshake done
+   ws_closed,           // session ended
+   ws_read,             // inbound frame
+   ws_enqueue,          // outbound frame accepted by do_write, arg: queue depth
+   ws_coalesced,        // replaced a queued message of its class
+   ws_dropped,          // queue full
+   ws_write_start,      // arg: queue wait in us
+   ws_write_done,       // arg: write time in us, size: bytes on the wire
+   sim_control,         // arg: AMM control type
+   sim_state,           // arg: new sim_status
+   monitor_initialized, // arg: monitor model ID
+   dump                 // arg: dump reason
+};
+
+enum class dump_reason : uint32_t {
+   signal = 1,          // SIGUSR1
+   disconnect,
+   crash
+};
+
+struct file_header {
+   char magic[8];
+   uint32_t version;
+   uint32_t entry_size;
+   uint64_t capacity;
+   uint64_t next;             // events recorded before the dump
+   int64_t dump_steady_ns;    // steady clock at the dump, entries use the same clock
+   int64_t dump_system_us;    // system clock at the dump
+   uint32_t reason;
+   uint32_t pid;
+};
+
+struct entry {
+   uint64_t seq;              // event number + 1, 0 while being written
+   int64_t time_ns;           // steady clock
+   uint8_t kind;              // event
+   uint8_t cls;               // message class of frames
+   uint16_t session;          // monitor session id, 0 for bridge events
+   uint32_t size;             // full frame size, the head keeps its start
+   uint32_t arg;
+   char head[head_size];
+};
+
+static_assert(sizeof(file_header) == 56, "flight recorder file header layout");
+static_assert(sizeof(entry) == 64, "flight recorder entry layout");
+
+inline const char* event_name(uint8_t kind) {
+   static const char* const names[] = {
+      "?", "ws_connected", "ws_closed", "ws_read", "ws_enqueue", "ws_coalesced", "ws_dropped",
+      "ws_write_start", "ws_write_done", "sim_control", "sim_state", "monitor_initialized", "dump"
+   };
+   return kind < sizeof(names) / sizeof(names[0]) ? names[kind] : names[0];
+}
+
+inline const char* reason_name(uint32_t reason) {
+   static const char* const names[] = {"?", "signal", "disconnect", "crash"};
+   return reason < sizeof(names) / sizeof(names[0]) ? names[reason] : names[0];
+}
+
+}
+
+/**
+ * @brief Flight_Recorder Class keeps the latest protocol events in a fixed lock-free ring.
+ *
+ * record() claims a slot with one atomic add and overwrites the oldest
+ * event; each slot is a small seqlock, so a dump taken while the bridge
+ * runs skips entries that were being written. Only the first bytes of a
+ * frame are kept. dump() writes the ring to <prefix>-<pid>-<n>-<reason>.bin;
+ * the crash handler writes the raw ring with async-signal-safe calls only.
+ *
+ * record() and dump() may be called from any thread.
+ */
+class flight_recorder
+{
+public:
+   using clock = std::chrono::steady_clock;
+
+   flight_recorder() = default;
+   flight_recorder(const flight_recorder&) = delete;
+   flight_recorder& operator=(const flight_recorder&) = delete;
+
+   // allocate capacity entries (rounded up to a power of two), not thread safe
+   void start(const std::string& prefix, std::size_t capacity);
+   bool enabled() const { return slots_ != nullptr; }
+
+   void record(flight_log::event kind, uint16_t session = 0, uint32_t arg = 0,
+               const char* data = nullptr, std::size_t size = 0, uint8_t cls = 0);
+
+   // write a consistent snapshot, returns the file name or an empty string
+   std::string dump(flight_log::dump_reason reason);
+   // dump on SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT, then die as before
+   void install_crash_handler();
+
+   uint64_t events() const { return next_.load(std::memory_order_relaxed); }
+
+private:
+   struct slot {
+      std::atomic<uint64_t> seq{0};
+      int64_t time_ns;
+      uint8_t kind;
+      uint8_t cls;
+      uint16_t session;
+      uint32_t size;
+      uint32_t arg;
+      char head[flight_log::head_size];
+   };
+   static_assert(sizeof(slot) == sizeof(flight_log::entry), "slot and entry layout differ");
+
+   flight_log::file_header header(flight_log::dump_reason reason) const;
+   static void crash_handler(int sig);
+
+   std::unique_ptr<slot[]> slots_;
+   std::size_t mask_ = 0;
+   alignas(64) std::atomic<uint64_t> next_{0};
+   alignas(64) std::atomic<uint32_t> dumps_{0};
+   std::string prefix_;
+   char crash_file_[256] = {0};
+};
+
+#endif
@@ -5,8 +5,11 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <sstream>
+#include <future>
 
 #include <amm_std.h>
 #include <signal.h>
@@ -16,282 +19,440 @@
 #include "rapidjson/document.h"
 #include "rapidjson/writer.h"
 
-/// xml library
-#include "tinyxml2.h"
-
 #include "websocket_session.hpp"
+#include "vitals_store.hpp"
+#include "isimulate_packets.hpp"
+#include "send_policy.hpp"
+#include "inbound_message.hpp"
+#include "session_manager.hpp"
+#include "service_discovery.hpp"
+#include "reconnect_controller.hpp"
+#include "waveform_pipeline.hpp"
+#include "derived_vitals.hpp"
+#include "input_log.hpp"
+#include "bridge_metrics.hpp"
+#include "metrics_server.hpp"
+#include "flight_recorder.hpp"
+#include "async_log_appender.hpp"
+#include "log_sampler.hpp"
+#include "waveform_rules.hpp"
+#include "physmod_parser.hpp"
+#include "bridge_actor.hpp"
+#include "send_scheduler.hpp"
+#include "startup_timeline.hpp"
 
 extern "C" {
-   #include "service_discovery.h"
    #include "cl_arguments.c"
 }
 
 using namespace AMM;
 using namespace std::chrono;
 using namespace rapidjson;
-using namespace tinyxml2;
 
 // declare DDSManager for this module
 const std::string moduleName = "iSimulate Bridge";
 const std::string configFile = "config/isimulate_bridge_amm.xml";
-AMM::DDSManager<void>* mgr = new AMM::DDSManager<void>(configFile);
-AMM::UUID m_uuid;
+// phase timestamps from process start to the first vitals on a monitor
+startup_timeline startup;
 
-//std::mutex nds_mutex;
-std::map<std::string, std::string> nodeDataStorage = {
-      {"Cardiovascular_HeartRate", "0"},
-      {"Cardiovascular_Arterial_Systolic_Pressure", "0"},
-      {"Cardiovascular_Arterial_Diastolic_Pressure", "0"},
-      {"BloodChemistry_Oxygen_Saturation", "0"},
-      {"Respiration_EndTidalCarbonDioxide", "0"},
-      {"Respiratory_Respiration_Rate", "0"},
-      {"Energy_Core_Temperature", "0"},
-      {"SIM_TIME", "0"},
-   };
-
-// init monitor waveforms
-int ecgWaveform = 9;       // 9 -> Sinus
-int bpWaveform = 0;        // 0 -> Normal
-int spo2Waveform = 0;      // 0 -> Normal
-int etco2Waveform = 0;     // 0 -> Normal
-
-// initialize module state
-int sim_status = 0;  // 0 - initial/reset, 1 - running, 2 - paused
+// created by setupDds() on its own thread, usable once ddsReady is
+AMM::DDSManager<void>* mgr = nullptr;
+AMM::UUID m_uuid;
+std::promise<void> ddsReadyPromise;
+std::shared_future<void> ddsReady = ddsReadyPromise.get_future().share();
+// module description files, read while DDS starts
+std::string moduleCapabilities;
+std::string moduleConfiguration;
+// bridge strand only: an AMM sample arrived, the module was announced after it
+bool ammSeen = false;
+bool ammAnnounced = false;
+
+// latest physiology values used by the monitor, written by DDS threads
+vitals_store vitals;
+
+// monitor waveforms, ectopics and interference, set by AMM events through the rule table
+waveform_rules waveformRules;
+monitor_settings monitorSettings(waveformRules.defaults());
+// decoded PhysiologyModification payloads, most are repeats
+physmod_cache physmodCache(waveformRules);
+
+// websocket sessions for asynchronous read/write to iSimulate devices,
+// one per discovered monitor, all on one io_context
+net::io_context ioc;
+session_manager sessions(ioc);
+// mDNS browser for iSimulate monitors, runs on the same io_context
+service_discovery discovery(ioc);
+// retries dropped monitors at their last endpoint while discovery runs
+reconnect_controller reconnect(ioc, sessions);
+net::executor_work_guard<net::io_context::executor_type> ioWork = net::make_work_guard(ioc);
+
+// bridge state machine: DDS listeners, the replay and the monitor sessions post
+// events, the on* handlers below run on its strand one at a time
+bridge_actor bridge(ioc);
+// bridge strand only
+scenario_state simState = scenario_state::initial;
 int64_t lastTick = 0;
+steady_clock::time_point lastVitalsReceived;   // latest SIM_TIME, origin of the next ChangeActionPacket
+// vitals and SyncTimes cadence, phase-locked to the AMM Tick (--cadence)
+send_scheduler sendScheduler(bridge.executor());
+
+// packets without slots never change: rendered once, every write shares the bytes
+template <std::size_t N>
+shared_message renderStaticPacket(const packet_segment (&layout)[N]) {
+   packet_buffer buffer;
+   return make_shared_message(packet_template(layout).render(buffer, packet_values()));
+}
 
-// websocket session for asynchronous read/write to iSimulate device
-net::io_context ioc;
-auto ws_session = std::make_shared<websocket_session>(ioc); 
-bool try_reconnect = true;
-bool websocket_connected = false;
-bool monitor_initialized = false;
+// outbound packets, rendered from the layouts in isimulate_packets.hpp
+packet_template connectionTypeTemplate(connection_type_packet);
+const shared_message settingsMessage = renderStaticPacket(settings_packet);
+packet_template scenarioTemplate(scenario_packet);
+packet_template changeActionTemplate(change_action_packet);
+packet_template syncTimesTemplate(sync_times_packet);
+packet_template scenarioChangeStateTemplate(scenario_change_state_packet);
+const shared_message powerOnMessage = renderStaticPacket(power_on_packet);
+const shared_message visibilityMessage = renderStaticPacket(visibility_packet);
+const shared_message nibpMessage = renderStaticPacket(nibp_packet);
+packet_template changeMonitorTemplate(change_monitor_packet);
+const shared_message disconnectMessage = renderStaticPacket(disconnect_packet);
+
+// decides which vitals updates are forwarded to the monitor
+send_policy changeActionPolicy;
+
+// packets are only built on the bridge strand, one render buffer is enough
+packet_buffer packetBuffer;
+
+// AMM waveform samples, batched into WaveformPackets by a frame timer
+waveform_pipeline waveforms;
+net::steady_timer waveformTimer(bridge.executor());
+// set by shutdownBridge(), bridge strand only: frame handlers already queued do not re-arm
+bool shuttingDown = false;
+packet_buffer waveformBuffer(16384);   // frame timer only
+// beat-to-beat HR, PPV and RR from the raw waveform blocks
+derived_vitals derivedVitals;
+
+// capture of the AMM input (--record) and its replay in place of DDS (--replay)
+input_recorder recorder;
+input_replay replay;
+
+// latency histograms and counters, served in Prometheus format (--metrics-port)
+bridge_metrics metrics;
+metrics_server metricsServer(ioc);
+
+// latest frames and state changes, dumped for post-mortems (--flight-recorder)
+flight_recorder flight;
+net::signal_set flightDumpSignal(ioc);
+
+// console logging on a writer thread (--log-queue), sampled per packet type (--log-sample)
+async_log_appender* logAppender = nullptr;
+log_sampler logSampler;
+
+// log a startup phase the first time it is reached
+void markStartup(startup_phase phase) {
+   if (!startup.mark(phase)) return;
+   LOG_INFO << "Startup " << to_string(phase) << " after " << startup.elapsed(phase).count() / 1000 << " ms";
+   if (phase == startup_phase::first_vitals) {
+      LOG_INFO << "Time to first vitals: " << startup.elapsed(phase).count() / 1000 << " ms (" << startup.summary() << ")";
+   }
+}
+
+// the only place the scenario state changes, bridge strand only
+void setSimState(scenario_state state) {
+   if (state != simState) LOG_DEBUG << "Scenario state " << to_string(simState) << " -> " << to_string(state);
+   simState = state;
+   sendScheduler.set_active(state == scenario_state::running);
+   flight.record(flight_log::event::sim_state, 0, static_cast<uint32_t>(state));
+}
+
+// collect current values for the numeric packet slots
+packet_values currentPacketValues(const monitor_session* session = nullptr) {
+   packet_values values;
+   values.set_vitals(vitals);
+   monitorSettings.fill(values);
+   values[packet_field::monitor_type] = session ? session->monitor_type : arguments.monitor;
+   if ( arguments.derived_vitals ) {
+      // waveform derived rates replace the engine's values while they are current
+      const auto now = steady_clock::now();
+      double rate;
+      if (derivedVitals.heart_rate(rate, now)) values[packet_field::heart_rate] = rate;
+      if (derivedVitals.resp_rate(rate, now)) values[packet_field::resp_rate] = rate;
+   }
+   return values;
+}
+
+// apply command line precision to the vitals in ChangeActionPacket
+void setVitalPrecision(int precision) {
+   for (std::size_t i = 0; i < vital_count; ++i) {
+      if (static_cast<vital>(i) == vital::sim_time) continue;
+      changeActionTemplate.set_precision(static_cast<packet_field>(i), precision);
+   }
+}
+
+// send to one monitor, or to every connected monitor when session is null;
+// origin is when the AMM data in the packet arrived, for the latency metrics
+bool sendPacket(monitor_session* session, const shared_message& message,
+                message_class cls = message_class::control, bool initializedOnly = false,
+                steady_clock::time_point origin = steady_clock::time_point()) {
+   if (session) return session->ws->do_write(message, cls, origin);
+   return sessions.broadcast(message, cls, initializedOnly, origin);
+}
 
-std::string host = "";
-std::string port = "";
-const std::string target = "/";
+// render into a message of its own, shared by every session it is sent to; bridge strand
+shared_message renderPacket(const packet_template& layout, const packet_values& values) {
+   return make_shared_message(layout.render(packetBuffer, values));
+}
+
+// log an outbound packet unless its type is sampled out or over its rate
+void logOutbound(const char* type, const std::string& message) {
+   if (logSampler.admit(type)) LOG_DEBUG << "Writing message to iSimulate: " << message;
+}
 
 //write data packets to websocket
-void writeConnectionTypePacket(int con) {
-   std::string message = "{\"type\":\"ConnectionTypePacket\",\"connectionType\":" + std::to_string(con) + "}";
+void writeConnectionTypePacket(monitor_session* session, int con) {
+   packet_values values = currentPacketValues(session);
+   values[packet_field::connection_type] = con;
+   const shared_message message = renderPacket(connectionTypeTemplate, values);
    // iSimulate monitor should respond with settings request and scenario request
-   LOG_DEBUG << "Writing message to iSimulate: " << message;
-   ws_session->do_write(message);
-}
-
-void writeSettingsPacket() {
-   std::string message =  "{\"type\": \"SettingsPacket\""
-      ",\"tempMeasureF\":true"
-      ",\"etco2MeasurekPa\":false"
-      ",\"cprDepthMeasureInch\":false"
-      ",\"pacingThreshold\":50"
-      ",\"preserveCO2\":true"
-      ",\"seeThruCPR\":true"
-      ",\"pacerCapture\":true"
-      ",\"monitorControlsVolume\":true"
-      ",\"nibpMeasure\":0,\"weightMeasure\":0,\"ibpMeasure\":0}";
-   LOG_DEBUG << "Writing message to iSimulate: " << message;
-   ws_session->do_write(message);
-}
-
-void writeScenarioPacket() {
-   std::string message = "{\"type\": \"ScenarioCurrentStatePacket\""
-      ",\"scenarioData\": {\"scenarioId\": \"\""
-                           ",\"scenarioType\": \"Vital Signs\""
-                           ",\"scenarioName\": \"\""
-                           ",\"scenarioTime\": 600"
-                           ",\"scenarioMonitorType\": " + std::to_string(arguments.monitor) +
-                           ",\"scenarioStory\": {\"history\": \"\""
-                                                ",\"course\": \"\""
-                                                ",\"discussion\": \"\"}"
-                           ",\"patientInformation\": {\"patientName\": \"\""
-                                                      ",\"patientSex\":0"
-                                                      ",\"patientCondition\": \"\""
-                                                      ",\"patientAdmitted\": 0"
-                                                      ",\"patientAge\": 30"
-                                                      ",\"patientPhotoId\":0}}"
-      ",\"scenarioState\": 0"
-      ",\"studentInfo\": {\"studentName\": \"\""
-                        ",\"studentNumber\": \"\""
-                        ",\"studentEmail\": \"\"}}";
-   LOG_DEBUG << "Writing message to iSimulate: " << message;
-   ws_session->do_write(message);
-}
-
-void writeChangeActionPacket() {
-   std::string message =  "{\"type\": \"ChangeActionPacket\","
-      "\"trendTime\": 0"
-      ",\"hr\":" + nodeDataStorage["Cardiovascular_HeartRate"] +
-      ",\"bpSys\":" + nodeDataStorage["Cardiovascular_Arterial_Systolic_Pressure"] +
-      ",\"bpDia\":" + nodeDataStorage["Cardiovascular_Arterial_Diastolic_Pressure"] +
-      ",\"spo2\":" + nodeDataStorage["BloodChemistry_Oxygen_Saturation"] +
-      ",\"etco2\":" + nodeDataStorage["Respiration_EndTidalCarbonDioxide"] +
-      ",\"respRate\":" + nodeDataStorage["Respiratory_Respiration_Rate"] +
-      ",\"temp\":" + nodeDataStorage["Energy_Core_Temperature"] +
-      ",\"cust1\":0,\"cust2\":0,\"cust3\":0,"
-      "\"cvp\":10,\"cvpWaveform\":0,\"cvpVisible\":true,\"cvpAmplitude\": 2,\"cvpVariation\": 1,"
-      "\"icp\":10,\"icpWaveform\":0,\"icpVisible\":true,\"icpAmplitude\": 2,\"icpVariation\": 1,"
-      "\"icpLundbergAEnabled\": false,\"icpLundbergBEnabled\": false,"
-      "\"papSys\":20,\"papDia\":10,\"papWaveform\": 0,\"papVisible\":true,\"papVariation\": 2,"
-      "\"ecgWaveform\": " + std::to_string(ecgWaveform) +
-      ",\"bpWaveform\": " + std::to_string(bpWaveform) +
-      ",\"spo2Waveform\": " + std::to_string(spo2Waveform) +
-      ",\"etco2Waveform\": " + std::to_string(etco2Waveform) +
-      ",\"ecgVisible\": true,\"bpVisible\":true,\"spo2Visible\": true,"
-      "\"etco2Visible\": true,\"rrVisible\": true,\"tempVisible\": true,"
-      "\"custVisible1\": false,\"custVisible2\":false,\"custVisible3\":false,"
-      "\"custLabel1\":\"\",\"custLabel2\":\"\",\"custLabel3\":\"\","
-      "\"custMeasureLabel1\":\"\",\"custMeasureLabel2\":\"\",\"custMeasureLabel3\": \"\","
-      "\"ectopicsPac\": 0,\"ectopicsPjc\": 0,\"ectopicsPvc\": 0,"
-      "\"perfusion\":0,"
-      "\"electricalInterference\":false,\"articInterference\":0,\"svvInterference\":0,\"sinusArrhythmiaInterference\": 1,"
-      "\"ventilated\":false,"
-      "\"electrodeStatus\": [true, true, true, true, true, true, true, true, true, true,true, true]"
-      "}";
+   logOutbound("ConnectionTypePacket", *message);
+   sendPacket(session, message);
+}
+
+void writeSettingsPacket(monitor_session* session) {
+   logOutbound("SettingsPacket", *settingsMessage);
+   sendPacket(session, settingsMessage);
+}
+
+void writeScenarioPacket(monitor_session* session) {
+   const shared_message message = renderPacket(scenarioTemplate, currentPacketValues(session));
+   logOutbound("ScenarioCurrentStatePacket", *message);
+   sendPacket(session, message);
+}
+
+void writeChangeActionPacket(const packet_values& values, steady_clock::time_point origin = steady_clock::time_point()) {
+   const shared_message message = renderPacket(changeActionTemplate, values);
    if ( arguments.verbose )
-      LOG_DEBUG << "Writing message to iSimulate: " << message;
+      logOutbound("ChangeActionPacket", *message);
    // else 
    //   LOG_DEBUG << "Writing message to iSimulate: {\"type\": \"ChangeActionPacket\" ...}";
-   ws_session->do_write(message);
+   if (!sendPacket(nullptr, message, message_class::vitals, false, origin) && arguments.verbose)
+      LOG_DEBUG << "iSimulate link backpressure";
+}
+
+// bring one monitor up to date right away instead of waiting for the next SIM_TIME
+void writeChangeActionPacket(monitor_session* session) {
+   const shared_message message = renderPacket(changeActionTemplate, currentPacketValues(session));
+   if ( arguments.verbose )
+      logOutbound("ChangeActionPacket", *message);
+   sendPacket(session, message, message_class::vitals);
 }
 
-void writeSyncTimesPacket() {
-   std::string message =  "{\"type\": \"SyncTimesPacket\""
-      ",\"actualTime\":0"
-      ",\"virtualTime\":" + nodeDataStorage["SIM_TIME"] +
-      ",\"alarmTime\":0,\"isVirtualTimePaused\":false}";
-   LOG_DEBUG << "Writing message to iSimulate: " << message; //{\"type\": \"SyncTimesPacket\" ...}";
-   ws_session->do_write(message);
+void writeSyncTimesPacket(monitor_session* session) {
+   const shared_message message = renderPacket(syncTimesTemplate, currentPacketValues(session));
+   logOutbound("SyncTimesPacket", *message);
+   sendPacket(session, message, message_class::sync);
 }
 
-void writeScenarioChangeStatePacket(int state) {
+void writeScenarioChangeStatePacket(monitor_session* session, scenario_state state, bool initializedOnly = false) {
    // requestedState values: 0 - initial, 1 - running, 2 - paused, 3 - finished
-   std::string message =  "{\"type\":\"ScenarioChangeStatePacket\",\"requestedState\":" + std::to_string(state) + "}";
-   LOG_DEBUG << "Writing message to iSimulate: " << message;
-   ws_session->do_write(message);
+   packet_values values = currentPacketValues(session);
+   values[packet_field::requested_state] = static_cast<int>(state);
+   const shared_message message = renderPacket(scenarioChangeStateTemplate, values);
+   logOutbound("ScenarioChangeStatePacket", *message);
+   sendPacket(session, message, message_class::control, initializedOnly);
 }
 
-void writePowerOnPacket() {
-   std::string message =  "{\"type\":\"PowerOnPacket\"}";
-   LOG_DEBUG << "Writing message to iSimulate: " << message;
-   ws_session->do_write(message);
+void writePowerOnPacket(monitor_session* session) {
+   logOutbound("PowerOnPacket", *powerOnMessage);
+   sendPacket(session, powerOnMessage);
 }
 
-void writeVisibilityPacket() {
-   std::string message =  "{\"type\": \"VisibilityPacket\","
-      "\"ecgVisible\": true,"
-      "\"bpVisible\": true,"
-      "\"spo2Visible\":true,"
-      "\"etco2Visible\": true,"
-      "\"rrVisible\": true,"
-      "\"tempVisible\": true,"
-      "\"custVisible1\": true,"
-      "\"custVisible2\": true,"
-      "\"custVisible3\": true,"
-      "\"cvpVisible\": true,"
-      "\"icpVisible\": true,"
-      "\"papVisible\": true,"
-      "}";
-   LOG_DEBUG << "Writing message to iSimulate: " << message;
-   ws_session->do_write(message);
+void writeVisibilityPacket(monitor_session* session) {
+   logOutbound("VisibilityPacket", *visibilityMessage);
+   sendPacket(session, visibilityMessage);
 }
 
-void writeNibpPacket() {
-   std::string message =  "{\"type\": \"NibpPacket\",\"subType\": 0,\"bpSys\": 0,\"bpDia\": 0}";
-   LOG_DEBUG << "Writing message to iSimulate: " << message;
-   ws_session->do_write(message);
+void writeNibpPacket(monitor_session* session) {
+   logOutbound("NibpPacket", *nibpMessage);
+   sendPacket(session, nibpMessage);
 }
 
-void writeChangeMonitorPacket() {
-   std::string message =  "{\"type\": \"ChangeMonitorPacket\""
-      ",\"monitorState\":" + std::to_string(arguments.monitor) + "}";
-   LOG_DEBUG << "Writing message to iSimulate: " << message;
-   ws_session->do_write(message);
+void writeChangeMonitorPacket(monitor_session* session) {
+   const shared_message message = renderPacket(changeMonitorTemplate, currentPacketValues(session));
+   logOutbound("ChangeMonitorPacket", *message);
+   sendPacket(session, message);
 }
 
-void writeDisconnectPackage() {
-   std::string message =  "{\"type\":\"DisconnectPacket\"}";
-   LOG_DEBUG << "Writing message to iSimulate: " << message;
-   ws_session->do_write(message);
+void writeDisconnectPackage(monitor_session* session) {
+   logOutbound("DisconnectPacket", *disconnectMessage);
+   sendPacket(session, disconnectMessage);
 }
 
 // callback function for new data on websocket
-void onNewWebsocketMessage(const std::string body) {
-   // parse web socket message as json data
-   std::string type;
-   Document document;
-   document.Parse(body.c_str());
-
-   if (document.HasMember("type") && document["type"].IsString()) {
-      type = document["type"].GetString();
-      if (type.compare("DebriefPacket") == 0) {
-         // ignore debrief, only log message type
-         LOG_DEBUG << "iSimulate message: {\"type\": \"DebriefPacket\", ...}";
-         return;
+void handleWebsocketMessage(monitor_session& session, char* data, std::size_t size) {
+   // route on the type member before (and mostly instead of) parsing
+   const inbound_type type = scan_message_type(data, size);
+   const beast::string_view body(data, size);
+
+   if (type == inbound_type::debrief) {
+      // ignore debrief, only log message type
+      if (logSampler.admit(to_string(type))) LOG_DEBUG << "iSimulate message: {\"type\": \"DebriefPacket\", ...}";
+      return;
+   }
+   if (type == inbound_type::none) {
+      LOG_ERROR << "iSimulate message (no type): " << body ;
+      return;
+   }
+   if (logSampler.admit(to_string(type))) LOG_DEBUG << "iSimulate message: " << body ;
+
+   switch (type) {
+      case inbound_type::settings_request:
+      case inbound_type::scenario_request:
+         bridge.post(bridge_event::monitor_message(session.shared_from_this(), type));
+         break;
+
+      case inbound_type::scenario_current_state: {
+         // parsed here, in place; the bridge strand only gets the state
+         const current_state_message message = parse_current_state(data);
+         if (!message.valid) {
+            LOG_ERROR << "iSimulate message (parse error " << message.parse_error << ")";
+            break;
+         }
+         if (message.has_state) {
+            bridge.post(bridge_event::monitor_message(session.shared_from_this(), type, message.state));
+         }
+         break;
       }
-      LOG_DEBUG << "iSimulate message: " << body ;
-      if (type.compare("SettingsRequestPacket") == 0) {
-         writeSettingsPacket();
-      } else if (type.compare("ScenarioRequestPacket") == 0) {
+
+      case inbound_type::disconnect:
+         // monitor is closing websocket connection
+         // pending async_read returns with eof
+         // which should result in io context running out of work, returning and connection being reset
+         // ioc.stop();
+         break;
+
+      default:
+         break;
+   }
+}
+
+// the monitor is up to date and gets vitals from now on
+void setMonitorInitialized(monitor_session& session) {
+   changeActionPolicy.reset();
+   session.initialized = true;
+   markStartup(startup_phase::monitor_initialized);
+   flight.record(flight_log::event::monitor_initialized, static_cast<uint16_t>(session.id), session.monitor_type);
+   writeChangeActionPacket(&session);
+}
+
+// monitor requests, bridge strand
+void onMonitorMessage(monitor_session& session, inbound_type type, int64_t scenarioState) {
+   switch (type) {
+      case inbound_type::settings_request:
+         writeSettingsPacket(&session);
+         break;
+
+      case inbound_type::scenario_request:
          // respond to request
-         writeScenarioPacket();
+         writeScenarioPacket(&session);
          // then fire up monitor
-         writeSyncTimesPacket();
-         if (arguments.autostart) writePowerOnPacket();
-         writeScenarioChangeStatePacket(sim_status);
-         writeVisibilityPacket();
-         monitor_initialized = true;
+         writeSyncTimesPacket(&session);
+         if (arguments.autostart) writePowerOnPacket(&session);
+         writeScenarioChangeStatePacket(&session, simState);
+         writeVisibilityPacket(&session);
          //writeNibpPacket();
-         //writeChangeActionPacket();
-      } else if (type.compare("ScenarioCurrentStatePacket") == 0) {
+         setMonitorInitialized(session);
+         break;
+
+      case inbound_type::scenario_current_state:
          // monitor sends this if it has already been initialized (and running or paused) when connection is established
          // bridge module cannot distinguish between paused and reset/init state of sim on startup
          // when sim is not running and monitor is paused assume the sim is paused
-         if (document.HasMember("scenarioState") && document["scenarioState"].IsInt()) {
-            int scenarioState = document["scenarioState"].GetInt();
-            if (scenarioState == 2 && sim_status == 0 ) writeScenarioChangeStatePacket(2);
-            else writeScenarioChangeStatePacket(sim_status);
-            monitor_initialized = true;
-         }
-      } else if (type.compare("DisconnectPacket") == 0) {
-         // monitor is closing websocket connection
-         // pending async_read returns with eof
-         // which should result in io context running out of work, returning and connection being reset
-         // ioc.stop();
-      }
-   } else {
-      LOG_ERROR << "iSimulate message (no type): " << body ;
+         if (scenarioState == static_cast<int>(scenario_state::paused) && simState == scenario_state::initial)
+            writeScenarioChangeStatePacket(&session, scenario_state::paused);
+         else writeScenarioChangeStatePacket(&session, simState);
+         setMonitorInitialized(session);
+         break;
+
+      default:
+         break;
    }
 }
 
-// init iSimulate device
-void onWebsocketHandshake(const std::string body) {
-   websocket_connected = true;
-   writeConnectionTypePacket(1);
+void onNewWebsocketMessage(monitor_session& session, char* data, std::size_t size) {
+   if ( !arguments.metrics_port ) return handleWebsocketMessage(session, data, size);
+   const auto start = steady_clock::now();
+   handleWebsocketMessage(session, data, size);
+   metrics.websocket_parse.record(steady_clock::now() - start);
+}
+
+void logSendPolicyCounters() {
+   LOG_INFO << "ChangeActionPacket sent: " << changeActionPolicy.sent()
+            << " (keyframes: " << changeActionPolicy.keyframes() << ")"
+            << " suppressed: " << changeActionPolicy.suppressed();
+}
+
+void logOutboundCounters(const monitor_session& session) {
+   logSendPolicyCounters();
+   LOG_INFO << "Outbound queue of monitor " << session.id << " depth: " << session.ws->queue_depth()
+            << " coalesced: " << session.ws->coalesced()
+            << " dropped: " << session.ws->dropped();
+}
+
+void onWebsocketHandshake(monitor_session& session) {
+   bridge.post(bridge_event::monitor_connected(session.shared_from_this()));
+}
+
+void onWebsocketClosed(monitor_session& session) {
+   bridge.post(bridge_event::monitor_closed(session.shared_from_this()));
+}
+
+// init iSimulate device, bridge strand
+void onMonitorConnected(monitor_session& session) {
+   markStartup(startup_phase::monitor_connected);
+   reconnect.on_connected(session);
+   writeConnectionTypePacket(&session, 1);
    // iSimulate monitor should respond with settings request and scenario request
 }
 
-void OnNewSimulationControl(AMM::SimulationControl& simControl, eprosima::fastrtps::SampleInfo_t* info) {
-   std::string message;
+void onMonitorClosed(monitor_session& session) {
+   LOG_INFO << "Connection to iSimulate monitor " << session.id << " (" << session.key << ") closed.";
+   logOutboundCounters(session);
+   if (flight.enabled()) {
+      const std::string dump = flight.dump(flight_log::dump_reason::disconnect);
+      if (!dump.empty()) LOG_INFO << "Flight recorder dumped to " << dump;
+   }
+   reconnect.on_closed(session);
+}
+
+void onWebsocketWritten(monitor_session& session, message_class cls, std::size_t bytes) {
+   // vitals reach the screen once the monitor has been initialized
+   if (cls == message_class::vitals && session.initialized) {
+      reconnect.on_vitals_written(session);
+      if (!startup.reached(startup_phase::first_vitals)) markStartup(startup_phase::first_vitals);
+   }
+}
 
-   switch (simControl.type()) {
+// SimulationControl, bridge strand
+void onSimControl(AMM::ControlType type) {
+   switch (type) {
       case AMM::ControlType::RUN :
 
          // write last recorded SIM_TIME to monitor
          // TODO: iSimulate may need to fix. does not work as expected
-         writeSyncTimesPacket();
+         writeSyncTimesPacket(nullptr);
 
-         sim_status = 1;
+         setSimState(scenario_state::running);
          // requestedState 1 = running
-         writeScenarioChangeStatePacket(sim_status);
+         writeScenarioChangeStatePacket(nullptr, simState);
 
          LOG_INFO << "SimControl Message recieved; Run sim.";
          break;
 
       case AMM::ControlType::HALT :
 
-         sim_status = 2;
+         setSimState(scenario_state::paused);
          // requestedState 2 = stopped
-         writeScenarioChangeStatePacket(sim_status);
+         writeScenarioChangeStatePacket(nullptr, simState);
 
          LOG_INFO << "SimControl Message recieved; Halt sim.";
          break;
@@ -299,16 +460,15 @@ void OnNewSimulationControl(AMM::SimulationControl& simControl, eprosima::fastrt
       case AMM::ControlType::RESET :
 
          //TODO: clear data and send to monitor before stopping
-         nodeDataStorage.clear();
+         vitals.reset();
          // reset waveforms to default
-         ecgWaveform = 9;
-         bpWaveform = 0;
-         spo2Waveform = 0;
-         etco2Waveform = 0; 
+         monitorSettings.reset(waveformRules.defaults());
+         changeActionPolicy.reset();
+         waveforms.reset();
 
-         sim_status = 0;
-         writeScenarioChangeStatePacket(0); // set monitor to pause state
-         writeConnectionTypePacket(1);
+         setSimState(scenario_state::initial);
+         writeScenarioChangeStatePacket(nullptr, scenario_state::initial); // set monitor to pause state
+         writeConnectionTypePacket(nullptr, 1);
 
          LOG_INFO << "SimControl Message recieved; Reset sim.";
 
@@ -322,41 +482,73 @@ void OnNewSimulationControl(AMM::SimulationControl& simControl, eprosima::fastrt
    }
 }
 
-void OnNewTick(AMM::Tick& tick, eprosima::fastrtps::SampleInfo_t* info) {
-   //if ( arguments.verbose )
-   //   LOG_DEBUG << "Tick received!";
-   if ( sim_status == 0 && tick.frame() > lastTick) {
-      LOG_DEBUG << "Tick received! sim_status:" << sim_status << "->1 lastTick:" << lastTick << " tick.frame(): " << tick.frame();
-      sim_status = 1;
-      if ( websocket_connected && monitor_initialized ) writeScenarioChangeStatePacket(sim_status);
+// Tick, bridge strand
+void onTick(int64_t frame, steady_clock::time_point received) {
+   if ( simState == scenario_state::initial && frame > lastTick) {
+      LOG_DEBUG << "Tick received! state: " << to_string(simState) << " -> running lastTick: " << lastTick << " frame: " << frame;
+      setSimState(scenario_state::running);
+      writeScenarioChangeStatePacket(nullptr, simState, true);
    }
-   lastTick = tick.frame();
+   lastTick = frame;
+   if ( arguments.cadence ) sendScheduler.on_tick(frame, received);
 }
 
-void OnPhysiologyValue(AMM::PhysiologyValue& physiologyvalue, eprosima::fastrtps::SampleInfo_t* info){
-   //const std::lock_guard<std::mutex> lock(nds_mutex);
-   // store all received phys values
-   if (!std::isnan(physiologyvalue.value())) {
-      nodeDataStorage[physiologyvalue.name()] = std::to_string(physiologyvalue.value());
-      //if ( arguments.verbose )
-      //   LOG_DEBUG << "[AMM_Node_Data] " << physiologyvalue.name() << " = " << physiologyvalue.value();
+// vitals sample, bridge strand
+void onVital(vital slot, double value, steady_clock::time_point received) {
+   // store raw value, formatting happens when a packet is built
+   vitals.update(slot, value);
+   if (slot != vital::sim_time) return;
+   // while the scenario runs the scheduler sends the latest values on its own
+   // cadence; initial and paused keep sending on every SIM_TIME as before
+   lastVitalsReceived = received;
+   if ( !arguments.cadence || simState != scenario_state::running ) {
       // phys values are updated every 200ms (5Hz)
       // forward to iSimulate device only once per data update
       // reduce frequency
-      if (physiologyvalue.name()=="SIM_TIME") {
-         // reformat SIM_TIME for storage
-         std::ostringstream oss;
-         oss.precision(1);
-         oss << std::fixed << physiologyvalue.value();
-         nodeDataStorage["SIM_TIME"] = oss.str();
-         //LOG_DEBUG << "sim time stringstream: " << oss.str();
-         // send data if websocket connection to monitor is live
-         if ( websocket_connected ) writeChangeActionPacket();
+      // send data if websocket connection to monitor is live
+      // and something the monitor shows has changed
+      if ( sessions.any_connected() ) {
+         packet_values values = currentPacketValues();
+         send_reason reason = changeActionPolicy.evaluate(values, received);
+         if (reason != send_reason::none) writeChangeActionPacket(values, received);
       }
    }
+}
+
+// send slot of the scheduler, bridge strand
+void onSendSlot(steady_clock::time_point now, bool sync) {
+   if ( !sessions.any_connected() ) return;
+   if (sync) writeSyncTimesPacket(nullptr);
+   packet_values values = currentPacketValues();
+   send_reason reason = changeActionPolicy.evaluate(values, now);
+   if (reason != send_reason::none) writeChangeActionPacket(values, lastVitalsReceived);
+}
+
+void OnNewSimulationControl(AMM::SimulationControl& simControl, eprosima::fastrtps::SampleInfo_t* info) {
+   if ( arguments.record ) recorder.record(simControl);
+   flight.record(flight_log::event::sim_control, 0, static_cast<uint32_t>(simControl.type()));
+   bridge.post(bridge_event::sim_control(static_cast<int32_t>(simControl.type())));
+}
+
+void OnNewTick(AMM::Tick& tick, eprosima::fastrtps::SampleInfo_t* info) {
+   if ( arguments.record ) recorder.record(tick);
+   //if ( arguments.verbose )
+   //   LOG_DEBUG << "Tick received!";
+   bridge.post(bridge_event::tick(tick.frame(), steady_clock::now()));
+}
+
+void OnPhysiologyValue(AMM::PhysiologyValue& physiologyvalue, eprosima::fastrtps::SampleInfo_t* info){
+   if ( arguments.record ) recorder.record(physiologyvalue);
+   // only values shown on the monitor are kept; everything else is dropped here,
+   // most by the length of the name alone (the AMM API has no content filter)
+   vital slot;
+   if (!vitals_store::accept(physiologyvalue.name(), physiologyvalue.value(), slot)) return;
+   //if ( arguments.verbose )
+   //   LOG_DEBUG << "[AMM_Node_Data] " << physiologyvalue.name() << " = " << physiologyvalue.value();
+   bridge.post(bridge_event::vital(slot, physiologyvalue.value(), steady_clock::now()));
 
    static bool printRRdata = true;  // set flag to print only initial value received
-   if (physiologyvalue.name()=="Respiratory_Respiration_Rate"){
+   if (slot == vital::resp_rate){
       if ( arguments.verbose && printRRdata ) {
          LOG_DEBUG << "[AMM_Node_Data] Respiratory_Respiration_Rate" << "=" << physiologyvalue.value();
          printRRdata = false;
@@ -365,15 +557,77 @@ void OnPhysiologyValue(AMM::PhysiologyValue& physiologyvalue, eprosima::fastrtps
 }
 
 void OnPhysiologyWaveform(AMM::PhysiologyWaveform &waveform, SampleInfo_t *info) {
+   if ( arguments.record ) recorder.record(waveform);
    // testing mohses data connection
    static int printHFdata = 10;   // initialize counter to print first xx high freequency data points
    if ( arguments.verbose && printHFdata > 0) {
       LOG_DEBUG << "[AMM_Node_Data](HF) " << waveform.name() << "=" << waveform.value();
       printHFdata -= 1;
    }
+   if ( !arguments.waveforms && !arguments.derived_vitals ) return;
+   waveform_channel channel;
+   if (!waveform_pipeline::resolve(waveform.name(), channel)) return;
+   // timestamp on arrival, batching and decimation happen on the frame timer
+   waveforms.push(channel, waveform.value(), steady_clock::now());
+}
+
+// send one WaveformPacket per frame to the initialized monitors
+void scheduleWaveformFrame() {
+   waveformTimer.expires_at(waveformTimer.expiry() + waveforms.config().frame_period);
+   waveformTimer.async_wait([](error_code ec) {
+      if (ec || shuttingDown) return;
+      const auto now = steady_clock::now();
+      if (waveforms.flush(waveformBuffer, now) && arguments.waveforms && sessions.any_connected()) {
+         sessions.broadcast(make_shared_message(waveformBuffer.str()), message_class::waveform, true, now);
+      }
+      scheduleWaveformFrame();
+   });
+}
+
+void logSchedulerCounters() {
+   const latency_histogram& jitter = sendScheduler.jitter();
+   LOG_INFO << "Send slots on Tick: " << sendScheduler.tick_slots()
+            << " on timer: " << sendScheduler.timer_slots()
+            << " SyncTimes: " << sendScheduler.syncs()
+            << " jitter p50: " << jitter.quantile_us(0.5) << " us"
+            << " p99: " << jitter.quantile_us(0.99) << " us"
+            << " max: " << jitter.max_us() << " us";
+}
+
+void logWaveformCounters() {
+   LOG_INFO << "Waveform samples received: " << waveforms.received()
+            << " sent: " << waveforms.samples_sent()
+            << " in " << waveforms.frames() << " frames"
+            << " overruns: " << waveforms.overruns()
+            << " stale: " << waveforms.stale();
+}
+
+void logDerivedVitals() {
+   const auto now = steady_clock::now();
+   double hr = 0, ppv = 0, rr = 0;
+   const bool hasHr = derivedVitals.heart_rate(hr, now);
+   const bool hasPpv = derivedVitals.pulse_pressure_variation(ppv, now);
+   const bool hasRr = derivedVitals.resp_rate(rr, now);
+   LOG_INFO << "Derived vitals (" << derived_vitals::simd_name() << ") beats: " << derivedVitals.beats()
+            << " breaths: " << derivedVitals.breaths()
+            << " HR: " << (hasHr ? std::to_string(hr) : "-")
+            << " PPV: " << (hasPpv ? std::to_string(ppv) : "-")
+            << " RR: " << (hasRr ? std::to_string(rr) : "-");
+}
+
+// set the monitor fields of a rule band, bridge strand
+void applyWaveformRule(const rule_band* band) {
+   if (!band) return;
+   for (const auto& action : band->actions) {
+      monitorSettings.set(action.field, action.value);
+      LOG_INFO << "Setting " << waveform_rules::field_name(action.field) << " to " << action.value
+               << (action.label.empty() ? "" : " -> ") << action.label;
+   }
+   // waveform type updated on monitor with next ChangeActionPacket
 }
 
 void OnNewRenderModification(AMM::RenderModification &rendMod, SampleInfo_t *info) {
+   if ( arguments.record ) recorder.record(rendMod);
    // LOG_DEBUG << "Render Modification received:\n"
    //          << "Type:      " << rendMod.type() << "\n"
    //          << "Data:      " << rendMod.data();
@@ -382,57 +636,35 @@ void OnNewRenderModification(AMM::RenderModification &rendMod, SampleInfo_t *inf
    //    LOG_INFO << "Patient entered state: Tachypnea. Setting EtCO2 waveform to 2 -> Obstructive 2";
    //    // waveform type updated on monitor with next ChangeActionPacket
    // }
-   if ( rendMod.type()=="PATIENT_STATE_TACHYCARDIA" ) {
-      ecgWaveform = 14;
-      LOG_INFO << "Patient entered state: Tachycardia. Setting ECG waveform to 14 -> Ventricular Tachycardia";
+   const std::string& type = rendMod.type();
+   if ( const waveform_rule* rule = waveformRules.find(rule_source::render_modification, type) ) {
+      LOG_INFO << "Patient entered state: " << type;
+      bridge.post(bridge_event::waveform_rule(rule->match(0)));
    }
 }
 
 //<?xml version="1.0" encoding="UTF-8"?><PhysiologyModification type="AirwayObstruction"><Severity>0.5</Severity></PhysiologyModification>
 void OnNewPhysiologyModification(AMM::PhysiologyModification &physMod, SampleInfo_t *info) {
+   if ( arguments.record ) recorder.record(physMod);
    // LOG_DEBUG << "Physiology Modification received:\n"
    //          << "Type:      " << physMod.type() << "\n"
    //          << "Data:      " << physMod.data();
-   tinyxml2::XMLDocument doc;
-   doc.Parse(physMod.data().c_str());
-
-   if (doc.ErrorID() == 0) {
-      tinyxml2::XMLElement* pRoot;
-
-      pRoot = doc.FirstChildElement("PhysiologyModification");
-
-      while (pRoot) {
-         std::string pmType = pRoot->ToElement()->Attribute("type");
-         boost::algorithm::to_lower(pmType);
-         //LOG_INFO << "Physmod type " << pmType;
-
-         if (pmType == "airwayobstruction") {
-            // Type:      PhysiologyModification
-            // Data:      <?xml version="1.0" encoding="UTF-8"?><PhysiologyModification type="AirwayObstruction"><Severity>0.5</Severity></PhysiologyModification>
-            double pmSev = std::stod(pRoot->FirstChildElement("Severity")->ToElement()->GetText());
-            LOG_INFO << "Physiology Modification received: AirwayObstruction. Severity:" << pmSev;
-            if (pmSev > 0.6) {
-               etco2Waveform = 2;
-               LOG_INFO << "Setting EtCO2 waveform to 2 -> Obstructive 2";
-            } else if (pmSev > 0.2) {
-               etco2Waveform = 1;
-               LOG_INFO << "Setting EtCO2 waveform to 1 -> Obstructive 1";
-            } else {
-               etco2Waveform = 0;
-               LOG_INFO << "Setting EtCO2 waveform to 0 -> Normal";
-            }
-            // waveform type updated on monitor with next ChangeActionPacket
-            return;
-         } else {
-            LOG_DEBUG << "Physiology Modification received:\n"
-                     << "Type:      " << pmType << "\n"
-                     << "Data:      " << physMod.data();
-            return;
-         }
-      }
+   const auto parseStart = steady_clock::now();
+   const physmod_action& action = physmodCache.lookup(physMod.data());
+   if ( arguments.metrics_port ) metrics.physmod_parse.record(steady_clock::now() - parseStart);
+
+   if ( !action.valid ) {
+      LOG_ERROR << "Malformed Physiology Modification: " << physMod.data();
+      return;
+   }
+   // Data:      <?xml version="1.0" encoding="UTF-8"?><PhysiologyModification type="AirwayObstruction"><Severity>0.5</Severity></PhysiologyModification>
+   if ( action.rule ) {
+      LOG_INFO << "Physiology Modification received: " << action.type << ". Severity:" << action.severity;
+      bridge.post(bridge_event::waveform_rule(action.band));
    } else {
-      //LOG_ERROR << "Document parsing error, ID: " << doc.ErrorID();
-      //doc.PrintError();
+      LOG_DEBUG << "Physiology Modification received:\n"
+               << "Type:      " << action.type << "\n"
+               << "Data:      " << physMod.data();
    }
 }
 
@@ -445,8 +677,7 @@ void PublishOperationalDescription() {
     od.module_id(m_uuid);
     od.module_version("1.2.0");
     od.description("A bridge module to connect MoHSES to an iSimulate patient monitor.");
-    const std::string capabilities = AMM::Utility::read_file_to_string("config/isimulate_bridge_capabilities.xml");
-    od.capabilities_schema(capabilities);
+    od.capabilities_schema(moduleCapabilities);
     od.description();
     mgr->WriteOperationalDescription(od);
 }
@@ -457,37 +688,53 @@ void PublishConfiguration() {
     mc.timestamp(ms);
     mc.module_id(m_uuid);
     mc.name(moduleName);
-    const std::string configuration = AMM::Utility::read_file_to_string("config/isimulate_bridge_configuration.xml");
-    mc.capabilities_configuration(configuration);
+    mc.capabilities_configuration(moduleConfiguration);
     mgr->WriteModuleConfiguration(mc);
 }
 
-void checkForExit() {
-   // wait for key press
-   std::cin.get();
-   std::cout << "Key pressed ... Shutting down." << std::endl;
+// the first AMM sample proves the AMM peers are matched, bridge strand;
+// if it came before ddsReady, setupDds() calls again once the module is published
+void onAmmSample() {
+   if (ammAnnounced) return;
+   ammSeen = true;
+   if (ddsReady.wait_for(seconds(0)) != std::future_status::ready) return;
+   PublishOperationalDescription();
+   PublishConfiguration();
+   ammAnnounced = true;
+}
 
-   // stop() will cause run() to return and leave the reconnect loop
-   try_reconnect = false;
-   ioc.stop();
+// DDS participant, subscriptions and module announcement; runs on its own
+// thread so discovery and the monitor connections do not wait for it
+void setupDds() {
+   auto capabilities = std::async(std::launch::async, AMM::Utility::read_file_to_string,
+                                  std::string("config/isimulate_bridge_capabilities.xml"));
+   auto configuration = std::async(std::launch::async, AMM::Utility::read_file_to_string,
+                                   std::string("config/isimulate_bridge_configuration.xml"));
 
-   // Raise SIGTERM to trigger async signal handler
-   //std::raise(SIGTERM);
-}
+   mgr = new AMM::DDSManager<void>(configFile);
+   markStartup(startup_phase::dds_participant);
 
-int main(int argc, char *argv[]) {
+   // subscriptions first, they are on the way to the first vitals
+   if ( !arguments.replay ) {
+      mgr->InitializeSimulationControl();
+      mgr->CreateSimulationControlSubscriber(&OnNewSimulationControl);
 
-   // set default command line options. process.
-   arguments.monitor = 3;
-   arguments.autostart = false;
-   arguments.verbose = false;
-   argp_parse(&argp, argc, argv, 0, 0, &arguments);
+      mgr->InitializeTick();
+      mgr->CreateTickSubscriber(&OnNewTick);
 
-   static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
-   plog::init(plog::verbose, &consoleAppender);
+      mgr->InitializePhysiologyValue();
+      mgr->CreatePhysiologyValueSubscriber(&OnPhysiologyValue);
 
-   LOG_INFO << "=== [ iSimulate Bridge ] ===";
-   LOG_INFO << "Monitor model ID = " << arguments.monitor;
+      mgr->InitializePhysiologyWaveform();
+      mgr->CreatePhysiologyWaveformSubscriber(&OnPhysiologyWaveform);
+
+      mgr->InitializeRenderModification();
+      mgr->CreateRenderModificationSubscriber(&OnNewRenderModification);
+
+      mgr->InitializePhysiologyModification();
+      mgr->CreatePhysiologyModificationSubscriber(&OnNewPhysiologyModification);
+   }
+   markStartup(startup_phase::dds_subscribers);
 
    mgr->InitializeOperationalDescription();
    mgr->CreateOperationalDescriptionPublisher();
@@ -495,88 +742,436 @@ int main(int argc, char *argv[]) {
    mgr->InitializeModuleConfiguration();
    mgr->CreateModuleConfigurationPublisher();
 
-   mgr->InitializeSimulationControl();
-   mgr->CreateSimulationControlSubscriber(&OnNewSimulationControl);
-
    mgr->InitializeStatus();
    mgr->CreateStatusPublisher();
 
-   mgr->InitializeTick();
-   mgr->CreateTickSubscriber(&OnNewTick);
+   m_uuid.id(mgr->GenerateUuidString());
+   markStartup(startup_phase::dds_publishers);
+
+   moduleCapabilities = capabilities.get();
+   moduleConfiguration = configuration.get();
+   ddsReadyPromise.set_value();
 
-   mgr->InitializePhysiologyValue();
-   mgr->CreatePhysiologyValueSubscriber(&OnPhysiologyValue);
+   // announced right away; announced again with the first AMM sample in case
+   // no reader had been matched yet (this replaces a fixed 250 ms wait)
+   PublishOperationalDescription();
+   PublishConfiguration();
+   markStartup(startup_phase::module_published);
+
+   // samples that came while the publishers were created did not announce
+   net::post(bridge.executor(), []() {
+      if (ammSeen) onAmmSample();
+   });
+}
+
+// the bridge state machine: every event, in the order it was posted
+void handleBridgeEvent(bridge_event& ev) {
+   switch (ev.type) {
+      case bridge_event::kind::sim_control:
+         onAmmSample();
+         onSimControl(static_cast<AMM::ControlType>(ev.code));
+         break;
+      case bridge_event::kind::tick:
+         onAmmSample();
+         onTick(ev.frame, ev.received);
+         break;
+      case bridge_event::kind::vital:
+         onAmmSample();
+         onVital(static_cast<vital>(ev.code), ev.value, ev.received);
+         break;
+      case bridge_event::kind::waveform_rule:
+         applyWaveformRule(ev.band);
+         break;
+      case bridge_event::kind::monitor_connected:
+         onMonitorConnected(*ev.session);
+         break;
+      case bridge_event::kind::monitor_message:
+         onMonitorMessage(*ev.session, static_cast<inbound_type>(ev.code), ev.frame);
+         break;
+      case bridge_event::kind::monitor_closed:
+         onMonitorClosed(*ev.session);
+         break;
+      default:
+         break;
+   }
+}
 
-   mgr->InitializePhysiologyWaveform();
-   mgr->CreatePhysiologyWaveformSubscriber(&OnPhysiologyWaveform);
+// a monitor service appeared, moved or went away
+void onServiceEvent(const service_event& ev) {
+   switch (ev.kind) {
+      case service_event::added:
+      case service_event::updated:
+         LOG_INFO << "Monitor '" << ev.name << "' " << (ev.kind == service_event::added ? "discovered" : "moved")
+                  << " at " << ev.address << ":" << ev.port;
+         // every resolved service gets its own session
+         LOG_INFO << "Connecting to iSimulate monitor.";
+         reconnect.on_service(ev);
+         sessions.open(ev.name, ev.address, std::to_string(ev.port));
+         break;
+      case service_event::removed:
+         LOG_INFO << "Monitor '" << ev.name << "' removed";
+         reconnect.on_service(ev);
+         sessions.close(ev.name);
+         break;
+   }
+}
 
-   mgr->InitializeRenderModification();
-   mgr->CreateRenderModificationSubscriber(&OnNewRenderModification);
+// Prometheus page: latency histograms plus the counters kept by the bridge's parts
+void renderMetrics(std::string& out) {
+   metrics.render(out);
 
-   mgr->InitializePhysiologyModification();
-   mgr->CreatePhysiologyModificationSubscriber(&OnNewPhysiologyModification);
+   auto current = sessions.sessions();
+   append_metric_help(out, "isimulate_bridge_monitors", "gauge", "Monitor sessions by state");
+   std::size_t connected = 0, initialized = 0;
+   for (const auto& s : *current) {
+      if (s->connected) ++connected;
+      if (s->initialized) ++initialized;
+   }
+   append_metric(out, "isimulate_bridge_monitors", "state=\"open\"", static_cast<double>(current->size()));
+   append_metric(out, "isimulate_bridge_monitors", "state=\"connected\"", static_cast<double>(connected));
+   append_metric(out, "isimulate_bridge_monitors", "state=\"initialized\"", static_cast<double>(initialized));
+
+   append_metric_help(out, "isimulate_bridge_queue_depth", "gauge", "Outbound messages queued per monitor");
+   for (const auto& s : *current) {
+      append_metric(out, "isimulate_bridge_queue_depth", "monitor=\"" + std::to_string(s->id) + "\"",
+                    static_cast<double>(s->ws->queue_depth()));
+   }
+   append_metric_help(out, "isimulate_bridge_queue_dropped_total", "counter", "Outbound messages dropped per monitor session");
+   for (const auto& s : *current) {
+      append_metric(out, "isimulate_bridge_queue_dropped_total", "monitor=\"" + std::to_string(s->id) + "\"",
+                    static_cast<double>(s->ws->dropped()));
+   }
+   append_metric_help(out, "isimulate_bridge_queue_coalesced_total", "counter", "Queued messages replaced by newer ones per monitor session");
+   for (const auto& s : *current) {
+      append_metric(out, "isimulate_bridge_queue_coalesced_total", "monitor=\"" + std::to_string(s->id) + "\"",
+                    static_cast<double>(s->ws->coalesced()));
+   }
 
-   m_uuid.id(mgr->GenerateUuidString());
+   append_metric_help(out, "isimulate_bridge_change_action_total", "counter", "ChangeActionPacket decisions of the send policy");
+   append_metric(out, "isimulate_bridge_change_action_total", "result=\"sent\"", static_cast<double>(changeActionPolicy.sent()));
+   append_metric(out, "isimulate_bridge_change_action_total", "result=\"keyframe\"", static_cast<double>(changeActionPolicy.keyframes()));
+   append_metric(out, "isimulate_bridge_change_action_total", "result=\"suppressed\"", static_cast<double>(changeActionPolicy.suppressed()));
 
-   std::this_thread::sleep_for(milliseconds(250));
+   append_metric_help(out, "isimulate_bridge_events_total", "counter", "Events handled by the bridge state machine by kind");
+   for (std::size_t k = 0; k < bridge_event_kind_count; ++k) {
+      const auto kind = static_cast<bridge_event::kind>(k);
+      append_metric(out, "isimulate_bridge_events_total", std::string("kind=\"") + to_string(kind) + "\"",
+                    static_cast<double>(bridge.handled(kind)));
+   }
 
-   PublishOperationalDescription();
-   PublishConfiguration();
+   if (arguments.cadence) {
+      append_metric_help(out, "isimulate_bridge_send_slots_total", "counter", "Vitals send slots by the clock that issued them");
+      append_metric(out, "isimulate_bridge_send_slots_total", "clock=\"tick\"", static_cast<double>(sendScheduler.tick_slots()));
+      append_metric(out, "isimulate_bridge_send_slots_total", "clock=\"timer\"", static_cast<double>(sendScheduler.timer_slots()));
+      append_metric_help(out, "isimulate_bridge_sync_times_total", "counter", "Periodic SyncTimesPackets");
+      append_metric(out, "isimulate_bridge_sync_times_total", "", static_cast<double>(sendScheduler.syncs()));
+      append_metric_help(out, "isimulate_bridge_tick_locked", "gauge", "1 while send slots follow AMM Ticks, 0 on the timer");
+      append_metric(out, "isimulate_bridge_tick_locked", "", sendScheduler.tick_locked() ? 1 : 0);
+      append_metric_help(out, "isimulate_bridge_send_jitter_seconds", "histogram", "Deviation of send slot intervals from the cadence");
+      sendScheduler.jitter().render(out, "isimulate_bridge_send_jitter_seconds", "");
+   }
+
+   append_metric_help(out, "isimulate_bridge_startup_seconds", "gauge", "Time from process start to each startup phase reached");
+   for (std::size_t i = 0; i < startup_phase_count; ++i) {
+      const auto phase = static_cast<startup_phase>(i);
+      if (!startup.reached(phase)) continue;
+      append_metric(out, "isimulate_bridge_startup_seconds", std::string("phase=\"") + to_string(phase) + "\"",
+                    startup.elapsed(phase).count() / 1e6);
+   }
+
+   append_metric_help(out, "isimulate_bridge_reconnects_total", "counter", "Reconnect attempts to dropped monitors");
+   append_metric(out, "isimulate_bridge_reconnects_total", "", static_cast<double>(reconnect.reconnects()));
+   append_metric_help(out, "isimulate_bridge_resyncs_total", "counter", "Dropped monitors back to receiving vitals");
+   append_metric(out, "isimulate_bridge_resyncs_total", "", static_cast<double>(reconnect.resyncs()));
+   append_metric_help(out, "isimulate_bridge_resync_seconds", "gauge", "Disconnect to first vitals of the last and the slowest resync");
+   append_metric(out, "isimulate_bridge_resync_seconds", "which=\"last\"", reconnect.last_resync().count() / 1e3);
+   append_metric(out, "isimulate_bridge_resync_seconds", "which=\"max\"", reconnect.max_resync().count() / 1e3);
+
+   append_metric_help(out, "isimulate_bridge_physmod_payloads_total", "counter", "PhysiologyModification payloads by decode cache outcome");
+   append_metric(out, "isimulate_bridge_physmod_payloads_total", "result=\"hit\"", static_cast<double>(physmodCache.hits()));
+   append_metric(out, "isimulate_bridge_physmod_payloads_total", "result=\"miss\"", static_cast<double>(physmodCache.misses()));
+   append_metric(out, "isimulate_bridge_physmod_payloads_total", "result=\"malformed\"", static_cast<double>(physmodCache.malformed()));
+
+   append_metric_help(out, "isimulate_bridge_log_lines_total", "counter", "Log lines by outcome");
+   append_metric(out, "isimulate_bridge_log_lines_total", "result=\"written\"", static_cast<double>(logAppender ? logAppender->written() : 0));
+   append_metric(out, "isimulate_bridge_log_lines_total", "result=\"dropped\"", static_cast<double>(logAppender ? logAppender->dropped() : 0));
+   append_metric(out, "isimulate_bridge_log_lines_total", "result=\"sampled\"", static_cast<double>(logSampler.sampled()));
+   append_metric(out, "isimulate_bridge_log_lines_total", "result=\"rate_limited\"", static_cast<double>(logSampler.rate_limited()));
+
+   if (arguments.waveforms || arguments.derived_vitals) {
+      append_metric_help(out, "isimulate_bridge_waveform_samples_total", "counter", "Waveform samples by outcome");
+      append_metric(out, "isimulate_bridge_waveform_samples_total", "result=\"received\"", static_cast<double>(waveforms.received()));
+      append_metric(out, "isimulate_bridge_waveform_samples_total", "result=\"sent\"", static_cast<double>(waveforms.samples_sent()));
+      append_metric(out, "isimulate_bridge_waveform_samples_total", "result=\"overrun\"", static_cast<double>(waveforms.overruns()));
+      append_metric(out, "isimulate_bridge_waveform_samples_total", "result=\"stale\"", static_cast<double>(waveforms.stale()));
+   }
+}
+
+// SIGUSR1 dumps the flight recorder
+void waitForFlightDumpSignal() {
+   flightDumpSignal.async_wait([](error_code ec, int) {
+      if (ec) return;
+      const std::string dump = flight.dump(flight_log::dump_reason::signal);
+      if (!dump.empty()) LOG_INFO << "Flight recorder dumped to " << dump;
+      waitForFlightDumpSignal();
+   });
+}
+
+// stop discovery, close all sessions and let the io_context run out
+// bridge strand only, every caller posts it to bridge.executor()
+void shutdownBridge() {
+   if (shuttingDown) return;
+   shuttingDown = true;
+   replay.stop();
+   metricsServer.stop();
+   flightDumpSignal.cancel();
+   discovery.stop();
+   reconnect.stop();
+   waveformTimer.cancel();
+   sendScheduler.stop();
+   sessions.close_all();
+   ioWork.reset();
+   // give pending close handshakes a moment, then stop
+   auto timer = std::make_shared<net::steady_timer>(ioc, milliseconds(250));
+   timer->async_wait([timer](error_code) { ioc.stop(); });
+}
+
+void checkForExit() {
+   // wait for key press
+   std::cin.get();
+   std::cout << "Key pressed ... Shutting down." << std::endl;
+
+   net::post(bridge.executor(), shutdownBridge);
+}
+
+int main(int argc, char *argv[]) {
+
+   // set default command line options. process.
+   arguments.monitor = 3;
+   arguments.monitors[0] = 3;
+   arguments.monitor_count = 1;
+   arguments.threads = 2;
+   arguments.autostart = false;
+   arguments.verbose = false;
+   arguments.precision = vital_precision;
+   arguments.min_interval = 150;
+   arguments.max_interval = 1000;
+   arguments.keyframe_period = 5000;
+   arguments.high_water = 8;
+   arguments.endpoint_cache = "config/isimulate_bridge_endpoints.cache";
+   arguments.waveforms = false;
+   arguments.waveform_fps = 25;
+   arguments.waveform_rate = -1;
+   arguments.derived_vitals = false;
+   arguments.record = nullptr;
+   arguments.replay = nullptr;
+   arguments.replay_speed = 1.0;
+   arguments.metrics_port = 0;
+   arguments.flight_recorder = nullptr;
+   arguments.flight_entries = 16384;
+   arguments.log_queue = 8192;
+   arguments.waveform_rules = "config/isimulate_bridge_waveform_rules.xml";
+   arguments.log_rule_count = 0;
+   arguments.deflate_window = 15;
+   arguments.deflate_mem_level = 4;
+   arguments.deflate_threshold = 256;
+   arguments.cadence = 200;
+   arguments.sync_period = 5000;
+   arguments.tick_timeout = 500;
+   argp_parse(&argp, argc, argv, 0, 0, &arguments);
+   setVitalPrecision(arguments.precision);
+
+   send_policy_config policyConfig;
+   policyConfig.min_interval = milliseconds(arguments.min_interval);
+   policyConfig.max_interval = milliseconds(arguments.max_interval);
+   policyConfig.keyframe_period = milliseconds(arguments.keyframe_period);
+   changeActionPolicy.set_config(policyConfig);
+
+   scheduler_config schedulerConfig;
+   schedulerConfig.cadence = milliseconds(arguments.cadence);
+   schedulerConfig.sync_period = milliseconds(arguments.sync_period);
+   schedulerConfig.tick_timeout = milliseconds(arguments.tick_timeout);
+   sendScheduler.set_config(schedulerConfig);
+   sendScheduler.set_handler(onSendSlot);
+
+   sessions.set_monitor_types(std::vector<int>(arguments.monitors, arguments.monitors + arguments.monitor_count));
+   sessions.set_verbose(arguments.verbose);
+   sessions.set_queue_limits(arguments.high_water, 64);
+   compression_options compression;
+   compression.enabled = arguments.deflate_window > 0;
+   compression.window_bits = arguments.deflate_window;
+   compression.mem_level = arguments.deflate_mem_level;
+   compression.threshold = arguments.deflate_threshold;
+   sessions.set_compression(compression);
+   bridge.set_handler(handleBridgeEvent);
+   if ( arguments.metrics_port ) bridge.set_delay_histogram(&metrics.event_delay);
+   sessions.set_handlers(onWebsocketHandshake, onNewWebsocketMessage, onWebsocketClosed);
+   sessions.set_write_handler(onWebsocketWritten);
+   if ( arguments.metrics_port ) sessions.set_metrics(&metrics);
+   if ( arguments.flight_recorder && *arguments.flight_recorder ) {
+      flight.start(arguments.flight_recorder, arguments.flight_entries);
+      flight.install_crash_handler();
+      sessions.set_flight_recorder(&flight);
+   }
+
+   reconnect_config reconnectConfig;
+   reconnectConfig.cache_file = arguments.endpoint_cache;
+   reconnect.set_config(reconnectConfig);
+
+   waveform_config waveformConfig;
+   // never 0, a zero period would re-arm the frame timer in a busy loop
+   waveformConfig.frame_period = milliseconds(std::max(1, 1000 / arguments.waveform_fps));
+   if (arguments.waveform_rate >= 0) {
+      for (auto& channel : waveformConfig.channel) channel.output_rate = arguments.waveform_rate;
+   }
+   waveforms.set_config(waveformConfig);
+   if (arguments.derived_vitals) {
+      waveforms.set_block_handler([](waveform_channel channel, const float* values, const int64_t* times, std::size_t n) {
+         derivedVitals.process(channel, values, times, n);
+      });
+   }
+
+   static plog::ColorConsoleAppender<plog::TxtFormatter> consoleAppender;
+   static async_log_appender asyncAppender(arguments.log_queue);
+   if ( arguments.log_queue ) {
+      asyncAppender.start();
+      logAppender = &asyncAppender;
+      plog::init(plog::verbose, &asyncAppender);
+   } else {
+      plog::init(plog::verbose, &consoleAppender);
+   }
+   for (const char* type : {"ConnectionTypePacket", "SettingsPacket", "ScenarioCurrentStatePacket", "ChangeActionPacket",
+                            "SyncTimesPacket", "ScenarioChangeStatePacket", "PowerOnPacket", "VisibilityPacket",
+                            "NibpPacket", "ChangeMonitorPacket", "DisconnectPacket"}) {
+      logSampler.add_type(type);
+   }
+   for (inbound_type type : {inbound_type::none, inbound_type::other, inbound_type::settings_request, inbound_type::scenario_request,
+                             inbound_type::scenario_current_state, inbound_type::debrief, inbound_type::disconnect}) {
+      logSampler.add_type(to_string(type));
+   }
+   for (int i = 0; i < arguments.log_rule_count; ++i) {
+      log_policy policy;
+      policy.every = static_cast<uint32_t>(arguments.log_rules[i].every);
+      policy.per_second = static_cast<uint32_t>(arguments.log_rules[i].per_second);
+      logSampler.set_policy(arguments.log_rules[i].type, policy);
+   }
+
+   LOG_INFO << "=== [ iSimulate Bridge ] ===";
+   for (int i = 0; i < arguments.monitor_count; ++i)
+      LOG_INFO << "Monitor " << i + 1 << " model ID = " << arguments.monitors[i];
+
+   if ( *arguments.waveform_rules ) {
+      if ( !waveformRules.load(arguments.waveform_rules) ) return EXIT_FAILURE;
+      monitorSettings.reset(waveformRules.defaults());
+   }
+
+   if ( arguments.replay && !replay.open(arguments.replay) ) return EXIT_FAILURE;
+   if ( arguments.record && !recorder.open(arguments.record) ) return EXIT_FAILURE;
+
+   if ( arguments.replay ) {
+      // the log stands in for the AMM subscriptions
+      input_replay::handlers replayHandlers;
+      replayHandlers.simulation_control = OnNewSimulationControl;
+      replayHandlers.tick = OnNewTick;
+      replayHandlers.physiology_value = OnPhysiologyValue;
+      replayHandlers.physiology_waveform = OnPhysiologyWaveform;
+      replayHandlers.render_modification = OnNewRenderModification;
+      replayHandlers.physiology_modification = OnNewPhysiologyModification;
+      replay.set_handlers(replayHandlers);
+   }
+   markStartup(startup_phase::configured);
 
    // set up thread to check console for "exit" command
    std::thread ec(checkForExit);
    ec.detach();
 
-   // set up thread for service discovery
-   LOG_INFO << "iSimulate device discovery";
-   std::thread sd(service_discovery);
-   sd.detach();
+   if ( flight.enabled() ) {
+      flightDumpSignal.add(SIGUSR1);
+      waitForFlightDumpSignal();
+      LOG_INFO << "Flight recorder keeps " << arguments.flight_entries << " events, SIGUSR1 dumps them";
+   }
 
-   //TODO: turn discovery into asynch process see mycroft bridge
-   // block until iSimulate monitor has been discovered on the local network
+   if ( arguments.metrics_port && !metricsServer.start("127.0.0.1", arguments.metrics_port, renderMetrics) ) {
+      return EXIT_FAILURE;
+   }
 
-   LOG_INFO << "iSimulate Bridge ready.";
-   std::cout << "Listening for data... Press return to exit." << std::endl;
+   // discovery runs on the io_context; sessions open as soon as a service resolves
+   // last known monitors first, they usually answer before mDNS resolves
+   reconnect.load();
+   LOG_INFO << "iSimulate device discovery";
+   discovery.start(onServiceEvent);
+   markStartup(startup_phase::discovery_started);
+
+   // DDS comes up on its own thread while the monitors are discovered and connected
+   std::thread ddsThread(setupDds);
+
+   if (arguments.waveforms || arguments.derived_vitals) {
+      if (arguments.waveforms) LOG_INFO << "Forwarding waveforms at " << arguments.waveform_fps << " frames/s";
+      if (arguments.derived_vitals) LOG_INFO << "Deriving HR, PPV and RR from waveforms (" << derived_vitals::simd_name() << ")";
+      net::post(bridge.executor(), []() {
+         waveformTimer.expires_at(steady_clock::now());
+         scheduleWaveformFrame();
+      });
+   }
 
-   while (try_reconnect) {
-
-      // wait for updated service info
-      while (try_reconnect) {
-         if ( monitor_port !=0 && monitor_service_new) {
-            LOG_INFO << "Monitor port aquired: " << monitor_port;
-            LOG_INFO << "Monitor address aquired: " << monitor_address;
-            if ( strlen(monitor_address) > 15 ) LOG_INFO << "Address invalid format (not IPv4): " << strlen(monitor_address);
-            else LOG_INFO << "Monitor address length: " << strlen(monitor_address);
-            host = monitor_address;
-            port = std::to_string(monitor_port);
-            monitor_service_new = false;
-            break;
-         }
-         std::this_thread::sleep_for(milliseconds(20));
-      }
+   if ( arguments.cadence ) {
+      LOG_INFO << "Sending vitals every " << arguments.cadence << " ms, locked to AMM Ticks";
+      sendScheduler.start();
+   }
 
-      LOG_INFO << "Connecting to iSimulate monitor.";
+   net::signal_set signals(ioc, SIGINT, SIGTERM);
+   signals.async_wait([](error_code ec, int) {
+      if (!ec) net::post(bridge.executor(), shutdownBridge);
+   });
 
-      // set up websocket session
-      ws_session->run(host, port, target);
-      ws_session->set_verbose( arguments.verbose );
-      ws_session->registerHandshakeCallback(onWebsocketHandshake);
-      ws_session->registerReadCallback(onNewWebsocketMessage);
+   LOG_INFO << "iSimulate Bridge ready, DDS starting.";
+   std::cout << "Listening for data... Press return to exit." << std::endl;
 
-      // Run the I/O context.
-      // The call will return when the socket is closed.
-      ioc.run();
+   // replay runs on its own thread like the DDS listeners, the bridge exits at the end of the log
+   std::thread replayThread;
+   if ( arguments.replay ) {
+      LOG_INFO << "Replaying " << arguments.replay << " at speed " << arguments.replay_speed;
+      replayThread = std::thread([] {
+         replay.run(arguments.replay_speed);
+         const double seconds = replay.elapsed().count() / 1e6;
+         LOG_INFO << "Replayed " << replay.records() << " samples (" << replay.recorded().count() / 1e6 << " s recorded) in "
+                  << seconds << " s, " << (seconds > 0 ? replay.records() / seconds : 0) << " samples/s";
+         // behind the replayed events still waiting for the bridge strand
+         net::post(bridge.executor(), shutdownBridge);
+      });
+   }
 
-      LOG_INFO << "Connection to iSimulate monitor closed.";
-      websocket_connected = false;
-      monitor_initialized = false;
-      ioc.reset();
+   // run discovery and all monitor sessions on a small thread pool, main thread included
+   std::vector<std::thread> ioThreads;
+   for (int i = 1; i < arguments.threads; ++i) {
+      ioThreads.emplace_back([] { ioc.run(); });
+   }
+   ioc.run();
+   for (auto& t : ioThreads) t.join();
+   if (replayThread.joinable()) replayThread.join();
+   if ( arguments.record ) {
+      recorder.close();
+      LOG_INFO << "Recorded " << recorder.records() << " samples, " << recorder.bytes() << " bytes"
+               << " dropped: " << recorder.dropped();
    }
 
+   logSendPolicyCounters();
+   if (arguments.cadence) logSchedulerCounters();
+   if (arguments.waveforms || arguments.derived_vitals) logWaveformCounters();
+   if (arguments.derived_vitals) logDerivedVitals();
+   LOG_INFO << "Monitor reconnects: " << reconnect.reconnects()
+            << " resyncs: " << reconnect.resyncs()
+            << " last: " << reconnect.last_resync().count() << " ms"
+            << " max: " << reconnect.max_resync().count() << " ms";
+   ddsThread.join();
    mgr->Shutdown();
    std::this_thread::sleep_for(milliseconds(100));
    delete mgr;
 
+   LOG_INFO << "Log lines sampled out: " << logSampler.sampled()
+            << " rate limited: " << logSampler.rate_limited()
+            << " dropped: " << (logAppender ? logAppender->dropped() : 0);
    LOG_INFO << "iSimulate Bridge shutdown.";
+   if (logAppender) logAppender->stop();
    return EXIT_SUCCESS;
 }
@@ -0,0 +1,139 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "inbound_message.hpp"
+
+#include <cstring>
+
+#include "rapidjson/document.h"
+
+using namespace rapidjson;
+
+namespace {
+
+struct type_name {
+   const char* name;
+   std::size_t length;
+   inbound_type type;
+};
+
+#define TYPE_NAME(s, t) { s, sizeof(s) - 1, t }
+const type_name type_names[] = {
+   TYPE_NAME("SettingsRequestPacket", inbound_type::settings_request),
+   TYPE_NAME("ScenarioRequestPacket", inbound_type::scenario_request),
+   TYPE_NAME("ScenarioCurrentStatePacket", inbound_type::scenario_current_state),
+   TYPE_NAME("DebriefPacket", inbound_type::debrief),
+   TYPE_NAME("DisconnectPacket", inbound_type::disconnect),
+};
+#undef TYPE_NAME
+
+const char type_key[] = "type";
+constexpr std::size_t type_key_length = sizeof(type_key) - 1;
+
+bool is_space(char c) {
+   return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// scratch memory for in situ parsing, reused per thread
+constexpr std::size_t parseValueBufferSize = 4096;
+constexpr std::size_t parseStackBufferSize = 1024;
+thread_local char parseValueBuffer[parseValueBufferSize];
+thread_local char parseStackBuffer[parseStackBufferSize];
+using PooledDocument = GenericDocument<UTF8<>, MemoryPoolAllocator<>, MemoryPoolAllocator<>>;
+
+// position right after the "type" member name of the message object, nullptr
+// if it has none; members of nested objects and string values do not count
+const char* find_type_member(const char* p, const char* end) {
+   while (p < end && is_space(*p)) ++p;
+   if (p == end || *p != '{') return nullptr;
+   int depth = 0;
+   bool key = false;          // next string at depth 1 is a member name
+   for (; p < end; ++p) {
+      switch (*p) {
+         case '"': {
+            const char* name = ++p;
+            while (p < end && *p != '"') {
+               if (*p == '\\') ++p;
+               ++p;
+            }
+            if (p >= end) return nullptr;
+            if (key && static_cast<std::size_t>(p - name) == type_key_length &&
+                std::memcmp(name, type_key, type_key_length) == 0) {
+               return p + 1;
+            }
+            key = false;
+            break;
+         }
+         case '{':
+            key = ++depth == 1;
+            break;
+         case '[':
+            ++depth;
+            break;
+         case '}':
+         case ']':
+            if (--depth == 0) return nullptr;
+            break;
+         case ',':
+            key = depth == 1;
+            break;
+         default:
+            break;
+      }
+   }
+   return nullptr;
+}
+
+}
+
+const char* to_string(inbound_type type) {
+   switch (type) {
+      case inbound_type::none:                   return "none";
+      case inbound_type::other:                  return "other";
+      case inbound_type::settings_request:       return "SettingsRequestPacket";
+      case inbound_type::scenario_request:       return "ScenarioRequestPacket";
+      case inbound_type::scenario_current_state: return "ScenarioCurrentStatePacket";
+      case inbound_type::debrief:                return "DebriefPacket";
+      case inbound_type::disconnect:             return "DisconnectPacket";
+   }
+   return "unknown";
+}
+
+inbound_type scan_message_type(const char* data, std::size_t size) {
+   const char* end = data + size;
+   // the monitor puts "type" first, so this normally stops within a few bytes
+   const char* p = find_type_member(data, end);
+   if (!p) return inbound_type::none;
+
+   // "type" : "value"
+   while (p < end && is_space(*p)) ++p;
+   if (p == end || *p != ':') return inbound_type::none;
+   ++p;
+   while (p < end && is_space(*p)) ++p;
+   if (p == end || *p != '"') return inbound_type::other;
+   const char* value = ++p;
+   p = static_cast<const char*>(std::memchr(p, '"', static_cast<std::size_t>(end - p)));
+   if (!p) return inbound_type::none;
+
+   const std::size_t length = static_cast<std::size_t>(p - value);
+   for (const auto& t : type_names) {
+      if (t.length == length && std::memcmp(t.name, value, length) == 0) return t.type;
+   }
+   return inbound_type::other;
+}
+
+current_state_message parse_current_state(char* data) {
+   current_state_message out;
+   MemoryPoolAllocator<> valueAllocator(parseValueBuffer, parseValueBufferSize);
+   MemoryPoolAllocator<> stackAllocator(parseStackBuffer, parseStackBufferSize);
+   PooledDocument document(&valueAllocator, parseStackBufferSize, &stackAllocator);
+   document.ParseInsitu(data);
+   out.parse_error = static_cast<int>(document.GetParseError());
+   if (document.HasParseError() || !document.IsObject()) return out;
+   out.valid = true;
+   if (document.HasMember("scenarioState") && document["scenarioState"].IsInt()) {
+      out.has_state = true;
+      out.state = document["scenarioState"].GetInt();
+   }
+   return out;
+}
@@ -0,0 +1,43 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef INBOUND_MESSAGE_HPP
+#define INBOUND_MESSAGE_HPP
+
+#include <cstddef>
+
+/**
+ * @brief Packet types the iSimulate monitor sends to the bridge
+ */
+enum class inbound_type {
+   none = 0,                  // no "type" member found
+   other,                     // type present but not handled by the bridge
+   settings_request,
+   scenario_request,
+   scenario_current_state,
+   debrief,
+   disconnect
+};
+
+const char* to_string(inbound_type type);
+
+// find the value of the "type" member of the message object without parsing
+// the message; "type" in nested objects or as a string value is skipped.
+// data does not need to be null terminated.
+inbound_type scan_message_type(const char* data, std::size_t size);
+
+/**
+ * @brief What the bridge takes from a ScenarioCurrentStatePacket
+ */
+struct current_state_message {
+   bool valid = false;        // parsed into a JSON object
+   int parse_error = 0;       // rapidjson::ParseErrorCode
+   bool has_state = false;    // integer scenarioState member present
+   int state = 0;
+};
+
+// parse a message in situ: data must be null terminated and is modified.
+// scratch memory is reused per thread, larger documents spill over into the heap.
+current_state_message parse_current_state(char* data);
+
+#endif
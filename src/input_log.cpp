@@ -0,0 +1,309 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "amm/BaseLogger.h"
+#include "input_log.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+using namespace input_log;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+namespace {
+
+constexpr std::size_t flush_size = 1 << 20;
+constexpr uint16_t max_names = 0xffff;
+
+std::size_t padded(std::size_t size) {
+   return (size + 7) & ~std::size_t(7);
+}
+
+struct tick_payload {
+   int64_t frame;
+   float time_factor;
+   uint32_t reserved;
+};
+
+}
+
+input_recorder::~input_recorder() {
+   close();
+}
+
+bool input_recorder::open(const std::string& file) {
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (file_) return false;
+   file_ = std::fopen(file.c_str(), "wb");
+   if (!file_) {
+      LOG_ERROR << "Could not create input log " << file;
+      return false;
+   }
+   start_ = clock::now();
+   buffer_.reserve(flush_size + 4096);
+   names_.clear();
+
+   file_header header{};
+   std::memcpy(header.magic, magic, sizeof(magic));
+   header.version = version;
+   header.start_us = duration_cast<microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+   const char* p = reinterpret_cast<const char*>(&header);
+   buffer_.assign(p, p + sizeof(header));
+   return true;
+}
+
+void input_recorder::close() {
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (!file_) return;
+   write_out();
+   std::fclose(file_);
+   file_ = nullptr;
+}
+
+bool input_recorder::intern(const std::string& name, uint16_t& id) {
+   auto it = names_.find(name);
+   if (it != names_.end()) {
+      id = it->second;
+      return true;
+   }
+   if (names_.size() == max_names) return false;
+   id = static_cast<uint16_t>(names_.size());
+   names_.emplace(name, id);
+   append(record_kind::name, id, name.data(), name.size());
+   return true;
+}
+
+void input_recorder::append(record_kind kind, uint16_t id, const void* payload, std::size_t size) {
+   record_header header;
+   header.size = static_cast<uint32_t>(size);
+   header.kind = kind;
+   header.id = id;
+   header.time_us = duration_cast<microseconds>(clock::now() - start_).count();
+
+   const std::size_t offset = buffer_.size();
+   buffer_.resize(offset + sizeof(header) + padded(size), 0);
+   std::memcpy(&buffer_[offset], &header, sizeof(header));
+   if (size) std::memcpy(&buffer_[offset + sizeof(header)], payload, size);
+   records_.fetch_add(1, std::memory_order_relaxed);
+
+   if (buffer_.size() >= flush_size) write_out();
+}
+
+void input_recorder::write_out() {
+   if (buffer_.empty()) return;
+   if (std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) {
+      LOG_ERROR << "Input log write failed, recording stopped";
+      std::fclose(file_);
+      file_ = nullptr;
+   } else {
+      bytes_.fetch_add(buffer_.size(), std::memory_order_relaxed);
+   }
+   buffer_.clear();
+}
+
+void input_recorder::record(const AMM::Tick& tick) {
+   tick_payload payload{tick.frame(), tick.time_factor(), 0};
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (!file_) return;
+   append(record_kind::tick, 0, &payload, sizeof(payload));
+}
+
+void input_recorder::record(const AMM::SimulationControl& control) {
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (!file_) return;
+   append(record_kind::simulation_control, static_cast<uint16_t>(control.type()), nullptr, 0);
+}
+
+void input_recorder::record(const AMM::PhysiologyValue& value) {
+   const double v = value.value();
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (!file_) return;
+   uint16_t id;
+   if (!intern(value.name(), id)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   append(record_kind::physiology_value, id, &v, sizeof(v));
+}
+
+void input_recorder::record(const AMM::PhysiologyWaveform& waveform) {
+   const double v = waveform.value();
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (!file_) return;
+   uint16_t id;
+   if (!intern(waveform.name(), id)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   append(record_kind::physiology_waveform, id, &v, sizeof(v));
+}
+
+void input_recorder::record(const AMM::RenderModification& modification) {
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (!file_) return;
+   uint16_t id;
+   if (!intern(modification.type(), id)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   append(record_kind::render_modification, id, modification.data().data(), modification.data().size());
+}
+
+void input_recorder::record(const AMM::PhysiologyModification& modification) {
+   std::lock_guard<std::mutex> lock(mutex_);
+   if (!file_) return;
+   uint16_t id;
+   if (!intern(modification.type(), id)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   append(record_kind::physiology_modification, id, modification.data().data(), modification.data().size());
+}
+
+input_replay::~input_replay() {
+   if (data_) munmap(const_cast<char*>(data_), mapped_);
+}
+
+bool input_replay::open(const std::string& file) {
+   const int fd = ::open(file.c_str(), O_RDONLY);
+   if (fd < 0) {
+      LOG_ERROR << "Could not open input log " << file;
+      return false;
+   }
+   struct stat st;
+   if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(file_header)) {
+      LOG_ERROR << "Input log " << file << " is too short";
+      ::close(fd);
+      return false;
+   }
+   void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   ::close(fd);
+   if (p == MAP_FAILED) {
+      LOG_ERROR << "Could not map input log " << file;
+      return false;
+   }
+   file_header header;
+   std::memcpy(&header, p, sizeof(header));
+   if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version) {
+      LOG_ERROR << file << " is not an input log of version " << version;
+      munmap(p, st.st_size);
+      return false;
+   }
+   madvise(p, st.st_size, MADV_SEQUENTIAL);
+   data_ = static_cast<const char*>(p);
+   mapped_ = size_ = st.st_size;
+
+   // find the end of the last complete record, a recording may have been cut off
+   std::size_t offset = sizeof(file_header);
+   std::size_t count = 0;
+   int64_t last_us = 0;
+   while (offset + sizeof(record_header) <= size_) {
+      record_header rec;
+      std::memcpy(&rec, data_ + offset, sizeof(rec));
+      const std::size_t next = offset + sizeof(rec) + padded(rec.size);
+      if (next > size_) break;
+      last_us = rec.time_us;
+      offset = next;
+      ++count;
+   }
+   if (offset != size_) {
+      LOG_WARNING << "Input log " << file << " ends in a partial record, replaying " << count << " records";
+   }
+   size_ = offset;
+   recorded_ = microseconds(last_us);
+   LOG_INFO << "Input log " << file << ": " << count << " records, " << last_us / 1000000.0 << " s";
+   return true;
+}
+
+bool input_replay::wait_until(clock::time_point t) {
+   std::unique_lock<std::mutex> lock(mutex_);
+   return !stop_cv_.wait_until(lock, t, [this]() { return stopped_.load(); });
+}
+
+void input_replay::stop() {
+   std::lock_guard<std::mutex> lock(mutex_);
+   stopped_.store(true);
+   stop_cv_.notify_all();
+}
+
+void input_replay::run(double speed) {
+   if (!data_) return;
+   std::vector<std::string> names;
+   const std::string unnamed;
+   // one sample of each type, reused for every record
+   AMM::Tick tick;
+   AMM::SimulationControl control;
+   AMM::PhysiologyValue value;
+   AMM::PhysiologyWaveform waveform;
+   AMM::RenderModification render;
+   AMM::PhysiologyModification physmod;
+
+   const clock::time_point begin = clock::now();
+   std::size_t offset = sizeof(file_header);
+   while (offset < size_) {
+      record_header rec;
+      std::memcpy(&rec, data_ + offset, sizeof(rec));
+      const char* payload = data_ + offset + sizeof(rec);
+      offset += sizeof(rec) + padded(rec.size);
+
+      if (rec.kind == record_kind::name) {
+         if (names.size() <= rec.id) names.resize(rec.id + 1);
+         names[rec.id].assign(payload, rec.size);
+         continue;
+      }
+      if (speed > 0) {
+         if (!wait_until(begin + microseconds(static_cast<int64_t>(rec.time_us / speed)))) break;
+      } else if (stopped_.load(std::memory_order_relaxed)) {
+         break;
+      }
+      const std::string& name = rec.id < names.size() ? names[rec.id] : unnamed;
+
+      double v = 0;
+      switch (rec.kind) {
+         case record_kind::tick: {
+            tick_payload t;
+            std::memcpy(&t, payload, sizeof(t));
+            tick.frame(t.frame);
+            tick.time_factor(t.time_factor);
+            if (handlers_.tick) handlers_.tick(tick, nullptr);
+            break;
+         }
+         case record_kind::simulation_control:
+            control.type(static_cast<AMM::ControlType>(rec.id));
+            if (handlers_.simulation_control) handlers_.simulation_control(control, nullptr);
+            break;
+         case record_kind::physiology_value:
+            std::memcpy(&v, payload, sizeof(v));
+            value.name(name);
+            value.value(v);
+            if (handlers_.physiology_value) handlers_.physiology_value(value, nullptr);
+            break;
+         case record_kind::physiology_waveform:
+            std::memcpy(&v, payload, sizeof(v));
+            waveform.name(name);
+            waveform.value(v);
+            if (handlers_.physiology_waveform) handlers_.physiology_waveform(waveform, nullptr);
+            break;
+         case record_kind::render_modification:
+            render.type(name);
+            render.data(std::string(payload, rec.size));
+            if (handlers_.render_modification) handlers_.render_modification(render, nullptr);
+            break;
+         case record_kind::physiology_modification:
+            physmod.type(name);
+            physmod.data(std::string(payload, rec.size));
+            if (handlers_.physiology_modification) handlers_.physiology_modification(physmod, nullptr);
+            break;
+         default:
+            // unknown kinds from newer recorders are skipped
+            continue;
+      }
+      records_.fetch_add(1, std::memory_order_relaxed);
+   }
+   elapsed_ = duration_cast<microseconds>(clock::now() - begin);
+}
@@ -0,0 +1,169 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef INPUT_LOG_HPP
+#define INPUT_LOG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <amm_std.h>
+
+/**
+ * @brief Binary input log layout.
+ *
+ * A file header followed by records, each a record_header and its payload
+ * padded to 8 bytes, so a mapped log is read in place without copies.
+ * Names and modification types are interned: a name record assigns an id
+ * once, value records only carry the id and the value.
+ */
+namespace input_log {
+
+constexpr char magic[8] = {'A', 'M', 'M', 'I', 'N', 'L', 'O', 'G'};
+constexpr uint32_t version = 1;
+
+struct file_header {
+   char magic[8];
+   uint32_t version;
+   uint32_t reserved;
+   int64_t start_us;          // system clock at the start of the recording
+};
+
+enum class record_kind : uint16_t {
+   name = 1,                  // id -> payload string
+   tick,                      // payload int64 frame, float time factor
+   simulation_control,        // id = control type
+   physiology_value,          // id = name, payload double
+   physiology_waveform,       // id = name, payload double
+   render_modification,       // id = type, payload data
+   physiology_modification    // id = type, payload data
+};
+
+struct record_header {
+   uint32_t size;             // payload bytes, without padding
+   record_kind kind;
+   uint16_t id;
+   int64_t time_us;           // since the start of the recording
+};
+
+static_assert(sizeof(file_header) == 24, "input log file header layout");
+static_assert(sizeof(record_header) == 16, "input log record header layout");
+
+}
+
+/**
+ * @brief Input_Recorder Class writes every AMM sample the bridge receives to an input log.
+ *
+ * The record functions may be called from any DDS listener thread; records
+ * are appended to a buffer under a short lock and written out in large
+ * blocks.
+ */
+class input_recorder
+{
+public:
+   using clock = std::chrono::steady_clock;
+
+   input_recorder() = default;
+   ~input_recorder();
+   input_recorder(const input_recorder&) = delete;
+   input_recorder& operator=(const input_recorder&) = delete;
+
+   bool open(const std::string& file);
+   void close();
+   bool is_open() const { return file_ != nullptr; }
+
+   void record(const AMM::Tick& tick);
+   void record(const AMM::SimulationControl& control);
+   void record(const AMM::PhysiologyValue& value);
+   void record(const AMM::PhysiologyWaveform& waveform);
+   void record(const AMM::RenderModification& modification);
+   void record(const AMM::PhysiologyModification& modification);
+
+   uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+   uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+   uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+   // callers hold mutex_
+   bool intern(const std::string& name, uint16_t& id);
+   void append(input_log::record_kind kind, uint16_t id, const void* payload, std::size_t size);
+   void write_out();
+
+   std::mutex mutex_;
+   std::FILE* file_ = nullptr;
+   clock::time_point start_;
+   std::vector<char> buffer_;
+   std::unordered_map<std::string, uint16_t> names_;
+
+   std::atomic<uint64_t> records_{0};
+   std::atomic<uint64_t> bytes_{0};
+   std::atomic<uint64_t> dropped_{0};
+};
+
+/**
+ * @brief Input_Replay Class feeds a recorded input log into the bridge's AMM callbacks.
+ *
+ * The log is memory mapped and replayed on the calling thread, which takes
+ * the place of the DDS listener threads; the callbacks get a null
+ * SampleInfo. Samples keep their recorded spacing divided by the speed
+ * factor, speed 0 replays as fast as the callbacks return.
+ */
+class input_replay
+{
+public:
+   using clock = std::chrono::steady_clock;
+
+   struct handlers {
+      std::function<void(AMM::Tick&, eprosima::fastrtps::SampleInfo_t*)> tick;
+      std::function<void(AMM::SimulationControl&, eprosima::fastrtps::SampleInfo_t*)> simulation_control;
+      std::function<void(AMM::PhysiologyValue&, eprosima::fastrtps::SampleInfo_t*)> physiology_value;
+      std::function<void(AMM::PhysiologyWaveform&, eprosima::fastrtps::SampleInfo_t*)> physiology_waveform;
+      std::function<void(AMM::RenderModification&, eprosima::fastrtps::SampleInfo_t*)> render_modification;
+      std::function<void(AMM::PhysiologyModification&, eprosima::fastrtps::SampleInfo_t*)> physiology_modification;
+   };
+
+   input_replay() = default;
+   ~input_replay();
+   input_replay(const input_replay&) = delete;
+   input_replay& operator=(const input_replay&) = delete;
+
+   // map the log and check its header
+   bool open(const std::string& file);
+   void set_handlers(handlers h) { handlers_ = std::move(h); }
+
+   // replay the whole log, returns early after stop()
+   void run(double speed);
+   // may be called from any thread
+   void stop();
+
+   uint64_t records() const { return records_.load(std::memory_order_relaxed); }
+   // recorded span of the log and wall time of the last run
+   std::chrono::microseconds recorded() const { return recorded_; }
+   std::chrono::microseconds elapsed() const { return elapsed_; }
+
+private:
+   bool wait_until(clock::time_point t);
+
+   handlers handlers_;
+   const char* data_ = nullptr;
+   std::size_t mapped_ = 0;
+   std::size_t size_ = 0;       // up to the last complete record
+   std::chrono::microseconds recorded_{0};
+   std::chrono::microseconds elapsed_{0};
+
+   std::mutex mutex_;
+   std::condition_variable stop_cv_;
+   std::atomic<bool> stopped_{false};
+   std::atomic<uint64_t> records_{0};
+};
+
+#endif
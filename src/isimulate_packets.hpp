@@ -0,0 +1,163 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef ISIMULATE_PACKETS_HPP
+#define ISIMULATE_PACKETS_HPP
+
+#include "packet_serializer.hpp"
+
+// Layouts of all packets the bridge sends to the iSimulate monitor.
+// Literal text is sent byte for byte; number() marks a slot filled in per packet.
+
+// default decimal places of vitals in ChangeActionPacket
+constexpr int vital_precision = 2;
+
+constexpr packet_segment connection_type_packet[] = {
+   literal("{\"type\":\"ConnectionTypePacket\",\"connectionType\":"),
+   number(packet_field::connection_type),
+   literal("}"),
+};
+
+constexpr packet_segment settings_packet[] = {
+   literal("{\"type\": \"SettingsPacket\""
+      ",\"tempMeasureF\":true"
+      ",\"etco2MeasurekPa\":false"
+      ",\"cprDepthMeasureInch\":false"
+      ",\"pacingThreshold\":50"
+      ",\"preserveCO2\":true"
+      ",\"seeThruCPR\":true"
+      ",\"pacerCapture\":true"
+      ",\"monitorControlsVolume\":true"
+      ",\"nibpMeasure\":0,\"weightMeasure\":0,\"ibpMeasure\":0}"),
+};
+
+constexpr packet_segment scenario_packet[] = {
+   literal("{\"type\": \"ScenarioCurrentStatePacket\""
+      ",\"scenarioData\": {\"scenarioId\": \"\""
+                           ",\"scenarioType\": \"Vital Signs\""
+                           ",\"scenarioName\": \"\""
+                           ",\"scenarioTime\": 600"
+                           ",\"scenarioMonitorType\": "),
+   number(packet_field::monitor_type),
+   literal(               ",\"scenarioStory\": {\"history\": \"\""
+                                                ",\"course\": \"\""
+                                                ",\"discussion\": \"\"}"
+                           ",\"patientInformation\": {\"patientName\": \"\""
+                                                      ",\"patientSex\":0"
+                                                      ",\"patientCondition\": \"\""
+                                                      ",\"patientAdmitted\": 0"
+                                                      ",\"patientAge\": 30"
+                                                      ",\"patientPhotoId\":0}}"
+      ",\"scenarioState\": 0"
+      ",\"studentInfo\": {\"studentName\": \"\""
+                        ",\"studentNumber\": \"\""
+                        ",\"studentEmail\": \"\"}}"),
+};
+
+constexpr packet_segment change_action_packet[] = {
+   literal("{\"type\": \"ChangeActionPacket\","
+      "\"trendTime\": 0"
+      ",\"hr\":"),
+   number(packet_field::heart_rate, vital_precision),
+   literal(",\"bpSys\":"),
+   number(packet_field::bp_systolic, vital_precision),
+   literal(",\"bpDia\":"),
+   number(packet_field::bp_diastolic, vital_precision),
+   literal(",\"spo2\":"),
+   number(packet_field::spo2, vital_precision),
+   literal(",\"etco2\":"),
+   number(packet_field::etco2, vital_precision),
+   literal(",\"respRate\":"),
+   number(packet_field::resp_rate, vital_precision),
+   literal(",\"temp\":"),
+   number(packet_field::temperature, vital_precision),
+   literal(",\"cust1\":0,\"cust2\":0,\"cust3\":0,"
+      "\"cvp\":10,\"cvpWaveform\":0,\"cvpVisible\":true,\"cvpAmplitude\": 2,\"cvpVariation\": 1,"
+      "\"icp\":10,\"icpWaveform\":0,\"icpVisible\":true,\"icpAmplitude\": 2,\"icpVariation\": 1,"
+      "\"icpLundbergAEnabled\": false,\"icpLundbergBEnabled\": false,"
+      "\"papSys\":20,\"papDia\":10,\"papWaveform\": 0,\"papVisible\":true,\"papVariation\": 2,"
+      "\"ecgWaveform\": "),
+   number(packet_field::ecg_waveform),
+   literal(",\"bpWaveform\": "),
+   number(packet_field::bp_waveform),
+   literal(",\"spo2Waveform\": "),
+   number(packet_field::spo2_waveform),
+   literal(",\"etco2Waveform\": "),
+   number(packet_field::etco2_waveform),
+   literal(",\"ecgVisible\": true,\"bpVisible\":true,\"spo2Visible\": true,"
+      "\"etco2Visible\": true,\"rrVisible\": true,\"tempVisible\": true,"
+      "\"custVisible1\": false,\"custVisible2\":false,\"custVisible3\":false,"
+      "\"custLabel1\":\"\",\"custLabel2\":\"\",\"custLabel3\":\"\","
+      "\"custMeasureLabel1\":\"\",\"custMeasureLabel2\":\"\",\"custMeasureLabel3\": \"\","
+      "\"ectopicsPac\": "),
+   number(packet_field::ectopics_pac),
+   literal(",\"ectopicsPjc\": "),
+   number(packet_field::ectopics_pjc),
+   literal(",\"ectopicsPvc\": "),
+   number(packet_field::ectopics_pvc),
+   literal(",\"perfusion\":0,"
+      "\"electricalInterference\":"),
+   boolean(packet_field::electrical_interference),
+   literal(",\"articInterference\":"),
+   number(packet_field::artic_interference),
+   literal(",\"svvInterference\":"),
+   number(packet_field::svv_interference),
+   literal(",\"sinusArrhythmiaInterference\": "),
+   number(packet_field::sinus_arrhythmia_interference),
+   literal(",\"ventilated\":false,"
+      "\"electrodeStatus\": [true, true, true, true, true, true, true, true, true, true,true, true]"
+      "}"),
+};
+
+constexpr packet_segment sync_times_packet[] = {
+   literal("{\"type\": \"SyncTimesPacket\""
+      ",\"actualTime\":0"
+      ",\"virtualTime\":"),
+   number(packet_field::sim_time, 1),
+   literal(",\"alarmTime\":0,\"isVirtualTimePaused\":false}"),
+};
+
+// requestedState values: 0 - initial, 1 - running, 2 - paused, 3 - finished
+constexpr packet_segment scenario_change_state_packet[] = {
+   literal("{\"type\":\"ScenarioChangeStatePacket\",\"requestedState\":"),
+   number(packet_field::requested_state),
+   literal("}"),
+};
+
+constexpr packet_segment power_on_packet[] = {
+   literal("{\"type\":\"PowerOnPacket\"}"),
+};
+
+constexpr packet_segment visibility_packet[] = {
+   literal("{\"type\": \"VisibilityPacket\","
+      "\"ecgVisible\": true,"
+      "\"bpVisible\": true,"
+      "\"spo2Visible\":true,"
+      "\"etco2Visible\": true,"
+      "\"rrVisible\": true,"
+      "\"tempVisible\": true,"
+      "\"custVisible1\": true,"
+      "\"custVisible2\": true,"
+      "\"custVisible3\": true,"
+      "\"cvpVisible\": true,"
+      "\"icpVisible\": true,"
+      "\"papVisible\": true,"
+      "}"),
+};
+
+constexpr packet_segment nibp_packet[] = {
+   literal("{\"type\": \"NibpPacket\",\"subType\": 0,\"bpSys\": 0,\"bpDia\": 0}"),
+};
+
+constexpr packet_segment change_monitor_packet[] = {
+   literal("{\"type\": \"ChangeMonitorPacket\""
+      ",\"monitorState\":"),
+   number(packet_field::monitor_type),
+   literal("}"),
+};
+
+constexpr packet_segment disconnect_packet[] = {
+   literal("{\"type\":\"DisconnectPacket\"}"),
+};
+
+#endif
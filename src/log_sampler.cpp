@@ -0,0 +1,64 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "log_sampler.hpp"
+
+log_sampler::log_sampler() {
+   topics_.emplace_back();
+   topics_.back().type = "*";
+}
+
+log_sampler::topic* log_sampler::find(const char* type) {
+   for (auto& t : topics_) {
+      if (t.type == type) return &t;
+   }
+   return nullptr;
+}
+
+void log_sampler::add_type(const char* type) {
+   if (find(type)) return;
+   topics_.emplace_back();
+   topics_.back().type = type;
+   topics_.back().policy = topics_.front().policy;
+}
+
+void log_sampler::set_policy(const std::string& type, log_policy policy) {
+   if (type == "*") {
+      for (auto& t : topics_) {
+         if (!t.own_policy) t.policy = policy;
+      }
+      return;
+   }
+   add_type(type.c_str());
+   topic* t = find(type.c_str());
+   t->policy = policy;
+   t->own_policy = true;
+}
+
+bool log_sampler::admit(const char* type) {
+   topic* t = find(type);
+   if (!t) t = &topics_.front();
+
+   const log_policy& policy = t->policy;
+   if (policy.every != 1) {
+      const uint64_t n = t->seen.fetch_add(1, std::memory_order_relaxed);
+      if (policy.every == 0 || n % policy.every != 0) {
+         sampled_.fetch_add(1, std::memory_order_relaxed);
+         return false;
+      }
+   }
+   if (policy.per_second == 0) return true;
+
+   // fixed one second windows, the count restarts with every new second
+   const uint64_t second = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::seconds>(clock::now() - start_).count());
+   uint64_t window = t->window.load(std::memory_order_relaxed);
+   for (;;) {
+      const uint64_t count = (window >> 32) == second ? (window & 0xffffffffu) : 0;
+      if (count >= policy.per_second) {
+         rate_limited_.fetch_add(1, std::memory_order_relaxed);
+         return false;
+      }
+      if (t->window.compare_exchange_weak(window, second << 32 | (count + 1), std::memory_order_relaxed)) return true;
+   }
+}
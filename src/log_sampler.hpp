@@ -0,0 +1,65 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef LOG_SAMPLER_HPP
+#define LOG_SAMPLER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+/**
+ * @brief How often messages of one packet type are logged
+ */
+struct log_policy {
+   uint32_t every = 1;        // log one in every messages, 0 logs none
+   uint32_t per_second = 0;   // at most this many per second, 0 for no limit
+};
+
+/**
+ * @brief Log_Sampler Class decides per packet type whether a message is logged.
+ *
+ * Asked before the log line is formatted, so a suppressed message costs
+ * two atomic operations. Types and policies are set up before the first
+ * admit(); types never added share the "*" policy and its counters.
+ * admit() may be called from any thread.
+ */
+class log_sampler
+{
+public:
+   using clock = std::chrono::steady_clock;
+
+   log_sampler();
+   log_sampler(const log_sampler&) = delete;
+   log_sampler& operator=(const log_sampler&) = delete;
+
+   // known type with the default policy, not thread safe
+   void add_type(const char* type);
+   // "*" changes the default of all types without their own policy, not thread safe
+   void set_policy(const std::string& type, log_policy policy);
+
+   bool admit(const char* type);
+
+   uint64_t sampled() const { return sampled_.load(std::memory_order_relaxed); }
+   uint64_t rate_limited() const { return rate_limited_.load(std::memory_order_relaxed); }
+
+private:
+   struct topic {
+      std::string type;
+      log_policy policy;
+      bool own_policy = false;
+      std::atomic<uint64_t> seen{0};
+      std::atomic<uint64_t> window{0};   // second << 32 | messages logged in it
+   };
+
+   topic* find(const char* type);
+
+   std::deque<topic> topics_;           // stable addresses, the first one is "*"
+   std::atomic<uint64_t> sampled_{0};
+   std::atomic<uint64_t> rate_limited_{0};
+   const clock::time_point start_ = clock::now();
+};
+
+#endif
@@ -0,0 +1,102 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "amm/BaseLogger.h"
+#include "metrics_server.hpp"
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = boost::beast::http;
+using tcp = net::ip::tcp;
+using error_code = boost::system::error_code;
+
+class metrics_server::connection : public std::enable_shared_from_this<connection>
+{
+   beast::tcp_stream stream_;
+   beast::flat_buffer buffer_;
+   http::request<http::empty_body> request_;
+   http::response<http::string_body> response_;
+   const render_handler& render_;
+
+public:
+   connection(tcp::socket&& socket, const render_handler& render)
+      : stream_(std::move(socket))
+      , render_(render)
+   {
+   }
+
+   void run() {
+      stream_.expires_after(std::chrono::seconds(10));
+      http::async_read(stream_, buffer_, request_,
+         beast::bind_front_handler(&connection::on_read, shared_from_this()));
+   }
+
+private:
+   void on_read(error_code ec, std::size_t) {
+      if (ec) return;
+      response_.version(request_.version());
+      response_.keep_alive(false);
+      if (request_.method() != http::verb::get) {
+         response_.result(http::status::method_not_allowed);
+      } else if (request_.target() != "/metrics") {
+         response_.result(http::status::not_found);
+      } else {
+         response_.result(http::status::ok);
+         response_.set(http::field::content_type, "text/plain; version=0.0.4");
+         response_.body().reserve(64 * 1024);
+         render_(response_.body());
+      }
+      response_.prepare_payload();
+      http::async_write(stream_, response_,
+         beast::bind_front_handler(&connection::on_write, shared_from_this()));
+   }
+
+   void on_write(error_code, std::size_t) {
+      error_code ec;
+      stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
+   }
+};
+
+metrics_server::metrics_server(net::io_context& ioc)
+   : ioc_(ioc)
+   , acceptor_(net::make_strand(ioc))
+{
+}
+
+bool metrics_server::start(const std::string& address, unsigned short port, render_handler render) {
+   render_ = std::move(render);
+   error_code ec;
+   const tcp::endpoint endpoint(net::ip::make_address(address, ec), port);
+   if (!ec) acceptor_.open(endpoint.protocol(), ec);
+   if (!ec) acceptor_.set_option(net::socket_base::reuse_address(true), ec);
+   if (!ec) acceptor_.bind(endpoint, ec);
+   if (!ec) acceptor_.listen(net::socket_base::max_listen_connections, ec);
+   if (ec) {
+      LOG_ERROR << "Metrics endpoint " << address << ":" << port << ": " << ec.message();
+      acceptor_.close(ec);
+      return false;
+   }
+   LOG_INFO << "Metrics at http://" << address << ":" << acceptor_.local_endpoint().port() << "/metrics";
+   accept();
+   return true;
+}
+
+void metrics_server::stop() {
+   net::dispatch(acceptor_.get_executor(), [this]() {
+      error_code ec;
+      acceptor_.close(ec);
+   });
+}
+
+unsigned short metrics_server::port() const {
+   error_code ec;
+   return acceptor_.local_endpoint(ec).port();
+}
+
+void metrics_server::accept() {
+   acceptor_.async_accept(net::make_strand(ioc_), [this](error_code ec, tcp::socket socket) {
+      if (ec) return;
+      std::make_shared<connection>(std::move(socket), render_)->run();
+      accept();
+   });
+}
@@ -0,0 +1,44 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef METRICS_SERVER_HPP
+#define METRICS_SERVER_HPP
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+/**
+ * @brief Metrics_Server Class serves GET /metrics over HTTP on the bridge's io_context.
+ *
+ * Every request renders the page anew through the render handler, which
+ * must be safe to call from the io_context threads. Connections are
+ * answered one request at a time and closed after the response.
+ */
+class metrics_server
+{
+public:
+   using render_handler = std::function<void(std::string&)>;
+
+   explicit metrics_server(boost::asio::io_context& ioc);
+
+   // listen on address:port, false if the port cannot be bound
+   bool start(const std::string& address, unsigned short port, render_handler render);
+   void stop();
+
+   unsigned short port() const;
+
+private:
+   class connection;
+
+   void accept();
+
+   boost::asio::io_context& ioc_;
+   boost::asio::ip::tcp::acceptor acceptor_;
+   render_handler render_;
+};
+
+#endif
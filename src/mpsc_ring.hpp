@@ -0,0 +1,94 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef MPSC_RING_HPP
+#define MPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+/**
+ * @brief Mpsc_Ring Class is a bounded lock-free queue for many producers and one consumer.
+ *
+ * Based on Dmitry Vyukov's bounded queue: every cell carries a sequence
+ * number, producers claim a position with one CAS and never wait on each
+ * other or on the consumer. try_push() fails instead of blocking when the
+ * ring is full. try_pop() must only be called from one thread at a time.
+ */
+template <typename T>
+class mpsc_ring
+{
+   struct cell {
+      std::atomic<std::size_t> sequence;
+      T data;
+   };
+
+   static constexpr std::size_t cache_line = 64;
+
+   std::unique_ptr<cell[]> buffer_;
+   std::size_t mask_;
+   char pad0_[cache_line];
+   std::atomic<std::size_t> enqueue_pos_{0};
+   char pad1_[cache_line];
+   std::size_t dequeue_pos_ = 0;
+
+   static std::size_t round_up(std::size_t n) {
+      std::size_t size = 2;
+      while (size < n) size <<= 1;
+      return size;
+   }
+
+public:
+   // capacity is rounded up to a power of two
+   explicit mpsc_ring(std::size_t capacity)
+      : buffer_(new cell[round_up(capacity)])
+      , mask_(round_up(capacity) - 1)
+   {
+      for (std::size_t i = 0; i <= mask_; ++i) {
+         buffer_[i].sequence.store(i, std::memory_order_relaxed);
+      }
+   }
+
+   mpsc_ring(const mpsc_ring&) = delete;
+   mpsc_ring& operator=(const mpsc_ring&) = delete;
+
+   std::size_t capacity() const { return mask_ + 1; }
+   // consumer only: no position is claimed, not even by a producer still writing it
+   bool empty() const { return enqueue_pos_.load(std::memory_order_acquire) == dequeue_pos_; }
+
+   bool try_push(T&& value) {
+      cell* c;
+      std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+      for (;;) {
+         c = &buffer_[pos & mask_];
+         std::size_t seq = c->sequence.load(std::memory_order_acquire);
+         std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+         if (diff == 0) {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+         } else if (diff < 0) {
+            return false;  // full
+         } else {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+         }
+      }
+      c->data = std::move(value);
+      c->sequence.store(pos + 1, std::memory_order_release);
+      return true;
+   }
+
+   bool try_pop(T& value) {
+      cell* c = &buffer_[dequeue_pos_ & mask_];
+      std::size_t seq = c->sequence.load(std::memory_order_acquire);
+      if (static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(dequeue_pos_ + 1) < 0) {
+         return false;  // empty, or the producer of this cell is not done yet
+      }
+      value = std::move(c->data);
+      c->sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+      ++dequeue_pos_;
+      return true;
+   }
+};
+
+#endif
@@ -0,0 +1,398 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "packet_serializer.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const double pow10_table[] = {
+   1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+};
+constexpr int max_fixed_precision = 9;
+
+// write an unsigned integer, returns end
+char* write_uint(char* out, uint64_t v) {
+   char tmp[20];
+   int n = 0;
+   do {
+      tmp[n++] = static_cast<char>('0' + v % 10);
+      v /= 10;
+   } while (v);
+   while (n) *out++ = tmp[--n];
+   return out;
+}
+
+// shortest %g text that parses back to v, up to three printf/strtod rounds;
+// the fallback of grisu3() below
+char* write_shortest_slow(char* out, double v) {
+   for (int digits = 15; digits <= 17; ++digits) {
+      int n = snprintf(out, max_number_length, "%.*g", digits, v);
+      if (digits == 17 || std::strtod(out, nullptr) == v) return out + n;
+   }
+   return out;
+}
+
+// Grisu3 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+// with Integers", 2010), the shortest mode of the double-conversion library:
+// 64-bit integer arithmetic only, and it knows when its digits may not be the
+// shortest or closest (about 0.5% of doubles), then write_shortest_slow() is used.
+struct diy_fp {
+   uint64_t f;
+   int e;
+};
+
+// upper 64 bits of the 128-bit product, rounded
+diy_fp multiply(diy_fp x, diy_fp y) {
+   const uint64_t m32 = 0xffffffffu;
+   const uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+   const uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+   const uint64_t mid = (bd >> 32) + (ad & m32) + (bc & m32) + (1u << 31);
+   return diy_fp{ac + (ad >> 32) + (bc >> 32) + (mid >> 32), x.e + y.e + 64};
+}
+
+diy_fp normalize(diy_fp x) {
+   while (!(x.f & (uint64_t(1) << 63))) {
+      x.f <<= 1;
+      --x.e;
+   }
+   return x;
+}
+
+// 10^k as a normalized significand and binary exponent, k = -348, -340, ..., 340
+struct cached_power {
+   uint64_t f;
+   int16_t e;
+   int16_t k;
+};
+
+const cached_power cached_powers[] = {
+   {0xfa8fd5a0081c0288, -1220, -348},
+   {0xbaaee17fa23ebf76, -1193, -340},
+   {0x8b16fb203055ac76, -1166, -332},
+   {0xcf42894a5dce35ea, -1140, -324},
+   {0x9a6bb0aa55653b2d, -1113, -316},
+   {0xe61acf033d1a45df, -1087, -308},
+   {0xab70fe17c79ac6ca, -1060, -300},
+   {0xff77b1fcbebcdc4f, -1034, -292},
+   {0xbe5691ef416bd60c, -1007, -284},
+   {0x8dd01fad907ffc3c, -980, -276},
+   {0xd3515c2831559a83, -954, -268},
+   {0x9d71ac8fada6c9b5, -927, -260},
+   {0xea9c227723ee8bcb, -901, -252},
+   {0xaecc49914078536d, -874, -244},
+   {0x823c12795db6ce57, -847, -236},
+   {0xc21094364dfb5637, -821, -228},
+   {0x9096ea6f3848984f, -794, -220},
+   {0xd77485cb25823ac7, -768, -212},
+   {0xa086cfcd97bf97f4, -741, -204},
+   {0xef340a98172aace5, -715, -196},
+   {0xb23867fb2a35b28e, -688, -188},
+   {0x84c8d4dfd2c63f3b, -661, -180},
+   {0xc5dd44271ad3cdba, -635, -172},
+   {0x936b9fcebb25c996, -608, -164},
+   {0xdbac6c247d62a584, -582, -156},
+   {0xa3ab66580d5fdaf6, -555, -148},
+   {0xf3e2f893dec3f126, -529, -140},
+   {0xb5b5ada8aaff80b8, -502, -132},
+   {0x87625f056c7c4a8b, -475, -124},
+   {0xc9bcff6034c13053, -449, -116},
+   {0x964e858c91ba2655, -422, -108},
+   {0xdff9772470297ebd, -396, -100},
+   {0xa6dfbd9fb8e5b88f, -369, -92},
+   {0xf8a95fcf88747d94, -343, -84},
+   {0xb94470938fa89bcf, -316, -76},
+   {0x8a08f0f8bf0f156b, -289, -68},
+   {0xcdb02555653131b6, -263, -60},
+   {0x993fe2c6d07b7fac, -236, -52},
+   {0xe45c10c42a2b3b06, -210, -44},
+   {0xaa242499697392d3, -183, -36},
+   {0xfd87b5f28300ca0e, -157, -28},
+   {0xbce5086492111aeb, -130, -20},
+   {0x8cbccc096f5088cc, -103, -12},
+   {0xd1b71758e219652c, -77, -4},
+   {0x9c40000000000000, -50, 4},
+   {0xe8d4a51000000000, -24, 12},
+   {0xad78ebc5ac620000, 3, 20},
+   {0x813f3978f8940984, 30, 28},
+   {0xc097ce7bc90715b3, 56, 36},
+   {0x8f7e32ce7bea5c70, 83, 44},
+   {0xd5d238a4abe98068, 109, 52},
+   {0x9f4f2726179a2245, 136, 60},
+   {0xed63a231d4c4fb27, 162, 68},
+   {0xb0de65388cc8ada8, 189, 76},
+   {0x83c7088e1aab65db, 216, 84},
+   {0xc45d1df942711d9a, 242, 92},
+   {0x924d692ca61be758, 269, 100},
+   {0xda01ee641a708dea, 295, 108},
+   {0xa26da3999aef774a, 322, 116},
+   {0xf209787bb47d6b85, 348, 124},
+   {0xb454e4a179dd1877, 375, 132},
+   {0x865b86925b9bc5c2, 402, 140},
+   {0xc83553c5c8965d3d, 428, 148},
+   {0x952ab45cfa97a0b3, 455, 156},
+   {0xde469fbd99a05fe3, 481, 164},
+   {0xa59bc234db398c25, 508, 172},
+   {0xf6c69a72a3989f5c, 534, 180},
+   {0xb7dcbf5354e9bece, 561, 188},
+   {0x88fcf317f22241e2, 588, 196},
+   {0xcc20ce9bd35c78a5, 614, 204},
+   {0x98165af37b2153df, 641, 212},
+   {0xe2a0b5dc971f303a, 667, 220},
+   {0xa8d9d1535ce3b396, 694, 228},
+   {0xfb9b7cd9a4a7443c, 720, 236},
+   {0xbb764c4ca7a44410, 747, 244},
+   {0x8bab8eefb6409c1a, 774, 252},
+   {0xd01fef10a657842c, 800, 260},
+   {0x9b10a4e5e9913129, 827, 268},
+   {0xe7109bfba19c0c9d, 853, 276},
+   {0xac2820d9623bf429, 880, 284},
+   {0x80444b5e7aa7cf85, 907, 292},
+   {0xbf21e44003acdd2d, 933, 300},
+   {0x8e679c2f5e44ff8f, 960, 308},
+   {0xd433179d9c8cb841, 986, 316},
+   {0x9e19db92b4e31ba9, 1013, 324},
+   {0xeb96bf6ebadf77d9, 1039, 332},
+   {0xaf87023b9bf0ee6b, 1066, 340},
+};
+constexpr int cached_powers_offset = 348;
+constexpr int cached_powers_distance = 8;
+
+// cached power c with -60 <= e(w * c) <= -32 for a normalized w
+const cached_power& cached_power_for(int e) {
+   const int min_exponent = -60 - (e + 64);
+   const int k = static_cast<int>(std::ceil((min_exponent + 63) * 0.30102999566398114));
+   return cached_powers[(cached_powers_offset + k - 1) / cached_powers_distance + 1];
+}
+
+// move the last digit down while that gets closer to w; false if the result
+// cannot be proven to be the closest digits inside the rounding interval
+bool round_weed(char* digits, int length, uint64_t distance_too_high_w, uint64_t unsafe_interval,
+                uint64_t rest, uint64_t ten_kappa, uint64_t unit) {
+   const uint64_t small_distance = distance_too_high_w - unit;
+   const uint64_t big_distance = distance_too_high_w + unit;
+   while (rest < small_distance && unsafe_interval - rest >= ten_kappa &&
+          (rest + ten_kappa < small_distance || small_distance - rest >= rest + ten_kappa - small_distance)) {
+      --digits[length - 1];
+      rest += ten_kappa;
+   }
+   if (rest < big_distance && unsafe_interval - rest >= ten_kappa &&
+       (rest + ten_kappa < big_distance || big_distance - rest > rest + ten_kappa - big_distance)) {
+      return false;
+   }
+   return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+// shortest digits of v > 0 with v = digits * 10^exponent; false if unsure
+bool grisu3(double v, char* digits, int& length, int& exponent) {
+   uint64_t bits;
+   std::memcpy(&bits, &v, sizeof(bits));
+   const uint64_t hidden = uint64_t(1) << 52;
+   const int biased = static_cast<int>(bits >> 52) & 0x7ff;
+   diy_fp w{bits & (hidden - 1), -1074};
+   if (biased) {
+      w.f += hidden;
+      w.e = biased - 1075;
+   }
+
+   // the rounding interval: halfway to the neighbouring doubles, the lower one
+   // is closer when v is a power of two
+   const diy_fp plus = normalize(diy_fp{(w.f << 1) + 1, w.e - 1});
+   diy_fp minus = (w.f == hidden && biased > 1) ? diy_fp{(w.f << 2) - 1, w.e - 2}
+                                                 : diy_fp{(w.f << 1) - 1, w.e - 1};
+   minus.f <<= minus.e - plus.e;
+   minus.e = plus.e;
+   w = normalize(w);
+
+   const cached_power& c = cached_power_for(w.e);
+   const diy_fp ten_mk{c.f, c.e};
+   const diy_fp scaled_w = multiply(w, ten_mk);
+   const diy_fp low = multiply(minus, ten_mk);
+   const diy_fp high = multiply(plus, ten_mk);
+
+   // the products are off by less than one unit each way
+   uint64_t unit = 1;
+   const uint64_t too_low = low.f - unit;
+   const uint64_t too_high = high.f + unit;
+   uint64_t unsafe_interval = too_high - too_low;
+   const int shift = -scaled_w.e;
+   const uint64_t one = uint64_t(1) << shift;
+   uint32_t integrals = static_cast<uint32_t>(too_high >> shift);
+   uint64_t fractionals = too_high & (one - 1);
+
+   uint32_t divisor = 1;
+   int kappa = 1;
+   while (divisor <= integrals / 10) {
+      divisor *= 10;
+      ++kappa;
+   }
+   length = 0;
+   while (kappa > 0) {
+      digits[length++] = static_cast<char>('0' + integrals / divisor);
+      integrals %= divisor;
+      --kappa;
+      const uint64_t rest = (static_cast<uint64_t>(integrals) << shift) + fractionals;
+      if (rest < unsafe_interval) {
+         exponent = kappa - c.k;
+         return round_weed(digits, length, too_high - scaled_w.f, unsafe_interval, rest,
+                           static_cast<uint64_t>(divisor) << shift, unit);
+      }
+      divisor /= 10;
+   }
+   for (;;) {
+      fractionals *= 10;
+      unit *= 10;
+      unsafe_interval *= 10;
+      digits[length++] = static_cast<char>('0' + (fractionals >> shift));
+      fractionals &= one - 1;
+      --kappa;
+      if (fractionals < unsafe_interval) {
+         exponent = kappa - c.k;
+         return round_weed(digits, length, (too_high - scaled_w.f) * unit, unsafe_interval, fractionals, one, unit);
+      }
+   }
+}
+
+// shortest text that parses back to v: plain decimals from 1e-5 up to 1e21,
+// exponent notation outside
+char* write_shortest(char* out, double v) {
+   char digits[18];
+   int length = 0;
+   int exponent = 0;
+   if (v == 0 || !grisu3(std::fabs(v), digits, length, exponent)) return write_shortest_slow(out, v);
+   while (length > 1 && digits[length - 1] == '0') {
+      --length;
+      ++exponent;
+   }
+
+   if (v < 0) *out++ = '-';
+   const int point = length + exponent;    // digits before the decimal point
+   if (point > 21 || point < -4) {
+      *out++ = digits[0];
+      if (length > 1) {
+         *out++ = '.';
+         std::memcpy(out, digits + 1, static_cast<std::size_t>(length - 1));
+         out += length - 1;
+      }
+      *out++ = 'e';
+      return out + snprintf(out, 8, "%d", point - 1);
+   }
+   if (point <= 0) {
+      *out++ = '0';
+      *out++ = '.';
+      for (int i = point; i < 0; ++i) *out++ = '0';
+      std::memcpy(out, digits, static_cast<std::size_t>(length));
+      return out + length;
+   }
+   if (point >= length) {
+      std::memcpy(out, digits, static_cast<std::size_t>(length));
+      out += length;
+      for (int i = length; i < point; ++i) *out++ = '0';
+      return out;
+   }
+   std::memcpy(out, digits, static_cast<std::size_t>(point));
+   out += point;
+   *out++ = '.';
+   std::memcpy(out, digits + point, static_cast<std::size_t>(length - point));
+   return out + (length - point);
+}
+
+}
+
+char* format_number(char* out, double v, int precision) {
+   // JSON has no representation for nan/inf
+   if (!std::isfinite(v)) {
+      *out++ = '0';
+      return out;
+   }
+
+   if (precision < 0) {
+      // integral values are common (waveform ids, whole vitals) and print without exponent
+      if (v == std::floor(v) && std::fabs(v) < 1e15) {
+         if (v < 0) *out++ = '-';
+         return write_uint(out, static_cast<uint64_t>(std::fabs(v)));
+      }
+      return write_shortest(out, v);
+   }
+
+   if (precision > max_fixed_precision) precision = max_fixed_precision;
+   const double scale = pow10_table[precision];
+   const double scaled = std::fabs(v) * scale;
+   if (scaled >= 9e15) return write_shortest(out, v);
+
+   uint64_t units = static_cast<uint64_t>(std::llround(scaled));
+   if (units == 0) {
+      *out++ = '0';
+      return out;
+   }
+   if (v < 0) *out++ = '-';
+
+   const uint64_t divisor = static_cast<uint64_t>(scale);
+   uint64_t integer = units / divisor;
+   uint64_t fraction = units % divisor;
+   out = write_uint(out, integer);
+   if (fraction == 0) return out;
+
+   // drop trailing zeros of the fraction
+   int digits = precision;
+   while (fraction % 10 == 0) {
+      fraction /= 10;
+      --digits;
+   }
+   *out++ = '.';
+   char* end = out + digits;
+   for (char* p = end; p != out;) {
+      *--p = static_cast<char>('0' + fraction % 10);
+      fraction /= 10;
+   }
+   return end;
+}
+
+void packet_template::build(const packet_segment* layout, std::size_t n) {
+   for (std::size_t i = 0; i < n; ++i) {
+      if (layout[i].text) {
+         text_ += layout[i].text;
+      } else {
+         slots_.push_back({text_.size(), layout[i].field, layout[i].precision});
+      }
+   }
+}
+
+void packet_values::set_vitals(const vitals_store& vitals) {
+   for (std::size_t i = 0; i < vital_count; ++i) {
+      value[i] = vitals.get(static_cast<vital>(i));
+   }
+}
+
+void packet_template::set_precision(packet_field field, int precision) {
+   for (auto& s : slots_) {
+      if (s.field == field) s.precision = precision;
+   }
+}
+
+const std::string& packet_template::render(packet_buffer& out, const packet_values& values) const {
+   out.reserve(max_size());
+   out.clear();
+
+   const char* text = text_.data();
+   std::size_t pos = 0;
+   char number[max_number_length];
+   for (const auto& s : slots_) {
+      out.append(text + pos, s.offset - pos);
+      if (s.precision == boolean_format) {
+         if (values[s.field] != 0) out.append("true", 4);
+         else out.append("false", 5);
+      } else {
+         char* end = format_number(number, values[s.field], s.precision);
+         out.append(number, static_cast<std::size_t>(end - number));
+      }
+      pos = s.offset;
+   }
+   out.append(text + pos, text_.size() - pos);
+   return out.str();
+}
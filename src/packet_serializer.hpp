@@ -0,0 +1,140 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef PACKET_SERIALIZER_HPP
+#define PACKET_SERIALIZER_HPP
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "vitals_store.hpp"
+
+/**
+ * @brief Numeric values that can be patched into an outbound packet.
+ * The first entries mirror the vital slots so the vitals map 1:1.
+ */
+enum class packet_field : std::size_t {
+   heart_rate = 0,
+   bp_systolic,
+   bp_diastolic,
+   spo2,
+   etco2,
+   resp_rate,
+   temperature,
+   sim_time,
+   ecg_waveform,
+   bp_waveform,
+   spo2_waveform,
+   etco2_waveform,
+   ectopics_pac,              // ectopic beats per minute
+   ectopics_pjc,
+   ectopics_pvc,
+   electrical_interference,   // rendered as true/false
+   artic_interference,
+   svv_interference,
+   sinus_arrhythmia_interference,
+   monitor_type,
+   connection_type,
+   requested_state,
+   count
+};
+
+constexpr std::size_t packet_field_count = static_cast<std::size_t>(packet_field::count);
+
+static_assert(static_cast<std::size_t>(packet_field::sim_time) == static_cast<std::size_t>(vital::sim_time),
+              "vital slots must map onto the leading packet fields");
+
+struct packet_values {
+   std::array<double, packet_field_count> value{};
+
+   double& operator[](packet_field f) { return value[static_cast<std::size_t>(f)]; }
+   double operator[](packet_field f) const { return value[static_cast<std::size_t>(f)]; }
+
+   // copy the latest vitals into the leading fields
+   void set_vitals(const vitals_store& vitals);
+};
+
+/**
+ * @brief One piece of a packet layout: either literal JSON text or a numeric slot.
+ * Layouts are constexpr arrays, see isimulate_packets.hpp.
+ */
+struct packet_segment {
+   const char* text;          // literal JSON, nullptr for a numeric slot
+   packet_field field;
+   int precision;             // max decimal places, -1 for shortest round trip
+};
+
+constexpr packet_segment literal(const char* text) {
+   return packet_segment{text, packet_field::count, 0};
+}
+
+constexpr packet_segment number(packet_field field, int precision = 0) {
+   return packet_segment{nullptr, field, precision};
+}
+
+// precision of a slot rendered as true (non-zero) or false
+constexpr int boolean_format = -2;
+
+constexpr packet_segment boolean(packet_field field) {
+   return packet_segment{nullptr, field, boolean_format};
+}
+
+// longest text format_number() can produce
+constexpr std::size_t max_number_length = 32;
+
+// write v with at most precision decimals (trailing zeros removed),
+// or the shortest text that round-trips when precision is negative.
+// out must hold max_number_length chars. returns the end of the written text.
+char* format_number(char* out, double v, int precision);
+
+/**
+ * @brief Reusable output buffer. Capacity is kept between packets, so rendering
+ * does not allocate once the buffer has grown to the largest packet.
+ */
+class packet_buffer
+{
+   std::string buf_;
+
+public:
+   explicit packet_buffer(std::size_t capacity = 4096) { buf_.reserve(capacity); }
+
+   void clear() { buf_.clear(); }
+   void reserve(std::size_t n) { if (buf_.capacity() < n) buf_.reserve(n); }
+   void append(const char* data, std::size_t n) { buf_.append(data, n); }
+   const std::string& str() const { return buf_; }
+};
+
+/**
+ * @brief Packet_Template Class is a pre-rendered packet built once from a layout.
+ * All literal text is joined up front; rendering copies it and fills in the
+ * numeric slots.
+ */
+class packet_template
+{
+   struct slot {
+      std::size_t offset;     // position in text_ where the value goes
+      packet_field field;
+      int precision;
+   };
+
+   std::string text_;
+   std::vector<slot> slots_;
+
+   void build(const packet_segment* layout, std::size_t n);
+
+public:
+   template <std::size_t N>
+   explicit packet_template(const packet_segment (&layout)[N]) { build(layout, N); }
+
+   // change the precision of every slot showing field
+   void set_precision(packet_field field, int precision);
+
+   // upper bound of the rendered size
+   std::size_t max_size() const { return text_.size() + slots_.size() * max_number_length; }
+
+   const std::string& render(packet_buffer& out, const packet_values& values) const;
+};
+
+#endif
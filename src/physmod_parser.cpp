@@ -0,0 +1,239 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "physmod_parser.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+
+namespace {
+
+constexpr std::size_t max_depth = 16;
+constexpr std::size_t severity_text_size = 32;
+
+const char root_name[] = "PhysiologyModification";
+const char severity_name[] = "Severity";
+
+struct name_ref {
+   const char* data;
+   std::size_t size;
+
+   template <std::size_t N>
+   bool is(const char (&name)[N]) const { return size == N - 1 && std::memcmp(data, name, N - 1) == 0; }
+};
+
+bool is_space(char c) {
+   return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool is_name_char(char c) {
+   return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+      || c == '_' || c == '-' || c == '.' || c == ':';
+}
+
+template <std::size_t N>
+bool starts_with(const char* p, const char* end, const char (&prefix)[N]) {
+   return static_cast<std::size_t>(end - p) >= N - 1 && std::memcmp(p, prefix, N - 1) == 0;
+}
+
+// move p behind the next marker, false if there is none
+template <std::size_t N>
+bool skip_past(const char*& p, const char* end, const char (&marker)[N]) {
+   for (; static_cast<std::size_t>(end - p) >= N - 1; ++p) {
+      if (std::memcmp(p, marker, N - 1) == 0) {
+         p += N - 1;
+         return true;
+      }
+   }
+   return false;
+}
+
+void skip_space(const char*& p, const char* end) {
+   while (p < end && is_space(*p)) ++p;
+}
+
+name_ref read_name(const char*& p, const char* end) {
+   const char* begin = p;
+   while (p < end && is_name_char(*p)) ++p;
+   return name_ref{begin, static_cast<std::size_t>(p - begin)};
+}
+
+// the whole trimmed text must be a number
+bool parse_severity(const char* begin, const char* end, double& value) {
+   while (begin < end && is_space(*begin)) ++begin;
+   while (end > begin && is_space(end[-1])) --end;
+   const std::size_t n = static_cast<std::size_t>(end - begin);
+   if (n == 0 || n >= severity_text_size) return false;
+   char text[severity_text_size];
+   std::memcpy(text, begin, n);
+   text[n] = '\0';
+   char* stop;
+   value = std::strtod(text, &stop);
+   return stop == text + n;
+}
+
+}
+
+bool parse_physmod(const char* data, std::size_t size, physmod_fields& out) {
+   out = physmod_fields();
+   const char* p = data;
+   const char* end = data + size;
+   name_ref stack[max_depth];
+   std::size_t depth = 0;
+   bool root_done = false;
+
+   while (p < end) {
+      if (*p != '<') {
+         const char* text = p;
+         while (p < end && *p != '<') ++p;
+         if (depth == 0) {
+            // only white space outside the root element
+            for (const char* c = text; c < p; ++c) {
+               if (!is_space(*c)) return false;
+            }
+         } else if (depth == 2 && stack[1].is(severity_name) && !out.has_severity) {
+            if (!parse_severity(text, p, out.severity)) return false;
+            out.has_severity = true;
+         }
+         continue;
+      }
+
+      if (starts_with(p, end, "<?")) {
+         if (!skip_past(p, end, "?>")) return false;
+      } else if (starts_with(p, end, "<!--")) {
+         if (!skip_past(p, end, "-->")) return false;
+      } else if (starts_with(p, end, "<![CDATA[")) {
+         if (depth == 0 || !skip_past(p, end, "]]>")) return false;
+      } else if (starts_with(p, end, "<!")) {
+         // DOCTYPE
+         if (depth != 0 || !skip_past(p, end, ">")) return false;
+      } else if (starts_with(p, end, "</")) {
+         p += 2;
+         const name_ref name = read_name(p, end);
+         skip_space(p, end);
+         if (p == end || *p != '>' || depth == 0) return false;
+         const name_ref& open = stack[depth - 1];
+         if (open.size != name.size || std::memcmp(open.data, name.data, name.size) != 0) return false;
+         ++p;
+         if (--depth == 0) root_done = true;
+      } else {
+         ++p;
+         const name_ref name = read_name(p, end);
+         if (name.size == 0 || root_done) return false;
+         if (depth == 0 && !name.is(root_name)) return false;
+
+         bool closed = false;
+         for (;;) {
+            skip_space(p, end);
+            if (p == end) return false;
+            if (*p == '>') {
+               ++p;
+               break;
+            }
+            if (*p == '/') {
+               if (++p == end || *p != '>') return false;
+               ++p;
+               closed = true;
+               break;
+            }
+            const name_ref attribute = read_name(p, end);
+            if (attribute.size == 0) return false;
+            skip_space(p, end);
+            if (p == end || *p != '=') return false;
+            ++p;
+            skip_space(p, end);
+            if (p == end || (*p != '"' && *p != '\'')) return false;
+            const char quote = *p++;
+            const char* value = p;
+            while (p < end && *p != quote) ++p;
+            if (p == end) return false;
+            if (depth == 0 && attribute.is("type")) {
+               out.type = value;
+               out.type_length = static_cast<std::size_t>(p - value);
+            }
+            ++p;
+         }
+
+         if (closed) {
+            if (depth == 0) root_done = true;
+         } else {
+            if (depth == max_depth) return false;
+            stack[depth++] = name;
+         }
+      }
+   }
+   return root_done && out.type != nullptr;
+}
+
+physmod_cache::physmod_cache(const waveform_rules& rules, std::size_t capacity)
+   : rules_(rules)
+   , capacity_(capacity > 0 ? capacity : 1)
+{
+   index_.reserve(capacity_);
+}
+
+// FNV-1a over 8 byte words, the tail byte by byte
+uint64_t physmod_cache::hash(const char* data, std::size_t size) {
+   uint64_t h = 14695981039346656037ull;
+   std::size_t i = 0;
+   for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+      uint64_t word;
+      std::memcpy(&word, data + i, sizeof(word));
+      h = (h ^ word) * 1099511628211ull;
+   }
+   for (; i < size; ++i) {
+      h = (h ^ static_cast<uint8_t>(data[i])) * 1099511628211ull;
+   }
+   return h ^ (h >> 32);
+}
+
+void physmod_cache::decode(const std::string& payload, physmod_action& action) const {
+   physmod_fields fields;
+   if (!parse_physmod(payload.data(), payload.size(), fields)) return;
+   action.valid = true;
+   action.type.assign(fields.type, fields.type_length);
+   action.severity = fields.severity;
+   action.has_severity = fields.has_severity;
+   action.rule = rules_.find(rule_source::physiology_modification, fields.type, fields.type_length);
+   if (action.rule) action.band = action.rule->match(fields.severity);
+}
+
+const physmod_action& physmod_cache::lookup(const std::string& payload) {
+   const uint64_t h = hash(payload.data(), payload.size());
+   auto range = index_.equal_range(h);
+   for (auto it = range.first; it != range.second; ++it) {
+      if (it->second->payload == payload) {
+         entries_.splice(entries_.begin(), entries_, it->second);
+         hits_.fetch_add(1, std::memory_order_relaxed);
+         return entries_.front().action;
+      }
+   }
+
+   misses_.fetch_add(1, std::memory_order_relaxed);
+   if (entries_.size() >= capacity_) {
+      // drop the least recently used payload
+      const entry& last = entries_.back();
+      auto victims = index_.equal_range(last.hash);
+      for (auto it = victims.first; it != victims.second; ++it) {
+         if (it->second == std::prev(entries_.end())) {
+            index_.erase(it);
+            break;
+         }
+      }
+      entries_.pop_back();
+   }
+   entries_.emplace_front();
+   entry& e = entries_.front();
+   e.hash = h;
+   e.payload = payload;
+   decode(payload, e.action);
+   if (!e.action.valid) malformed_.fetch_add(1, std::memory_order_relaxed);
+   index_.emplace(h, entries_.begin());
+   return e.action;
+}
+
+void physmod_cache::clear() {
+   entries_.clear();
+   index_.clear();
+}
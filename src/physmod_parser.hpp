@@ -0,0 +1,93 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef PHYSMOD_PARSER_HPP
+#define PHYSMOD_PARSER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+
+#include "waveform_rules.hpp"
+
+/**
+ * @brief Fields of a PhysiologyModification payload the bridge uses.
+ * type points into the parsed payload.
+ *
+ *    <?xml version="1.0" encoding="UTF-8"?>
+ *    <PhysiologyModification type="AirwayObstruction"><Severity>0.5</Severity></PhysiologyModification>
+ */
+struct physmod_fields {
+   const char* type = nullptr;
+   std::size_t type_length = 0;
+   double severity = 0;
+   bool has_severity = false;
+};
+
+// single pass over the payload without building a document or allocating.
+// checks that tags nest and close; false for malformed XML, another root
+// element or a missing type attribute.
+bool parse_physmod(const char* data, std::size_t size, physmod_fields& out);
+
+/**
+ * @brief What a PhysiologyModification payload does to the monitor
+ */
+struct physmod_action {
+   bool valid = false;        // well-formed PhysiologyModification
+   std::string type;
+   double severity = 0;
+   bool has_severity = false;
+   const waveform_rule* rule = nullptr;   // nullptr if no rule handles the type
+   const rule_band* band = nullptr;       // band of the severity, nullptr if none matches
+};
+
+/**
+ * @brief Physmod_Cache Class decodes PhysiologyModification payloads once.
+ *
+ * Scenario engines send the same few payloads over and over. Decoded
+ * actions are kept in an LRU list keyed by a word-wise FNV-1a hash of the payload;
+ * a repeated payload costs one hash, one map lookup and a compare with the
+ * cached payload, and does not allocate. Malformed payloads are cached too.
+ *
+ * The rules must outlive the cache and not be reloaded while it is used.
+ * lookup() is called from a single thread (the PhysiologyModification listener).
+ */
+class physmod_cache
+{
+public:
+   explicit physmod_cache(const waveform_rules& rules, std::size_t capacity = 64);
+   physmod_cache(const physmod_cache&) = delete;
+   physmod_cache& operator=(const physmod_cache&) = delete;
+
+   const physmod_action& lookup(const std::string& payload);
+   void clear();
+
+   uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+   uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+   uint64_t malformed() const { return malformed_.load(std::memory_order_relaxed); }
+
+private:
+   struct entry {
+      uint64_t hash;
+      std::string payload;
+      physmod_action action;
+   };
+   using entry_list = std::list<entry>;
+
+   static uint64_t hash(const char* data, std::size_t size);
+   void decode(const std::string& payload, physmod_action& action) const;
+
+   const waveform_rules& rules_;
+   const std::size_t capacity_;
+   entry_list entries_;          // most recently used first
+   std::unordered_multimap<uint64_t, entry_list::iterator> index_;
+
+   std::atomic<uint64_t> hits_{0};
+   std::atomic<uint64_t> misses_{0};
+   std::atomic<uint64_t> malformed_{0};
+};
+
+#endif
@@ -0,0 +1,201 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "amm/BaseLogger.h"
+#include "reconnect_controller.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+reconnect_controller::reconnect_controller(net::io_context& ioc, session_manager& sessions)
+   : sessions_(sessions)
+   , strand_(net::make_strand(ioc))
+   , random_(static_cast<std::minstd_rand::result_type>(clock::now().time_since_epoch().count()))
+{
+}
+
+reconnect_controller::endpoint& reconnect_controller::entry(const std::string& key) {
+   auto& ep = endpoints_[key];
+   if (!ep) ep.reset(new endpoint(strand_));
+   return *ep;
+}
+
+void reconnect_controller::set_endpoint(endpoint& ep, const std::string& host, const std::string& port) {
+   if (ep.host == host && ep.port == port) return;
+   ep.host = host;
+   ep.port = port;
+   dirty_ = true;
+}
+
+void reconnect_controller::load() {
+   if (config_.cache_file.empty()) return;
+   net::dispatch(strand_, [this]() {
+      std::ifstream in(config_.cache_file);
+      std::string line;
+      while (std::getline(in, line)) {
+         // name <tab> address <tab> port
+         const auto a = line.find('\t');
+         const auto b = a == std::string::npos ? a : line.find('\t', a + 1);
+         if (b == std::string::npos) continue;
+         const std::string key = line.substr(0, a);
+         endpoint& ep = entry(key);
+         ep.host = line.substr(a + 1, b - a - 1);
+         ep.port = line.substr(b + 1);
+         LOG_INFO << "Connecting to cached monitor endpoint '" << key << "' at " << ep.host << ":" << ep.port;
+         sessions_.open(key, ep.host, ep.port);
+      }
+   });
+}
+
+void reconnect_controller::on_service(const service_event& ev) {
+   net::dispatch(strand_, [this, ev]() {
+      endpoint& ep = entry(ev.name);
+      if (ev.kind == service_event::removed) {
+         // the monitor went away on purpose, its session is closed and not retried
+         ep.advertised = false;
+         ep.withdrawn = true;
+         ep.timer.cancel();
+         if (ep.down) {
+            ep.down = false;
+            pending_resyncs_.fetch_sub(1, std::memory_order_relaxed);
+         }
+         return;
+      }
+      // discovery opens the session itself, a pending retry is obsolete
+      set_endpoint(ep, ev.address, std::to_string(ev.port));
+      ep.advertised = true;
+      ep.withdrawn = false;
+      ep.attempts = 0;
+      ep.timer.cancel();
+   });
+}
+
+void reconnect_controller::on_connected(monitor_session& session) {
+   net::dispatch(strand_, [this, key = session.key, host = session.host, port = session.port]() {
+      endpoint& ep = entry(key);
+      set_endpoint(ep, host, port);
+      ep.up = true;
+      ep.timer.cancel();
+      if (ep.down) {
+         reconnects_.fetch_add(1, std::memory_order_relaxed);
+         LOG_INFO << "Monitor '" << key << "' reconnected after "
+                  << duration_cast<milliseconds>(clock::now() - ep.down_since).count() << " ms"
+                  << " (" << ep.attempts << " attempts)";
+      }
+      ep.attempts = 0;
+      if (dirty_) save();
+   });
+}
+
+void reconnect_controller::on_closed(monitor_session& session) {
+   if (stopped_.load(std::memory_order_acquire)) return;
+   net::dispatch(strand_, [this, key = session.key, host = session.host, port = session.port]() {
+      if (stopped_.load(std::memory_order_acquire)) return;
+      auto it = endpoints_.find(key);
+      if (it == endpoints_.end()) return;
+      endpoint& ep = *it->second;
+      // replaced by a session at a newer endpoint, or already reopened
+      if (ep.host != host || ep.port != port) return;
+      if (sessions_.find(key)) return;
+      if (ep.withdrawn) {
+         ep.up = false;
+         return;
+      }
+
+      const bool was_up = ep.up;
+      ep.up = false;
+      // a drop of a live link starts the resync clock, a failed attempt does not
+      if (was_up && !ep.down) {
+         ep.down = true;
+         ep.down_since = clock::now();
+         pending_resyncs_.fetch_add(1, std::memory_order_relaxed);
+      }
+      schedule(key, ep);
+   });
+}
+
+void reconnect_controller::on_vitals_written(monitor_session& session) {
+   // cheap check on the write path, nothing to measure most of the time
+   if (pending_resyncs_.load(std::memory_order_relaxed) == 0) return;
+   const clock::time_point now = clock::now();
+   net::dispatch(strand_, [this, key = session.key, now]() {
+      auto it = endpoints_.find(key);
+      if (it == endpoints_.end() || !it->second->down) return;
+      endpoint& ep = *it->second;
+      ep.down = false;
+      pending_resyncs_.fetch_sub(1, std::memory_order_relaxed);
+
+      const int64_t ms = duration_cast<milliseconds>(now - ep.down_since).count();
+      resyncs_.fetch_add(1, std::memory_order_relaxed);
+      last_resync_ms_.store(ms, std::memory_order_relaxed);
+      if (ms > max_resync_ms_.load(std::memory_order_relaxed)) max_resync_ms_.store(ms, std::memory_order_relaxed);
+      LOG_INFO << "Monitor '" << key << "' resynced: disconnect to first vitals " << ms << " ms";
+   });
+}
+
+void reconnect_controller::stop() {
+   stopped_.store(true, std::memory_order_release);
+   net::dispatch(strand_, [this]() {
+      for (auto& e : endpoints_) e.second->timer.cancel();
+      if (dirty_) save();
+   });
+}
+
+reconnect_controller::clock::duration reconnect_controller::backoff(int attempt) {
+   // first retry right away, then base * 2^(n-1) up to the cap
+   if (attempt <= 0) return clock::duration::zero();
+   const int64_t cap = config_.max_delay.count();
+   int64_t delay = config_.base_delay.count();
+   for (int i = 1; i < attempt && delay < cap; ++i) delay *= 2;
+   if (delay > cap) delay = cap;
+   // jitter into [delay/2, delay] so monitors dropped together do not retry in lockstep
+   std::uniform_int_distribution<int64_t> jitter(delay / 2, delay);
+   return milliseconds(jitter(random_));
+}
+
+void reconnect_controller::schedule(const std::string& key, endpoint& ep) {
+   if (!ep.advertised && ep.attempts >= config_.max_attempts) {
+      LOG_INFO << "Monitor '" << key << "' not advertised, giving up after " << ep.attempts << " attempts";
+      if (ep.down) {
+         ep.down = false;
+         pending_resyncs_.fetch_sub(1, std::memory_order_relaxed);
+      }
+      return;
+   }
+
+   const clock::duration delay = backoff(ep.attempts++);
+   LOG_DEBUG << "Monitor '" << key << "' retry " << ep.attempts << " in "
+             << duration_cast<milliseconds>(delay).count() << " ms";
+   ep.timer.expires_after(delay);
+   endpoint* target = &ep;   // endpoints are never erased
+   ep.timer.async_wait([this, key, target](error_code ec) {
+      if (ec || stopped_.load(std::memory_order_acquire) || target->withdrawn) return;
+      if (sessions_.find(key)) return;
+      LOG_INFO << "Reconnecting to monitor '" << key << "' at " << target->host << ":" << target->port;
+      sessions_.open(key, target->host, target->port);
+   });
+}
+
+void reconnect_controller::save() {
+   dirty_ = false;
+   if (config_.cache_file.empty()) return;
+   // write aside and rename, a crash never leaves a truncated cache
+   const std::string tmp = config_.cache_file + ".tmp";
+   {
+      std::ofstream out(tmp, std::ios::trunc);
+      for (const auto& e : endpoints_) {
+         if (e.second->host.empty()) continue;
+         out << e.first << '\t' << e.second->host << '\t' << e.second->port << '\n';
+      }
+      if (!out) {
+         LOG_ERROR << "Could not write endpoint cache " << tmp;
+         return;
+      }
+   }
+   if (std::rename(tmp.c_str(), config_.cache_file.c_str()) != 0) {
+      LOG_ERROR << "Could not replace endpoint cache " << config_.cache_file;
+   }
+}
@@ -0,0 +1,108 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef RECONNECT_CONTROLLER_HPP
+#define RECONNECT_CONTROLLER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+#include "session_manager.hpp"
+#include "service_discovery.hpp"
+
+struct reconnect_config {
+   std::chrono::milliseconds base_delay{250};    // delay of the first backoff step
+   std::chrono::milliseconds max_delay{10000};   // backoff cap
+   // endpoints no longer advertised (or only known from the cache file)
+   // are given up after this many failed attempts; advertised ones retry forever
+   int max_attempts = 20;
+   std::string cache_file = "config/isimulate_bridge_endpoints.cache";   // empty: do not persist
+};
+
+/**
+ * @brief Reconnect_Controller Class reconnects dropped monitors without waiting for mDNS.
+ *
+ * The last endpoint of every monitor is remembered (and persisted to the
+ * cache file). When a session closes the endpoint is retried right away,
+ * then with jittered exponential backoff, while discovery keeps running and
+ * may supply a newer endpoint at any time. The time from a disconnect to the
+ * first vitals written after the reconnect is logged. A monitor whose
+ * service discovery reports removed is not retried until it is resolved again.
+ *
+ * All public functions may be called from any thread; the work runs on the
+ * controller's strand.
+ */
+class reconnect_controller
+{
+public:
+   using clock = std::chrono::steady_clock;
+
+   reconnect_controller(net::io_context& ioc, session_manager& sessions);
+
+   void set_config(reconnect_config config) { config_ = std::move(config); }
+
+   // read the cache file and connect to every endpoint in it
+   void load();
+   // endpoint updates from discovery
+   void on_service(const service_event& ev);
+   // websocket handshake completed
+   void on_connected(monitor_session& session);
+   // session ended, schedules a retry
+   void on_closed(monitor_session& session);
+   // a vitals packet reached the monitor
+   void on_vitals_written(monitor_session& session);
+   // cancel all retries, sessions closed from now on stay closed
+   void stop();
+
+   uint64_t reconnects() const { return reconnects_.load(std::memory_order_relaxed); }
+   uint64_t resyncs() const { return resyncs_.load(std::memory_order_relaxed); }
+   // disconnect to first vitals of the latest and the slowest resync
+   std::chrono::milliseconds last_resync() const { return std::chrono::milliseconds(last_resync_ms_.load(std::memory_order_relaxed)); }
+   std::chrono::milliseconds max_resync() const { return std::chrono::milliseconds(max_resync_ms_.load(std::memory_order_relaxed)); }
+
+private:
+   struct endpoint {
+      explicit endpoint(net::strand<net::io_context::executor_type>& strand)
+         : timer(strand) {}
+
+      std::string host;
+      std::string port;
+      bool advertised = false;    // currently resolved by discovery
+      bool withdrawn = false;     // removed by discovery, not retried until resolved again
+      bool up = false;            // websocket handshake done on the current session
+      int attempts = 0;           // failed attempts since the last handshake
+      bool down = false;          // disconnected, resync pending
+      clock::time_point down_since;
+      net::steady_timer timer;
+   };
+
+   endpoint& entry(const std::string& key);
+   void set_endpoint(endpoint& ep, const std::string& host, const std::string& port);
+   void schedule(const std::string& key, endpoint& ep);
+   clock::duration backoff(int attempt);
+   void save();
+
+   session_manager& sessions_;
+   net::strand<net::io_context::executor_type> strand_;
+   reconnect_config config_;
+   std::atomic<bool> stopped_{false};
+
+   // strand only
+   std::map<std::string, std::unique_ptr<endpoint>> endpoints_;
+   std::minstd_rand random_;
+   bool dirty_ = false;          // endpoints changed since the cache was written
+
+   // sessions waiting for their first vitals, checked before posting
+   std::atomic<int> pending_resyncs_{0};
+   std::atomic<uint64_t> reconnects_{0};
+   std::atomic<uint64_t> resyncs_{0};
+   std::atomic<int64_t> last_resync_ms_{0};
+   std::atomic<int64_t> max_resync_ms_{0};
+};
+
+#endif
@@ -0,0 +1,98 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "send_policy.hpp"
+
+#include <cmath>
+
+send_policy_config::send_policy_config() {
+   deadband.fill(-1.0);
+   deadband[static_cast<std::size_t>(packet_field::heart_rate)] = 0.5;
+   deadband[static_cast<std::size_t>(packet_field::bp_systolic)] = 0.5;
+   deadband[static_cast<std::size_t>(packet_field::bp_diastolic)] = 0.5;
+   deadband[static_cast<std::size_t>(packet_field::spo2)] = 0.005;   // AMM may report a fraction
+   deadband[static_cast<std::size_t>(packet_field::etco2)] = 0.5;
+   deadband[static_cast<std::size_t>(packet_field::resp_rate)] = 0.5;
+   deadband[static_cast<std::size_t>(packet_field::temperature)] = 0.05;
+   // any change of a waveform selection is sent
+   deadband[static_cast<std::size_t>(packet_field::ecg_waveform)] = 0.0;
+   deadband[static_cast<std::size_t>(packet_field::bp_waveform)] = 0.0;
+   deadband[static_cast<std::size_t>(packet_field::spo2_waveform)] = 0.0;
+   deadband[static_cast<std::size_t>(packet_field::etco2_waveform)] = 0.0;
+   // as are the ectopics and interference settings
+   for (std::size_t i = static_cast<std::size_t>(packet_field::ectopics_pac);
+        i <= static_cast<std::size_t>(packet_field::sinus_arrhythmia_interference); ++i) {
+      deadband[i] = 0.0;
+   }
+}
+
+const char* to_string(send_reason reason) {
+   switch (reason) {
+      case send_reason::none:      return "none";
+      case send_reason::first:     return "first";
+      case send_reason::vitals:    return "vitals";
+      case send_reason::waveform:  return "waveform";
+      case send_reason::heartbeat: return "heartbeat";
+      case send_reason::keyframe:  return "keyframe";
+   }
+   return "unknown";
+}
+
+send_policy::send_policy(send_policy_config config)
+   : config_(config)
+{
+}
+
+// waveform selections and the ECG settings next to them
+bool send_policy::is_waveform(std::size_t field) {
+   return field >= static_cast<std::size_t>(packet_field::ecg_waveform)
+      && field <= static_cast<std::size_t>(packet_field::sinus_arrhythmia_interference);
+}
+
+send_reason send_policy::evaluate(const packet_values& values, clock::time_point now) {
+   send_reason reason = send_reason::none;
+
+   if (reset_requested_.exchange(false, std::memory_order_acq_rel)) has_sent_ = false;
+
+   if (!has_sent_) {
+      reason = send_reason::first;
+   } else if (now - last_keyframe_time_ >= config_.keyframe_period) {
+      reason = send_reason::keyframe;
+   } else {
+      bool vitals_changed = false;
+      bool waveform_changed = false;
+      for (std::size_t i = 0; i < packet_field_count; ++i) {
+         const double band = config_.deadband[i];
+         if (band < 0) continue;
+         const double delta = std::fabs(values.value[i] - last_sent_.value[i]);
+         if (delta > band || (band == 0 && values.value[i] != last_sent_.value[i])) {
+            if (is_waveform(i)) waveform_changed = true;
+            else vitals_changed = true;
+         }
+      }
+      const auto elapsed = now - last_send_time_;
+      if (waveform_changed) reason = send_reason::waveform;
+      else if (vitals_changed && elapsed >= config_.min_interval) reason = send_reason::vitals;
+      else if (elapsed >= config_.max_interval) reason = send_reason::heartbeat;
+   }
+
+   if (reason == send_reason::none) {
+      suppressed_.fetch_add(1, std::memory_order_relaxed);
+      return reason;
+   }
+
+   // deadbands are measured against the last values sent, so slow drift is not lost
+   last_sent_ = values;
+   last_send_time_ = now;
+   if (reason == send_reason::keyframe || reason == send_reason::first) {
+      last_keyframe_time_ = now;
+      keyframes_.fetch_add(1, std::memory_order_relaxed);
+   }
+   has_sent_ = true;
+   sent_.fetch_add(1, std::memory_order_relaxed);
+   return reason;
+}
+
+void send_policy::reset() {
+   reset_requested_.store(true, std::memory_order_release);
+}
@@ -0,0 +1,81 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef SEND_POLICY_HPP
+#define SEND_POLICY_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "packet_serializer.hpp"
+
+/**
+ * @brief Tuning of the ChangeActionPacket send policy
+ */
+struct send_policy_config {
+   // smallest change of a field that triggers a send; negative ignores the field
+   std::array<double, packet_field_count> deadband;
+   // changed vitals are held back until this much time passed since the last send
+   std::chrono::milliseconds min_interval{150};
+   // longest silence before the unchanged state is sent again
+   std::chrono::milliseconds max_interval{1000};
+   // full resend that also re-baselines all deadbands
+   std::chrono::milliseconds keyframe_period{5000};
+
+   send_policy_config();
+};
+
+enum class send_reason {
+   none = 0,      // suppressed
+   first,         // nothing sent yet since start or reset
+   vitals,        // a vital moved beyond its deadband
+   waveform,      // waveform selection, ectopics or interference changed
+   heartbeat,     // max_interval expired
+   keyframe       // keyframe_period expired
+};
+
+const char* to_string(send_reason reason);
+
+/**
+ * @brief Send_Policy Class decides whether a new ChangeActionPacket is worth sending.
+ *
+ * evaluate() is called from a single thread (the bridge strand);
+ * reset() and the counters may be used from any thread.
+ */
+class send_policy
+{
+public:
+   using clock = std::chrono::steady_clock;
+
+   explicit send_policy(send_policy_config config = send_policy_config());
+
+   send_reason evaluate(const packet_values& values, clock::time_point now);
+
+   // next evaluate() sends unconditionally
+   void reset();
+
+   const send_policy_config& config() const { return config_; }
+   void set_config(const send_policy_config& config) { config_ = config; }
+
+   uint64_t sent() const { return sent_.load(std::memory_order_relaxed); }
+   uint64_t suppressed() const { return suppressed_.load(std::memory_order_relaxed); }
+   uint64_t keyframes() const { return keyframes_.load(std::memory_order_relaxed); }
+
+private:
+   static bool is_waveform(std::size_t field);
+
+   send_policy_config config_;
+   packet_values last_sent_;
+   clock::time_point last_send_time_;
+   clock::time_point last_keyframe_time_;
+   bool has_sent_ = false;
+   std::atomic<bool> reset_requested_{false};
+
+   std::atomic<uint64_t> sent_{0};
+   std::atomic<uint64_t> suppressed_{0};
+   std::atomic<uint64_t> keyframes_{0};
+};
+
+#endif
@@ -0,0 +1,118 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "amm/BaseLogger.h"
+#include "send_scheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+namespace {
+
+// frames measured before the slots lock to the ticks
+constexpr int64_t lock_frames = 8;
+
+}
+
+send_scheduler::send_scheduler(executor_type executor)
+   : timer_(executor)
+{
+}
+
+void send_scheduler::start() {
+   net::dispatch(timer_.get_executor(), [this]() {
+      stopped_ = false;
+      timer_.expires_after(config_.cadence);
+      arm();
+   });
+}
+
+void send_scheduler::stop() {
+   net::dispatch(timer_.get_executor(), [this]() {
+      stopped_ = true;
+      timer_.cancel();
+   });
+}
+
+void send_scheduler::set_active(bool active) {
+   // a pause is not jitter, the first slot after it starts over
+   if (active != active_) last_slot_ = clock::time_point();
+   active_ = active;
+}
+
+void send_scheduler::on_tick(int64_t frame, clock::time_point now) {
+   if (frame < last_frame_) {
+      // frames start over after a reset
+      base_frame_ = -1;
+      next_frame_ = 0;
+   }
+   if (base_frame_ < 0) {
+      base_frame_ = frame;
+      base_tick_ = now;
+   } else if (frame > base_frame_) {
+      // over the whole run the delivery jitter of single ticks averages out
+      tick_period_us_ = duration_cast<microseconds>(now - base_tick_).count() / static_cast<double>(frame - base_frame_);
+   }
+   last_frame_ = frame;
+   last_tick_ = now;
+   if (!active_ || frame - base_frame_ < lock_frames) return;
+
+   if (!locked_.load(std::memory_order_relaxed)) {
+      // the frames per slot are kept until the ticks stop, so the phase never jumps
+      const double cadence_us = static_cast<double>(duration_cast<microseconds>(config_.cadence).count());
+      step_ = std::max<int64_t>(1, std::llround(cadence_us / tick_period_us_));
+      next_frame_ = (frame / step_ + 1) * step_;
+      locked_.store(true, std::memory_order_relaxed);
+      LOG_INFO << "Send scheduler locked to Tick, " << tick_period_us_ / 1000 << " ms per frame, "
+               << step_ << " frames per slot";
+   }
+   if (frame < next_frame_) return;
+
+   // slots fall on multiples of step frames, a late tick does not shift the phase
+   next_frame_ = (frame / step_ + 1) * step_;
+   fire(now, microseconds(std::llround(step_ * tick_period_us_)), true);
+}
+
+void send_scheduler::arm() {
+   timer_.async_wait([this](error_code ec) { on_timer(ec); });
+}
+
+void send_scheduler::on_timer(error_code ec) {
+   if (ec || stopped_) return;
+   const clock::time_point now = clock::now();
+   if (active_) {
+      if (locked_.load(std::memory_order_relaxed) && now - last_tick_ > config_.tick_timeout) {
+         locked_.store(false, std::memory_order_relaxed);
+         base_frame_ = -1;
+         unlocks_.fetch_add(1, std::memory_order_relaxed);
+         LOG_WARNING << "No Tick for " << duration_cast<milliseconds>(now - last_tick_).count()
+                     << " ms, sending on the timer";
+      }
+      if (!locked_.load(std::memory_order_relaxed)) fire(now, config_.cadence, false);
+   }
+   // fixed period from the first expiry, a late wakeup does not delay the next one;
+   // after a stall the slots start over instead of catching up
+   const clock::time_point next = timer_.expiry() + config_.cadence;
+   timer_.expires_at(next > now ? next : now + config_.cadence);
+   arm();
+}
+
+void send_scheduler::fire(clock::time_point now, clock::duration expected, bool from_tick) {
+   if (last_slot_ != clock::time_point()) {
+      const clock::duration interval = now - last_slot_;
+      jitter_.record(interval > expected ? interval - expected : expected - interval);
+   }
+   last_slot_ = now;
+
+   const bool sync = config_.sync_period.count() > 0 && now - last_sync_ >= config_.sync_period;
+   if (sync) {
+      last_sync_ = now;
+      syncs_.fetch_add(1, std::memory_order_relaxed);
+   }
+   (from_tick ? tick_slots_ : timer_slots_).fetch_add(1, std::memory_order_relaxed);
+   if (handler_) handler_(now, sync);
+}
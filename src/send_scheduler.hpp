@@ -0,0 +1,97 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef SEND_SCHEDULER_HPP
+#define SEND_SCHEDULER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include "bridge_metrics.hpp"
+
+/**
+ * @brief Cadence of the packets sent to the monitors
+ */
+struct scheduler_config {
+   // time between send slots; with ticks the nearest whole number of tick frames
+   std::chrono::milliseconds cadence{200};
+   // a SyncTimesPacket goes with the first slot after this much time, 0 never
+   std::chrono::milliseconds sync_period{5000};
+   // without a Tick for this long the timer drives the slots
+   std::chrono::milliseconds tick_timeout{500};
+};
+
+/**
+ * @brief Send_Scheduler Class is the clock of the monitor updates.
+ *
+ * Send slots are phase-locked to AMM Tick frames: every slot falls on a
+ * multiple of cadence / tick period frames, so packets follow simulation
+ * time instead of when a sample happened to be delivered. When the ticks
+ * stop, a steady_timer on the same strand keeps the cadence until they
+ * come back. The error of every slot interval against its expected length
+ * is recorded as jitter.
+ *
+ * All functions except the counters run on the strand given to the constructor.
+ */
+class send_scheduler
+{
+public:
+   using clock = std::chrono::steady_clock;
+   using executor_type = net::strand<net::io_context::executor_type>;
+   // sync: a SyncTimesPacket is due with this slot
+   using slot_handler = std::function<void(clock::time_point now, bool sync)>;
+
+   explicit send_scheduler(executor_type executor);
+
+   void set_config(const scheduler_config& config) { config_ = config; }
+   void set_handler(slot_handler on_slot) { handler_ = std::move(on_slot); }
+
+   // arm the fallback timer
+   void start();
+   void stop();
+   // slots are only issued while active (the scenario is running)
+   void set_active(bool active);
+   // an AMM Tick arrived at now
+   void on_tick(int64_t frame, clock::time_point now);
+
+   bool tick_locked() const { return locked_.load(std::memory_order_relaxed); }
+   uint64_t tick_slots() const { return tick_slots_.load(std::memory_order_relaxed); }
+   uint64_t timer_slots() const { return timer_slots_.load(std::memory_order_relaxed); }
+   uint64_t syncs() const { return syncs_.load(std::memory_order_relaxed); }
+   // times the ticks stopped and the timer took over
+   uint64_t unlocks() const { return unlocks_.load(std::memory_order_relaxed); }
+   const latency_histogram& jitter() const { return jitter_; }
+
+private:
+   void arm();
+   void on_timer(error_code ec);
+   void fire(clock::time_point now, clock::duration expected, bool from_tick);
+
+   net::steady_timer timer_;
+   scheduler_config config_;
+   slot_handler handler_;
+
+   // strand only
+   bool active_ = false;
+   bool stopped_ = false;
+   int64_t last_frame_ = -1;
+   int64_t next_frame_ = 0;
+   clock::time_point last_tick_;
+   int64_t base_frame_ = -1;      // first frame of the period measurement
+   clock::time_point base_tick_;
+   double tick_period_us_ = 0;    // time per frame since base_frame_
+   int64_t step_ = 1;             // frames per slot, fixed while locked
+   clock::time_point last_slot_;
+   clock::time_point last_sync_;
+
+   std::atomic<bool> locked_{false};
+   std::atomic<uint64_t> tick_slots_{0};
+   std::atomic<uint64_t> timer_slots_{0};
+   std::atomic<uint64_t> syncs_{0};
+   std::atomic<uint64_t> unlocks_{0};
+   latency_histogram jitter_;
+};
+
+#endif
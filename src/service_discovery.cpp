@@ -0,0 +1,178 @@
+/*
+    based on avahi example client-browse-services.c
+*/
+#include "amm/BaseLogger.h"
+#include "service_discovery.hpp"
+
+#include <avahi-common/error.h>
+#include <avahi-common/malloc.h>
+
+service_discovery::service_discovery(boost::asio::io_context& ioc, std::string type)
+   : poll_(ioc)
+   , type_(std::move(type))
+{
+}
+
+service_discovery::~service_discovery() {
+   // io threads are gone by now, free avahi objects directly
+   do_stop();
+}
+
+void service_discovery::start(event_handler handler) {
+   handler_ = std::move(handler);
+   boost::asio::dispatch(poll_.strand(), [this]() { do_start(); });
+}
+
+void service_discovery::stop() {
+   boost::asio::dispatch(poll_.strand(), [this]() { do_stop(); });
+}
+
+void service_discovery::do_start() {
+   int error;
+   /* Allocate a new client */
+   client_ = avahi_client_new(poll_.get(), static_cast<AvahiClientFlags>(0), client_callback, this, &error);
+   /* Check wether creating the client object succeeded */
+   if (!client_) {
+      LOG_ERROR << "Failed to create client: " << avahi_strerror(error);
+      return;
+   }
+   /* Create the service browser */
+   browser_ = avahi_service_browser_new(client_, AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC, type_.c_str(), NULL,
+                                        static_cast<AvahiLookupFlags>(0), browse_callback, this);
+   if (!browser_) {
+      LOG_ERROR << "Failed to create service browser: " << avahi_strerror(avahi_client_errno(client_));
+   }
+}
+
+void service_discovery::do_stop() {
+   /* Cleanup things */
+   for (auto& r : resolvers_) {
+      avahi_service_resolver_free(r.second);
+   }
+   resolvers_.clear();
+   if (browser_) {
+      avahi_service_browser_free(browser_);
+      browser_ = nullptr;
+   }
+   if (client_) {
+      avahi_client_free(client_);
+      client_ = nullptr;
+   }
+}
+
+void service_discovery::emit(service_event::kind_type kind, const std::string& name, const service& s) {
+   if (!handler_) return;
+   service_event ev;
+   ev.kind = kind;
+   ev.name = name;
+   ev.host_name = s.host_name;
+   ev.address = s.address;
+   ev.port = s.port;
+   handler_(ev);
+}
+
+void service_discovery::client_callback(AvahiClient* c, AvahiClientState state, AVAHI_GCC_UNUSED void* userdata) {
+   /* Called whenever the client or server state changes */
+   if (state == AVAHI_CLIENT_FAILURE) {
+      LOG_ERROR << "Server connection failure: " << avahi_strerror(avahi_client_errno(c));
+   }
+}
+
+void service_discovery::browse_callback(
+   AvahiServiceBrowser* b,
+   AvahiIfIndex interface,
+   AvahiProtocol protocol,
+   AvahiBrowserEvent event,
+   const char* name,
+   const char* type,
+   const char* domain,
+   AVAHI_GCC_UNUSED AvahiLookupResultFlags flags,
+   void* userdata) {
+   auto self = static_cast<service_discovery*>(userdata);
+   /* Called whenever a new services becomes available on the LAN or is removed from the LAN */
+   switch (event) {
+      case AVAHI_BROWSER_FAILURE:
+         LOG_ERROR << "(Browser) " << avahi_strerror(avahi_client_errno(avahi_service_browser_get_client(b)));
+         return;
+      case AVAHI_BROWSER_NEW: {
+         LOG_INFO << "(Browser) NEW: service '" << name << "' of type '" << type << "' in domain '" << domain << "'";
+         instance_key key{interface, protocol, name};
+         if (self->resolvers_.count(key)) break;
+         /* Keep the resolver, it is refired if the service changes; freed on REMOVE.
+            Resolve to IPv4 so instances seen over IPv6 report the same address */
+         AvahiServiceResolver* r = avahi_service_resolver_new(self->client_, interface, protocol, name, type, domain,
+                                                              AVAHI_PROTO_INET, static_cast<AvahiLookupFlags>(0),
+                                                              resolve_callback, self);
+         if (!r) {
+            LOG_ERROR << "Failed to resolve service '" << name << "': " << avahi_strerror(avahi_client_errno(self->client_));
+            break;
+         }
+         self->resolvers_[key] = r;
+         self->services_[name].instances++;
+         break;
+      }
+      case AVAHI_BROWSER_REMOVE: {
+         LOG_INFO << "(Browser) REMOVE: service '" << name << "' of type '" << type << "' in domain '" << domain << "'";
+         instance_key key{interface, protocol, name};
+         auto r = self->resolvers_.find(key);
+         if (r == self->resolvers_.end()) break;
+         avahi_service_resolver_free(r->second);
+         self->resolvers_.erase(r);
+
+         auto s = self->services_.find(name);
+         if (s != self->services_.end() && --s->second.instances <= 0) {
+            service gone = s->second;
+            self->services_.erase(s);
+            if (gone.resolved) self->emit(service_event::removed, name, gone);
+         }
+         break;
+      }
+      case AVAHI_BROWSER_ALL_FOR_NOW:
+      case AVAHI_BROWSER_CACHE_EXHAUSTED:
+         LOG_DEBUG << "(Browser) " << (event == AVAHI_BROWSER_CACHE_EXHAUSTED ? "CACHE_EXHAUSTED" : "ALL_FOR_NOW");
+         break;
+   }
+}
+
+void service_discovery::resolve_callback(
+   AvahiServiceResolver* r,
+   AVAHI_GCC_UNUSED AvahiIfIndex interface,
+   AVAHI_GCC_UNUSED AvahiProtocol protocol,
+   AvahiResolverEvent event,
+   const char* name,
+   const char* type,
+   const char* domain,
+   const char* host_name,
+   const AvahiAddress* address,
+   uint16_t port,
+   AVAHI_GCC_UNUSED AvahiStringList* txt,
+   AVAHI_GCC_UNUSED AvahiLookupResultFlags flags,
+   void* userdata) {
+   auto self = static_cast<service_discovery*>(userdata);
+   /* Called whenever a service has been resolved successfully or timed out */
+   switch (event) {
+      case AVAHI_RESOLVER_FAILURE:
+         LOG_ERROR << "(Resolver) Failed to resolve service '" << name << "' of type '" << type << "' in domain '" << domain
+                   << "': " << avahi_strerror(avahi_client_errno(avahi_service_resolver_get_client(r)));
+         break;
+      case AVAHI_RESOLVER_FOUND: {
+         char a[AVAHI_ADDRESS_STR_MAX];
+         avahi_address_snprint(a, sizeof(a), address);
+         LOG_INFO << "Service '" << name << "' of type '" << type << "' in domain '" << domain << "': "
+                  << host_name << ":" << port << " (" << a << ")";
+
+         auto it = self->services_.find(name);
+         if (it == self->services_.end()) break;   // removed meanwhile
+         service& s = it->second;
+         const bool changed = s.address != a || s.port != port;
+         const bool first = !s.resolved;
+         s.host_name = host_name;
+         s.address = a;
+         s.port = port;
+         s.resolved = true;
+         if (first) self->emit(service_event::added, name, s);
+         else if (changed) self->emit(service_event::updated, name, s);
+         break;
+      }
+   }
+}
@@ -0,0 +1,94 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef SERVICE_DISCOVERY_HPP
+#define SERVICE_DISCOVERY_HPP
+
+// avahi service discovery browser
+// see https://www.avahi.org/doxygen/html/client-browse-services_8c-example.html
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+#include <avahi-client/client.h>
+#include <avahi-client/lookup.h>
+
+#include "avahi_asio_poll.hpp"
+
+/**
+ * @brief Change of a discovered service
+ */
+struct service_event {
+   enum kind_type { added, updated, removed };
+
+   kind_type kind;
+   std::string name;          // service instance name, stable key of the service
+   std::string host_name;
+   std::string address;       // empty for removed
+   uint16_t port = 0;
+};
+
+/**
+ * @brief Service_Discovery Class browses for mDNS services on the bridge's io_context.
+ *
+ * A service is added when it first resolves, updated when its address or
+ * port changes and removed when the last browser instance of it is gone.
+ * Events are delivered on the discovery strand.
+ */
+class service_discovery
+{
+public:
+   using event_handler = std::function<void(const service_event&)>;
+
+   service_discovery(boost::asio::io_context& ioc, std::string type = "_realiti_v1._tcp");
+   ~service_discovery();
+
+   // start browsing, events go to handler
+   void start(event_handler handler);
+   void stop();
+
+private:
+   struct instance_key {
+      AvahiIfIndex interface;
+      AvahiProtocol protocol;
+      std::string name;
+      bool operator<(const instance_key& o) const {
+         if (interface != o.interface) return interface < o.interface;
+         if (protocol != o.protocol) return protocol < o.protocol;
+         return name < o.name;
+      }
+   };
+
+   struct service {
+      std::string host_name;
+      std::string address;
+      uint16_t port = 0;
+      bool resolved = false;
+      int instances = 0;       // browser entries (interface/protocol) for this name
+   };
+
+   static void client_callback(AvahiClient* c, AvahiClientState state, void* userdata);
+   static void browse_callback(AvahiServiceBrowser* b, AvahiIfIndex interface, AvahiProtocol protocol,
+                               AvahiBrowserEvent event, const char* name, const char* type, const char* domain,
+                               AvahiLookupResultFlags flags, void* userdata);
+   static void resolve_callback(AvahiServiceResolver* r, AvahiIfIndex interface, AvahiProtocol protocol,
+                                AvahiResolverEvent event, const char* name, const char* type, const char* domain,
+                                const char* host_name, const AvahiAddress* address, uint16_t port,
+                                AvahiStringList* txt, AvahiLookupResultFlags flags, void* userdata);
+
+   void do_start();
+   void do_stop();
+   void emit(service_event::kind_type kind, const std::string& name, const service& s);
+
+   avahi_asio_poll poll_;
+   std::string type_;
+   event_handler handler_;
+   AvahiClient* client_ = nullptr;
+   AvahiServiceBrowser* browser_ = nullptr;
+   std::map<instance_key, AvahiServiceResolver*> resolvers_;
+   std::map<std::string, service> services_;
+};
+
+#endif
@@ -0,0 +1,155 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "amm/BaseLogger.h"
+#include "session_manager.hpp"
+
+#include <algorithm>
+
+session_manager::session_manager(net::io_context& ioc)
+   : ioc_(ioc)
+   , list_(std::make_shared<const session_list>())
+{
+}
+
+void session_manager::set_handlers(session_handler on_handshake, message_handler on_message, session_handler on_closed) {
+   on_handshake_ = std::move(on_handshake);
+   on_message_ = std::move(on_message);
+   on_closed_ = std::move(on_closed);
+}
+
+void session_manager::set_monitor_types(std::vector<int> types) {
+   if (!types.empty()) monitor_types_ = std::move(types);
+}
+
+void session_manager::set_queue_limits(std::size_t high_water, std::size_t capacity) {
+   high_water_ = high_water;
+   capacity_ = capacity;
+}
+
+std::shared_ptr<const session_manager::session_list> session_manager::sessions() const {
+   return std::atomic_load(&list_);
+}
+
+void session_manager::publish(std::shared_ptr<const session_list> list) {
+   std::atomic_store(&list_, std::move(list));
+}
+
+std::shared_ptr<monitor_session> session_manager::open(const std::string& key, const std::string& host, const std::string& port) {
+   std::lock_guard<std::mutex> lock(mutex_);
+
+   auto current = sessions();
+   auto next = std::make_shared<session_list>();
+   next->reserve(current->size() + 1);
+   for (const auto& s : *current) {
+      if (s->key != key) {
+         next->push_back(s);
+      } else if (s->host == host && s->port == port) {
+         return s;
+      } else {
+         // service moved: drop the old session from the list and close it
+         LOG_INFO << "Monitor session " << s->id << " (" << key << ") moved to " << host << ":" << port;
+         s->ws->do_close();
+      }
+   }
+
+   auto session = std::make_shared<monitor_session>();
+   session->id = ++opened_;
+   session->key = key;
+   session->host = host;
+   session->port = port;
+   auto assigned = assigned_types_.find(key);
+   if (assigned == assigned_types_.end()) {
+      const std::size_t index = std::min(assigned_types_.size(), monitor_types_.size() - 1);
+      assigned = assigned_types_.emplace(key, monitor_types_[index]).first;
+   }
+   session->monitor_type = assigned->second;
+   session->ws = std::make_shared<websocket_session>(ioc_);
+   session->ws->set_verbose(verbose_);
+   session->ws->set_queue_limits(high_water_, capacity_);
+   session->ws->set_compression(compression_);
+   session->ws->set_metrics(metrics_);
+   session->ws->set_flight_recorder(flight_, static_cast<uint16_t>(session->id));
+
+   // callbacks are stored in the websocket_session, which the monitor_session owns
+   std::weak_ptr<monitor_session> weak = session;
+   session->ws->registerHandshakeCallback([this, weak](std::string) {
+      auto s = weak.lock();
+      if (!s) return;
+      s->connected = true;
+      if (on_handshake_) on_handshake_(*s);
+   });
+   session->ws->registerReadCallback([this, weak](char* data, std::size_t size) {
+      auto s = weak.lock();
+      if (s && on_message_) on_message_(*s, data, size);
+   });
+   if (on_written_) {
+      session->ws->registerWriteCallback([this, weak](message_class cls, std::size_t bytes) {
+         auto s = weak.lock();
+         if (s) on_written_(*s, cls, bytes);
+      });
+   }
+   session->ws->registerCloseCallback([this, weak]() {
+      auto s = weak.lock();
+      if (!s) return;
+      s->connected = false;
+      s->initialized = false;
+      remove(s);
+      if (on_closed_) on_closed_(*s);
+   });
+
+   next->push_back(session);
+   publish(std::move(next));
+
+   LOG_INFO << "Monitor session " << session->id << " (" << key << ") monitor model ID = " << session->monitor_type;
+   session->ws->run(host, port, "/");
+   return session;
+}
+
+void session_manager::remove(const std::shared_ptr<monitor_session>& session) {
+   std::lock_guard<std::mutex> lock(mutex_);
+   // no-op for sessions already replaced in open()
+   auto next = std::make_shared<session_list>(*sessions());
+   next->erase(std::remove(next->begin(), next->end(), session), next->end());
+   publish(std::move(next));
+}
+
+void session_manager::close(const std::string& key) {
+   auto current = sessions();
+   for (const auto& s : *current) {
+      if (s->key == key) s->ws->do_close();
+   }
+}
+
+void session_manager::close_all() {
+   auto current = sessions();
+   for (const auto& s : *current) {
+      s->ws->do_close();
+   }
+}
+
+bool session_manager::broadcast(const shared_message& message, message_class cls, bool initialized_only,
+                                websocket_session::clock::time_point origin) {
+   bool accepted = true;
+   auto current = sessions();
+   for (const auto& s : *current) {
+      if (!s->connected) continue;
+      if (initialized_only && !s->initialized) continue;
+      if (!s->ws->do_write(message, cls, origin)) accepted = false;
+   }
+   return accepted;
+}
+
+std::shared_ptr<monitor_session> session_manager::find(const std::string& key) const {
+   auto current = sessions();
+   for (const auto& s : *current) {
+      if (s->key == key) return s;
+   }
+   return nullptr;
+}
+
+bool session_manager::any_connected() const {
+   auto current = sessions();
+   return std::any_of(current->begin(), current->end(),
+      [](const std::shared_ptr<monitor_session>& s) { return s->connected.load(); });
+}
@@ -0,0 +1,106 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef SESSION_MANAGER_HPP
+#define SESSION_MANAGER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "websocket_session.hpp"
+
+/**
+ * @brief State of one connected iSimulate monitor
+ */
+struct monitor_session : std::enable_shared_from_this<monitor_session> {
+   std::size_t id = 0;
+   std::string key;                       // discovery key, mDNS service name
+   std::string host;
+   std::string port;
+   int monitor_type = 3;                  // iSimulate monitor model ID
+   std::atomic<bool> connected{false};    // websocket handshake done
+   std::atomic<bool> initialized{false};  // monitor answered the scenario handshake, set by the bridge strand
+   std::shared_ptr<websocket_session> ws;
+};
+
+/**
+ * @brief Session_Manager Class keeps one websocket_session per discovered monitor.
+ *
+ * All sessions share one io_context. Structural changes (open/close) take a
+ * mutex; broadcast() only reads an immutable snapshot of the session list,
+ * so a packet rendered once is fanned out without locking or copying.
+ */
+class session_manager
+{
+public:
+   using session_handler = std::function<void(monitor_session&)>;
+   using message_handler = std::function<void(monitor_session&, char*, std::size_t)>;
+   using write_handler = std::function<void(monitor_session&, message_class, std::size_t)>;
+   using session_list = std::vector<std::shared_ptr<monitor_session>>;
+
+   explicit session_manager(net::io_context& ioc);
+
+   void set_handlers(session_handler on_handshake, message_handler on_message, session_handler on_closed);
+   // optional, called on the session strand after each completed write
+   void set_write_handler(write_handler on_written) { on_written_ = std::move(on_written); }
+   // monitor model IDs, assigned to monitors (discovery keys) in the order they
+   // are first opened; the last one is reused once the list runs out. A monitor
+   // that reconnects keeps its model ID
+   void set_monitor_types(std::vector<int> types);
+   void set_verbose(bool flag) { verbose_ = flag; }
+   void set_queue_limits(std::size_t high_water, std::size_t capacity);
+   // permessage-deflate offer of every session opened from now on
+   void set_compression(const compression_options& options) { compression_ = options; }
+   // latency and write metrics of every session opened from now on
+   void set_metrics(bridge_metrics* metrics) { metrics_ = metrics; }
+   // frame trace of every session opened from now on
+   void set_flight_recorder(flight_recorder* recorder) { flight_ = recorder; }
+
+   // connect to a monitor unless a session for key is already open at host:port;
+   // an open session for key at another endpoint is closed and replaced
+   std::shared_ptr<monitor_session> open(const std::string& key, const std::string& host, const std::string& port);
+   // close the session for key, if any
+   void close(const std::string& key);
+   void close_all();
+
+   // write a message to every connected (or only every initialized) monitor,
+   // returns false if any of them reported backpressure
+   bool broadcast(const shared_message& message, message_class cls, bool initialized_only = false,
+                  websocket_session::clock::time_point origin = websocket_session::clock::time_point());
+
+   std::shared_ptr<const session_list> sessions() const;
+   // the open session for key, null if there is none
+   std::shared_ptr<monitor_session> find(const std::string& key) const;
+   std::size_t size() const { return sessions()->size(); }
+   bool any_connected() const;
+
+private:
+   void remove(const std::shared_ptr<monitor_session>& session);
+   void publish(std::shared_ptr<const session_list> list);
+
+   net::io_context& ioc_;
+   session_handler on_handshake_;
+   message_handler on_message_;
+   session_handler on_closed_;
+   write_handler on_written_;
+   std::vector<int> monitor_types_{3};
+   std::map<std::string, int> assigned_types_;   // discovery key -> model ID, under mutex_
+   std::size_t opened_ = 0;
+   std::size_t high_water_ = 8;
+   std::size_t capacity_ = 64;
+   bool verbose_ = false;
+   compression_options compression_;
+   bridge_metrics* metrics_ = nullptr;
+   flight_recorder* flight_ = nullptr;
+
+   mutable std::mutex mutex_;                   // serializes open/close
+   std::shared_ptr<const session_list> list_;   // replaced, never modified in place
+};
+
+#endif
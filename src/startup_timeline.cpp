@@ -0,0 +1,53 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "startup_timeline.hpp"
+
+#include <cstdio>
+
+namespace {
+
+const char* const phase_names[startup_phase_count] = {
+   "configured", "discovery_started", "dds_participant", "dds_subscribers", "dds_publishers",
+   "module_published", "monitor_connected", "monitor_initialized", "first_vitals"
+};
+
+}
+
+const char* to_string(startup_phase phase) {
+   const std::size_t i = static_cast<std::size_t>(phase);
+   return i < startup_phase_count ? phase_names[i] : "?";
+}
+
+startup_timeline::startup_timeline()
+   : start_(clock::now())
+{
+}
+
+bool startup_timeline::mark(startup_phase phase) {
+   const int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start_).count() + 1;
+   int64_t expected = 0;
+   return marks_[static_cast<std::size_t>(phase)].compare_exchange_strong(expected, us, std::memory_order_relaxed);
+}
+
+bool startup_timeline::reached(startup_phase phase) const {
+   return marks_[static_cast<std::size_t>(phase)].load(std::memory_order_relaxed) != 0;
+}
+
+std::chrono::microseconds startup_timeline::elapsed(startup_phase phase) const {
+   const int64_t us = marks_[static_cast<std::size_t>(phase)].load(std::memory_order_relaxed);
+   return std::chrono::microseconds(us > 0 ? us - 1 : 0);
+}
+
+std::string startup_timeline::summary() const {
+   std::string out;
+   for (std::size_t i = 0; i < startup_phase_count; ++i) {
+      const auto phase = static_cast<startup_phase>(i);
+      if (!reached(phase)) continue;
+      char item[64];
+      std::snprintf(item, sizeof(item), "%s%s +%.1f ms", out.empty() ? "" : ", ", phase_names[i],
+                    elapsed(phase).count() / 1e3);
+      out += item;
+   }
+   return out;
+}
@@ -0,0 +1,63 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef STARTUP_TIMELINE_HPP
+#define STARTUP_TIMELINE_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Milestones between process start and the first vitals on a monitor
+ */
+enum class startup_phase : std::size_t {
+   configured = 0,         // arguments parsed, logging and rules ready
+   discovery_started,      // mDNS browser and cached endpoints running
+   dds_participant,        // DDSManager created
+   dds_subscribers,        // AMM subscriptions (or the replay) in place
+   dds_publishers,
+   module_published,       // OperationalDescription and ModuleConfiguration written
+   monitor_connected,      // first websocket handshake
+   monitor_initialized,    // first monitor answered the scenario handshake
+   first_vitals,           // first ChangeActionPacket written to an initialized monitor
+   count
+};
+
+constexpr std::size_t startup_phase_count = static_cast<std::size_t>(startup_phase::count);
+
+const char* to_string(startup_phase phase);
+
+/**
+ * @brief Startup_Timeline Class records when each startup phase is first reached.
+ *
+ * The clock starts when the timeline is constructed (static initialization
+ * of the bridge). mark() is lock-free and may be called from any thread;
+ * only the first mark of a phase counts.
+ */
+class startup_timeline
+{
+public:
+   using clock = std::chrono::steady_clock;
+
+   startup_timeline();
+
+   // true the first time the phase is reached
+   bool mark(startup_phase phase);
+   bool reached(startup_phase phase) const;
+   // time from start to the phase, zero if not reached
+   std::chrono::microseconds elapsed(startup_phase phase) const;
+
+   // "phase +12.3 ms, ..." for the phases reached so far
+   std::string summary() const;
+
+private:
+   const clock::time_point start_;
+   // microseconds since start_ plus one, 0 while not reached
+   std::array<std::atomic<int64_t>, startup_phase_count> marks_{};
+};
+
+#endif
@@ -0,0 +1,87 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "vitals_store.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// AMM node names, in slot order
+const char* const vital_names[vital_count] = {
+   "Cardiovascular_HeartRate",
+   "Cardiovascular_Arterial_Systolic_Pressure",
+   "Cardiovascular_Arterial_Diastolic_Pressure",
+   "BloodChemistry_Oxygen_Saturation",
+   "Respiration_EndTidalCarbonDioxide",
+   "Respiratory_Respiration_Rate",
+   "Energy_Core_Temperature",
+   "SIM_TIME",
+};
+
+// slots by name length, built once on first use. The engine publishes
+// hundreds of names and the monitor uses a few, so most samples are
+// rejected by their length alone, without hashing or comparing the name.
+constexpr std::size_t max_name_length = 63;
+static_assert(vital_count <= 16, "slot mask is 16 bits");
+
+const std::array<uint16_t, max_name_length + 1>& vital_lengths() {
+   static const std::array<uint16_t, max_name_length + 1> lengths = [] {
+      std::array<uint16_t, max_name_length + 1> l{};
+      for (std::size_t i = 0; i < vital_count; ++i) {
+         const std::size_t n = std::strlen(vital_names[i]);
+         if (n <= max_name_length) l[n] |= static_cast<uint16_t>(1u << i);
+      }
+      return l;
+   }();
+   return lengths;
+}
+
+}
+
+bool vitals_store::resolve(const std::string& name, vital& v) {
+   return resolve(name.data(), name.size(), v);
+}
+
+bool vitals_store::resolve(const char* name, std::size_t length, vital& v) {
+   if (length > max_name_length) return false;
+   for (uint16_t mask = vital_lengths()[length]; mask != 0; mask &= static_cast<uint16_t>(mask - 1)) {
+      std::size_t i = 0;
+      while (!(mask & (1u << i))) ++i;
+      if (std::memcmp(name, vital_names[i], length) == 0) {
+         v = static_cast<vital>(i);
+         return true;
+      }
+   }
+   return false;
+}
+
+const char* vitals_store::name(vital v) {
+   return vital_names[static_cast<std::size_t>(v)];
+}
+
+bool vitals_store::accept(const std::string& name, double value, vital& v) {
+   return resolve(name, v) && !std::isnan(value);
+}
+
+bool vitals_store::update(vital v, double value) {
+   return slots_[static_cast<std::size_t>(v)].value.exchange(value, std::memory_order_acq_rel) != value;
+}
+
+bool vitals_store::update(const std::string& name, double value) {
+   vital v;
+   if (!resolve(name, v)) return false;
+   update(v, value);
+   return true;
+}
+
+double vitals_store::get(vital v) const {
+   return slots_[static_cast<std::size_t>(v)].value.load(std::memory_order_acquire);
+}
+
+void vitals_store::reset() {
+   for (auto& s : slots_) {
+      s.value.store(0.0, std::memory_order_release);
+   }
+}
@@ -0,0 +1,66 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef VITALS_STORE_HPP
+#define VITALS_STORE_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Physiology values forwarded to the iSimulate monitor.
+ * One fixed slot per field used in the outbound packets.
+ */
+enum class vital : std::size_t {
+   heart_rate = 0,
+   bp_systolic,
+   bp_diastolic,
+   spo2,
+   etco2,
+   resp_rate,
+   temperature,
+   sim_time,
+   count
+};
+
+constexpr std::size_t vital_count = static_cast<std::size_t>(vital::count);
+
+/**
+ * @brief Vitals_Store Class holds the latest raw AMM value for every vital slot.
+ *
+ * Writers (DDS listener threads) and readers (packet builders) never take a
+ * lock and never allocate; every slot is an atomic. Values are stored
+ * as doubles and only formatted when a packet is built.
+ */
+class vitals_store
+{
+   struct slot {
+      std::atomic<double> value{0.0};
+   };
+
+   std::array<slot, vital_count> slots_;
+
+public:
+   vitals_store() = default;
+   vitals_store(const vitals_store&) = delete;
+   vitals_store& operator=(const vitals_store&) = delete;
+
+   // map an AMM node name to its slot, false if the monitor does not use it
+   static bool resolve(const std::string& name, vital& v);
+   static bool resolve(const char* name, std::size_t length, vital& v);
+   static const char* name(vital v);
+   // what OnPhysiologyValue keeps: a name the monitor uses and a value that is not NaN
+   static bool accept(const std::string& name, double value, vital& v);
+
+   // store a new value, returns true if it differs from the stored one
+   bool update(vital v, double value);
+   // resolve and store, returns false if the name is not used by the monitor
+   bool update(const std::string& name, double value);
+
+   double get(vital v) const;
+   void reset();
+};
+
+#endif
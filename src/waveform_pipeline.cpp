@@ -0,0 +1,220 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "waveform_pipeline.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+namespace {
+
+// AMM waveform names, in channel order
+const char* const waveform_amm_names[waveform_channel_count] = {
+   "ECG",
+   "Cardiovascular_Pleth",
+   "Cardiovascular_Arterial_Pressure",
+   "Respiratory_CarbonDioxide_Exhaled",
+};
+
+// names used in WaveformPacket
+const char* const waveform_packet_names[waveform_channel_count] = {
+   "ecg",
+   "pleth",
+   "abp",
+   "co2",
+};
+
+const std::unordered_map<std::string, waveform_channel>& waveform_lookup() {
+   static const std::unordered_map<std::string, waveform_channel> lookup = [] {
+      std::unordered_map<std::string, waveform_channel> m;
+      m.reserve(waveform_channel_count * 2);
+      for (std::size_t i = 0; i < waveform_channel_count; ++i) {
+         m.emplace(waveform_amm_names[i], static_cast<waveform_channel>(i));
+      }
+      return m;
+   }();
+   return lookup;
+}
+
+int64_t to_us(waveform_pipeline::clock::time_point t) {
+   return duration_cast<microseconds>(t.time_since_epoch()).count();
+}
+
+void append_text(packet_buffer& out, const char* text) {
+   out.append(text, std::strlen(text));
+}
+
+void append_number(packet_buffer& out, double v, int precision) {
+   char digits[max_number_length];
+   char* end = format_number(digits, v, precision);
+   out.append(digits, end - digits);
+}
+
+}
+
+waveform_config::waveform_config() {
+   // iSimulate draws ECG at 250 Hz, the other curves at lower rates
+   channel[static_cast<std::size_t>(waveform_channel::ecg)] = {250, 3};
+   channel[static_cast<std::size_t>(waveform_channel::pleth)] = {125, 2};
+   channel[static_cast<std::size_t>(waveform_channel::abp)] = {125, 1};
+   channel[static_cast<std::size_t>(waveform_channel::co2)] = {25, 1};
+}
+
+waveform_pipeline::waveform_pipeline(std::size_t ring_capacity, waveform_config config)
+   : config_(config)
+   , epoch_us_(to_us(clock::now()))
+{
+   for (auto& ch : channels_) {
+      ch.reset(new channel_state(ring_capacity));
+      // decimated output never exceeds the input, held periods are bounded by max_age
+      ch->out_capacity = 2 * ch->ring.capacity();
+      ch->out.reset(new float[ch->out_capacity]);
+      ch->raw.reset(new float[ch->ring.capacity()]);
+      ch->raw_time.reset(new int64_t[ch->ring.capacity()]);
+   }
+}
+
+bool waveform_pipeline::resolve(const std::string& name, waveform_channel& channel) {
+   const auto& lookup = waveform_lookup();
+   auto it = lookup.find(name);
+   if (it == lookup.end()) return false;
+   channel = it->second;
+   return true;
+}
+
+const char* waveform_pipeline::name(waveform_channel channel) {
+   return waveform_packet_names[static_cast<std::size_t>(channel)];
+}
+
+bool waveform_pipeline::push(waveform_channel channel, double value, clock::time_point time) {
+   received_.fetch_add(1, std::memory_order_relaxed);
+   waveform_sample s{to_us(time), static_cast<float>(value)};
+   if (channels_[static_cast<std::size_t>(channel)]->ring.try_push(std::move(s))) return true;
+   overruns_.fetch_add(1, std::memory_order_relaxed);
+   return false;
+}
+
+void waveform_pipeline::emit(channel_state& ch, int64_t time_us, float value) {
+   if (ch.out_count == ch.out_capacity) return;
+   if (ch.out_count == 0) ch.out_first_us = time_us;
+   ch.out_last_us = time_us;
+   ch.out[ch.out_count++] = value;
+}
+
+void waveform_pipeline::collect(channel_state& ch, const waveform_channel_config& cfg, int64_t oldest_us) {
+   const int64_t max_age_us = duration_cast<microseconds>(config_.max_age).count();
+   const int64_t period_us = cfg.output_rate > 0 ? std::llround(1e6 / cfg.output_rate) : 0;
+   decimator& d = ch.dec;
+
+   // at most one ring's worth per flush, samples pushed meanwhile wait for the next one
+   const std::size_t limit = ch.ring.capacity();
+   ch.raw_count = 0;
+   waveform_sample s;
+   while (ch.raw_count < limit && ch.ring.try_pop(s)) {
+      if (s.time_us < oldest_us) {
+         stale_.fetch_add(1, std::memory_order_relaxed);
+         continue;
+      }
+      ch.raw[ch.raw_count] = s.value;
+      ch.raw_time[ch.raw_count] = s.time_us;
+      ++ch.raw_count;
+      if (period_us <= 0) {
+         emit(ch, s.time_us, s.value);
+         continue;
+      }
+      // (re)start the output grid on the first sample and after a gap
+      if (!d.started || s.time_us - d.bin_end_us > max_age_us) {
+         d.started = true;
+         d.bin_end_us = s.time_us + period_us;
+         d.sum = 0;
+         d.count = 0;
+         d.last = s.value;
+      }
+      while (s.time_us >= d.bin_end_us) {
+         // close the period: mean of its samples, or hold the last value if it had none
+         const float v = d.count ? static_cast<float>(d.sum / d.count) : d.last;
+         emit(ch, d.bin_end_us - period_us, v);
+         d.last = v;
+         d.sum = 0;
+         d.count = 0;
+         d.bin_end_us += period_us;
+      }
+      d.sum += s.value;
+      ++d.count;
+   }
+}
+
+bool waveform_pipeline::flush(packet_buffer& out, clock::time_point now) {
+   if (reset_requested_.exchange(false, std::memory_order_acq_rel)) discard();
+
+   const int64_t now_us = to_us(now);
+   const int64_t oldest_us = now_us - duration_cast<microseconds>(config_.max_age).count();
+
+   std::size_t total = 0;
+   for (std::size_t i = 0; i < waveform_channel_count; ++i) {
+      channel_state& ch = *channels_[i];
+      ch.out_count = 0;
+      collect(ch, config_.channel[i], oldest_us);
+      if (block_handler_ && ch.raw_count) {
+         block_handler_(static_cast<waveform_channel>(i), ch.raw.get(), ch.raw_time.get(), ch.raw_count);
+      }
+      total += ch.out_count;
+   }
+   if (total == 0) return false;
+
+   out.clear();
+   out.reserve(128 + waveform_channel_count * 96 + total * 12);
+   append_text(out, "{\"type\":\"WaveformPacket\",\"time\":");
+   append_number(out, (now_us - epoch_us_) / 1000.0, 1);
+   append_text(out, ",\"channels\":[");
+   bool first = true;
+   for (std::size_t i = 0; i < waveform_channel_count; ++i) {
+      const channel_state& ch = *channels_[i];
+      if (ch.out_count == 0) continue;
+      const waveform_channel_config& cfg = config_.channel[i];
+
+      // undecimated channels report the rate measured over this frame
+      double rate = cfg.output_rate;
+      if (rate <= 0) {
+         const int64_t span_us = ch.out_last_us - ch.out_first_us;
+         rate = span_us > 0 ? (ch.out_count - 1) * 1e6 / span_us : 0;
+      }
+
+      append_text(out, first ? "{\"name\":\"" : ",{\"name\":\"");
+      first = false;
+      append_text(out, waveform_packet_names[i]);
+      append_text(out, "\",\"rate\":");
+      append_number(out, rate, 1);
+      append_text(out, ",\"t0\":");
+      append_number(out, (ch.out_first_us - epoch_us_) / 1000.0, 1);
+      append_text(out, ",\"samples\":[");
+      for (std::size_t k = 0; k < ch.out_count; ++k) {
+         if (k) out.append(",", 1);
+         append_number(out, ch.out[k], cfg.precision);
+      }
+      append_text(out, "]}");
+   }
+   append_text(out, "]}");
+
+   samples_sent_.fetch_add(total, std::memory_order_relaxed);
+   frames_.fetch_add(1, std::memory_order_relaxed);
+   return true;
+}
+
+void waveform_pipeline::reset() {
+   reset_requested_.store(true, std::memory_order_release);
+}
+
+void waveform_pipeline::discard() {
+   waveform_sample s;
+   for (auto& ch : channels_) {
+      while (ch->ring.try_pop(s)) {}
+      ch->dec = decimator();
+      ch->out_count = 0;
+      ch->raw_count = 0;
+   }
+}
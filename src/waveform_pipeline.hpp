@@ -0,0 +1,144 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef WAVEFORM_PIPELINE_HPP
+#define WAVEFORM_PIPELINE_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "mpsc_ring.hpp"
+#include "packet_serializer.hpp"
+
+/**
+ * @brief High frequency channels forwarded to the monitor
+ */
+enum class waveform_channel : std::size_t {
+   ecg = 0,
+   pleth,
+   abp,
+   co2,
+   count
+};
+
+constexpr std::size_t waveform_channel_count = static_cast<std::size_t>(waveform_channel::count);
+
+struct waveform_sample {
+   int64_t time_us;     // steady clock, microseconds
+   float value;
+};
+
+struct waveform_channel_config {
+   double output_rate;  // samples per second sent to the monitor, 0 forwards every sample
+   int precision;       // max decimal places
+};
+
+/**
+ * @brief Tuning of the waveform pipeline
+ */
+struct waveform_config {
+   std::array<waveform_channel_config, waveform_channel_count> channel;
+   // one WaveformPacket per frame
+   std::chrono::milliseconds frame_period{40};
+   // samples older than this at flush time are dropped, bounds the latency
+   std::chrono::milliseconds max_age{500};
+
+   waveform_config();
+};
+
+/**
+ * @brief Waveform_Pipeline Class batches AMM waveform samples into WaveformPackets.
+ *
+ * Every channel has a preallocated ring filled by push() from the DDS
+ * listener (or replay) threads. flush() drains all rings once per frame, decimates each
+ * channel to its output rate by averaging the samples of each output period
+ * and renders one packet. Memory is fixed at construction: a full ring drops
+ * new samples and counts them as overruns.
+ *
+ * push() and reset() may be called from any thread; flush() from one thread
+ * at a time (the frame timer on the bridge strand).
+ */
+class waveform_pipeline
+{
+public:
+   using clock = std::chrono::steady_clock;
+   // raw samples of one channel drained by a flush, before decimation
+   using block_handler = std::function<void(waveform_channel, const float*, const int64_t*, std::size_t)>;
+
+   // ring_capacity samples per channel, rounded up to a power of two
+   explicit waveform_pipeline(std::size_t ring_capacity = 2048, waveform_config config = waveform_config());
+
+   // AMM waveform name -> channel
+   static bool resolve(const std::string& name, waveform_channel& channel);
+   static const char* name(waveform_channel channel);
+
+   // not thread safe, set before samples arrive
+   void set_config(const waveform_config& config) { config_ = config; }
+   const waveform_config& config() const { return config_; }
+   // called from flush() for every channel that received samples
+   void set_block_handler(block_handler handler) { block_handler_ = std::move(handler); }
+
+   bool push(waveform_channel channel, double value, clock::time_point time);
+
+   // render the samples that arrived since the last flush; false if there are none
+   bool flush(packet_buffer& out, clock::time_point now);
+
+   // next flush() discards pending samples and decimator state first
+   void reset();
+
+   uint64_t received() const { return received_.load(std::memory_order_relaxed); }
+   uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+   uint64_t stale() const { return stale_.load(std::memory_order_relaxed); }
+   uint64_t samples_sent() const { return samples_sent_.load(std::memory_order_relaxed); }
+   uint64_t frames() const { return frames_.load(std::memory_order_relaxed); }
+
+private:
+   struct decimator {
+      bool started = false;
+      int64_t bin_end_us = 0;      // end of the output period being averaged
+      double sum = 0;
+      int count = 0;
+      float last = 0;              // held for output periods without input
+   };
+
+   struct channel_state {
+      explicit channel_state(std::size_t capacity) : ring(capacity) {}
+
+      mpsc_ring<waveform_sample> ring;
+      decimator dec;
+      // raw samples of the current flush, contiguous for the block handler
+      std::unique_ptr<float[]> raw;
+      std::unique_ptr<int64_t[]> raw_time;
+      std::size_t raw_count = 0;
+      // output of the current flush
+      std::unique_ptr<float[]> out;
+      std::size_t out_capacity = 0;
+      std::size_t out_count = 0;
+      int64_t out_first_us = 0;
+      int64_t out_last_us = 0;
+   };
+
+   void emit(channel_state& ch, int64_t time_us, float value);
+   void collect(channel_state& ch, const waveform_channel_config& cfg, int64_t oldest_us);
+   void discard();
+
+   waveform_config config_;
+   block_handler block_handler_;
+   std::array<std::unique_ptr<channel_state>, waveform_channel_count> channels_;
+   int64_t epoch_us_;   // packet timestamps are relative to construction
+   std::atomic<bool> reset_requested_{false};
+
+   std::atomic<uint64_t> received_{0};
+   std::atomic<uint64_t> overruns_{0};
+   std::atomic<uint64_t> stale_{0};
+   std::atomic<uint64_t> samples_sent_{0};
+   std::atomic<uint64_t> frames_{0};
+};
+
+#endif
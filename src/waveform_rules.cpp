@@ -0,0 +1,212 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#include "amm/BaseLogger.h"
+#include "waveform_rules.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "tinyxml2.h"
+
+namespace {
+
+const char* const field_names[rule_field_count] = {
+   "ecgWaveform",
+   "bpWaveform",
+   "spo2Waveform",
+   "etco2Waveform",
+   "ectopicsPac",
+   "ectopicsPjc",
+   "ectopicsPvc",
+   "electricalInterference",
+   "articInterference",
+   "svvInterference",
+   "sinusArrhythmiaInterference",
+};
+
+char lower(char c) {
+   return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+bool equal_nocase(const std::string& a, const char* b, std::size_t length) {
+   if (a.size() != length) return false;
+   for (std::size_t i = 0; i < length; ++i) {
+      if (lower(a[i]) != lower(b[i])) return false;
+   }
+   return true;
+}
+
+rule_action action(packet_field field, int value, const char* label) {
+   rule_action a;
+   a.field = field;
+   a.value = value;
+   a.label = label;
+   return a;
+}
+
+}
+
+const rule_band* waveform_rule::match(double severity) const {
+   for (const auto& band : bands) {
+      if (severity > band.above) return &band;
+   }
+   return nullptr;
+}
+
+const char* waveform_rules::field_name(packet_field field) {
+   const std::size_t i = static_cast<std::size_t>(field) - rule_field_first;
+   return i < rule_field_count ? field_names[i] : nullptr;
+}
+
+bool waveform_rules::resolve_field(const char* name, packet_field& field) {
+   for (std::size_t i = 0; i < rule_field_count; ++i) {
+      if (std::strcmp(field_names[i], name) == 0) {
+         field = static_cast<packet_field>(rule_field_first + i);
+         return true;
+      }
+   }
+   return false;
+}
+
+// the rules the bridge always had, used when there is no rule file
+waveform_rules::waveform_rules() {
+   defaults_.fill(0);
+   defaults_[static_cast<std::size_t>(packet_field::ecg_waveform) - rule_field_first] = 9;   // 9 -> Sinus
+   defaults_[static_cast<std::size_t>(packet_field::sinus_arrhythmia_interference) - rule_field_first] = 1;
+
+   const double otherwise = -std::numeric_limits<double>::infinity();
+
+   waveform_rule tachycardia;
+   tachycardia.source = rule_source::render_modification;
+   tachycardia.event = "PATIENT_STATE_TACHYCARDIA";
+   tachycardia.bands.push_back({otherwise, {action(packet_field::ecg_waveform, 14, "Ventricular Tachycardia")}});
+   add(std::move(tachycardia));
+
+   waveform_rule obstruction;
+   obstruction.source = rule_source::physiology_modification;
+   obstruction.event = "AirwayObstruction";
+   obstruction.bands.push_back({0.6, {action(packet_field::etco2_waveform, 2, "Obstructive 2")}});
+   obstruction.bands.push_back({0.2, {action(packet_field::etco2_waveform, 1, "Obstructive 1")}});
+   obstruction.bands.push_back({otherwise, {action(packet_field::etco2_waveform, 0, "Normal")}});
+   add(std::move(obstruction));
+
+   compile();
+}
+
+// FNV-1a over the source and the lowercased name
+uint64_t waveform_rules::hash(rule_source source, const char* event, std::size_t length) {
+   uint64_t h = 14695981039346656037ull;
+   h = (h ^ static_cast<uint8_t>(source)) * 1099511628211ull;
+   for (std::size_t i = 0; i < length; ++i) {
+      h = (h ^ static_cast<uint8_t>(lower(event[i]))) * 1099511628211ull;
+   }
+   return h;
+}
+
+void waveform_rules::add(waveform_rule rule) {
+   std::stable_sort(rule.bands.begin(), rule.bands.end(),
+                    [](const rule_band& a, const rule_band& b) { return a.above > b.above; });
+   // a later rule for the same event replaces the earlier one
+   for (auto& r : rules_) {
+      if (r.source == rule.source && equal_nocase(r.event, rule.event.data(), rule.event.size())) {
+         r = std::move(rule);
+         return;
+      }
+   }
+   rules_.push_back(std::move(rule));
+}
+
+void waveform_rules::compile() {
+   std::size_t size = 8;
+   while (size < rules_.size() * 2) size <<= 1;
+   table_.assign(size, 0);
+   hashes_.assign(size, 0);
+   mask_ = size - 1;
+   for (std::size_t i = 0; i < rules_.size(); ++i) {
+      const uint64_t h = hash(rules_[i].source, rules_[i].event.data(), rules_[i].event.size());
+      std::size_t slot = h & mask_;
+      while (table_[slot]) slot = (slot + 1) & mask_;
+      table_[slot] = static_cast<uint32_t>(i + 1);
+      hashes_[slot] = h;
+   }
+}
+
+const waveform_rule* waveform_rules::find(rule_source source, const char* event, std::size_t length) const {
+   const uint64_t h = hash(source, event, length);
+   for (std::size_t slot = h & mask_; table_[slot]; slot = (slot + 1) & mask_) {
+      if (hashes_[slot] != h) continue;
+      const waveform_rule& rule = rules_[table_[slot] - 1];
+      if (rule.source == source && equal_nocase(rule.event, event, length)) return &rule;
+   }
+   return nullptr;
+}
+
+bool waveform_rules::load(const std::string& file) {
+   tinyxml2::XMLDocument doc;
+   if (doc.LoadFile(file.c_str()) != tinyxml2::XML_SUCCESS) {
+      LOG_ERROR << "Waveform rules " << file << ": " << doc.ErrorStr();
+      return false;
+   }
+   tinyxml2::XMLElement* root = doc.FirstChildElement("WaveformRules");
+   if (!root) {
+      LOG_ERROR << "Waveform rules " << file << ": no <WaveformRules> element";
+      return false;
+   }
+
+   std::array<int, rule_field_count> defaults = defaults_;
+   if (tinyxml2::XMLElement* d = root->FirstChildElement("Defaults")) {
+      for (std::size_t i = 0; i < rule_field_count; ++i) {
+         d->QueryIntAttribute(field_names[i], &defaults[i]);
+      }
+   }
+
+   std::vector<waveform_rule> rules;
+   for (tinyxml2::XMLElement* e = root->FirstChildElement(); e; e = e->NextSiblingElement()) {
+      waveform_rule rule;
+      const char* tag = e->Name();
+      if (std::strcmp(tag, "RenderModification") == 0) rule.source = rule_source::render_modification;
+      else if (std::strcmp(tag, "PhysiologyModification") == 0) rule.source = rule_source::physiology_modification;
+      else continue;
+      const char* type = e->Attribute("type");
+      if (!type || !*type) {
+         LOG_ERROR << "Waveform rules " << file << ": <" << tag << "> without type";
+         return false;
+      }
+      rule.event = type;
+
+      // <Set> directly in the rule applies when no <Severity> band matches
+      auto read_band = [&](tinyxml2::XMLElement* parent, rule_band& band) {
+         for (tinyxml2::XMLElement* s = parent->FirstChildElement("Set"); s; s = s->NextSiblingElement("Set")) {
+            const char* name = s->Attribute("field");
+            rule_action a;
+            if (!name || !resolve_field(name, a.field) || s->QueryIntAttribute("value", &a.value) != tinyxml2::XML_SUCCESS) {
+               LOG_ERROR << "Waveform rules " << file << ": bad <Set> in rule " << type;
+               return false;
+            }
+            const char* label = s->Attribute("label");
+            if (label) a.label = label;
+            band.actions.push_back(std::move(a));
+         }
+         return true;
+      };
+      rule_band any{-std::numeric_limits<double>::infinity(), {}};
+      if (!read_band(e, any)) return false;
+      if (!any.actions.empty()) rule.bands.push_back(std::move(any));
+      for (tinyxml2::XMLElement* s = e->FirstChildElement("Severity"); s; s = s->NextSiblingElement("Severity")) {
+         rule_band band{-std::numeric_limits<double>::infinity(), {}};
+         s->QueryDoubleAttribute("above", &band.above);
+         if (!read_band(s, band)) return false;
+         rule.bands.push_back(std::move(band));
+      }
+      rules.push_back(std::move(rule));
+   }
+
+   rules_.clear();
+   for (auto& rule : rules) add(std::move(rule));
+   defaults_ = defaults;
+   compile();
+   LOG_INFO << "Waveform rules " << file << ": " << rules_.size() << " events";
+   return true;
+}
@@ -0,0 +1,126 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+#ifndef WAVEFORM_RULES_HPP
+#define WAVEFORM_RULES_HPP
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "packet_serializer.hpp"
+
+// the packet fields rules can set: waveform selections, ectopics and interference
+constexpr std::size_t rule_field_first = static_cast<std::size_t>(packet_field::ecg_waveform);
+constexpr std::size_t rule_field_count =
+   static_cast<std::size_t>(packet_field::sinus_arrhythmia_interference) - rule_field_first + 1;
+
+// AMM topic an event arrives on
+enum class rule_source : uint8_t {
+   render_modification = 0,
+   physiology_modification
+};
+
+/**
+ * @brief Current waveform and ECG settings of the monitor
+ *
+ * One atomic per rule field, written by the DDS listeners, read by the
+ * packet builders.
+ */
+class monitor_settings
+{
+   std::array<std::atomic<int>, rule_field_count> value_;
+
+public:
+   explicit monitor_settings(const std::array<int, rule_field_count>& defaults) { reset(defaults); }
+   monitor_settings(const monitor_settings&) = delete;
+   monitor_settings& operator=(const monitor_settings&) = delete;
+
+   void set(packet_field field, int value) {
+      value_[static_cast<std::size_t>(field) - rule_field_first].store(value, std::memory_order_relaxed);
+   }
+   int get(packet_field field) const {
+      return value_[static_cast<std::size_t>(field) - rule_field_first].load(std::memory_order_relaxed);
+   }
+   void reset(const std::array<int, rule_field_count>& defaults) {
+      for (std::size_t i = 0; i < rule_field_count; ++i) value_[i].store(defaults[i], std::memory_order_relaxed);
+   }
+   // copy all rule fields into a packet
+   void fill(packet_values& values) const {
+      for (std::size_t i = 0; i < rule_field_count; ++i) {
+         values.value[rule_field_first + i] = value_[i].load(std::memory_order_relaxed);
+      }
+   }
+};
+
+struct rule_action {
+   packet_field field;
+   int value;
+   std::string label;         // shown in the log, e.g. "Ventricular Tachycardia"
+};
+
+/**
+ * @brief Actions of one severity band; the first band whose threshold
+ * the event severity exceeds is applied
+ */
+struct rule_band {
+   double above;              // -infinity for the fallback band
+   std::vector<rule_action> actions;
+};
+
+struct waveform_rule {
+   rule_source source;
+   std::string event;         // as written in the config, matched case-insensitively
+   std::vector<rule_band> bands;   // thresholds descending
+
+   // band for an event severity, nullptr if no band matches
+   const rule_band* match(double severity) const;
+};
+
+/**
+ * @brief Waveform_Rules Class maps AMM render and physiology events to monitor settings.
+ *
+ * The rules are read once from an XML file (config/isimulate_bridge_waveform_rules.xml)
+ * and compiled into an open-addressing hash table keyed by the case-insensitive
+ * FNV-1a hash of source and event name. find() takes the name as it arrives,
+ * without copying or lowercasing it, and does not allocate.
+ * Without a file the bridge's built-in rules apply.
+ *
+ * load() is not thread safe; find() may be called from any thread afterwards.
+ */
+class waveform_rules
+{
+public:
+   waveform_rules();
+
+   // replace the rules and defaults with the ones in file
+   bool load(const std::string& file);
+
+   const waveform_rule* find(rule_source source, const char* event, std::size_t length) const;
+   const waveform_rule* find(rule_source source, const std::string& event) const {
+      return find(source, event.data(), event.size());
+   }
+
+   const std::array<int, rule_field_count>& defaults() const { return defaults_; }
+   std::size_t size() const { return rules_.size(); }
+
+   // JSON name of a rule field in the ChangeActionPacket ("ecgWaveform"), nullptr if none
+   static const char* field_name(packet_field field);
+   static bool resolve_field(const char* name, packet_field& field);
+
+private:
+   static uint64_t hash(rule_source source, const char* event, std::size_t length);
+   void add(waveform_rule rule);
+   void compile();
+
+   std::vector<waveform_rule> rules_;
+   std::vector<uint32_t> table_;    // rule index + 1, 0 marks a free slot
+   std::vector<uint64_t> hashes_;   // hash of the rule in the same slot
+   std::size_t mask_ = 0;
+   std::array<int, rule_field_count> defaults_;
+};
+
+#endif
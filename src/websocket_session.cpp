@@ -3,15 +3,47 @@
 
 #include "amm/BaseLogger.h"
 #include "websocket_session.hpp"
+#include "bridge_metrics.hpp"
+#include "flight_recorder.hpp"
+
+#include <time.h>
+
+namespace {
+
+// CPU time of the calling thread, unlike wall time not inflated by preemption
+std::chrono::nanoseconds thread_cpu_now() {
+   timespec ts;
+   clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+   return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+uint32_t elapsed_us(websocket_session::clock::time_point from, websocket_session::clock::time_point to) {
+   return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count());
+}
+
+}
 
 websocket_session::websocket_session(net::io_context& ioc)
-   : resolver_(net::make_strand(ioc))
-   , ws_(net::make_strand(ioc))
+   : websocket_session(net::make_strand(ioc))
+{
+}
+
+// resolver and stream share one strand, so do_close can cancel either
+websocket_session::websocket_session(net::strand<net::io_context::executor_type> strand)
+   : resolver_(strand)
+   , ws_(strand)
+   , ingress_(256)
 {
 }
 
 websocket_session::~websocket_session()
 {
+   overflow_node* node = overflow_.exchange(nullptr, std::memory_order_acquire);
+   while (node) {
+      overflow_node* next = node->next;
+      delete node;
+      node = next;
+   }
 }
 
 void websocket_session::run(
@@ -46,11 +78,24 @@ void websocket_session::fail(error_code ec, char const* what)
    LOG_ERROR << what << ": " << ec.message();
 }
 
+void websocket_session::fail_and_close(error_code ec, char const* what)
+{
+   fail(ec, what);
+   notify_closed();
+}
+
+void websocket_session::notify_closed()
+{
+   if (closed_.exchange(true)) return;
+   if (flight_) flight_->record(flight_log::event::ws_closed, flight_session_);
+   if (closeCallback) closeCallback();
+}
+
 void websocket_session::on_resolve(
    error_code ec,
    tcp::resolver::results_type results)
 {
-   if(ec) return fail(ec, "resolve");
+   if(ec) return fail_and_close(ec, "resolve");
    for(tcp::endpoint const& endpoint : results) {
       LOG_INFO << "websocket resolved endpoint: " << endpoint;
    }
@@ -70,7 +115,7 @@ void websocket_session::on_connect(
    error_code ec,
    tcp::resolver::results_type::endpoint_type ep)
 {
-   if(ec) return fail(ec, "connect");
+   if(ec) return fail_and_close(ec, "connect");
    LOG_INFO << "websocket connected ";
 
    // Turn off the timeout on the tcp_stream, because
@@ -82,6 +127,20 @@ void websocket_session::on_connect(
       websocket::stream_base::timeout::suggested(
          beast::role_type::client));
 
+   if (compression_.enabled) {
+      // context takeover stays on: consecutive ChangeActionPackets differ in a
+      // few digits and compress against the previous one
+      websocket::permessage_deflate pmd;
+      pmd.client_enable = true;
+      pmd.client_max_window_bits = compression_.window_bits;
+      pmd.server_max_window_bits = compression_.window_bits;
+      pmd.memLevel = compression_.mem_level;
+#if BOOST_VERSION >= 107600
+      pmd.msg_size_threshold = compression_.threshold;
+#endif
+      ws_.set_option(pmd);
+   }
+
    // Set a decorator to change the User-Agent of the handshake
    ws_.set_option(websocket::stream_base::decorator(
       [](websocket::request_type& req)
@@ -97,7 +156,7 @@ void websocket_session::on_connect(
    host_ += ':' + std::to_string(ep.port());
 
    // Perform the websocket handshake
-   ws_.async_handshake(host_, target_,
+   ws_.async_handshake(handshake_response_, host_, target_,
       beast::bind_front_handler(
          &websocket_session::on_handshake,
          shared_from_this()));
@@ -105,8 +164,14 @@ void websocket_session::on_connect(
 
 void websocket_session::on_handshake(error_code ec)
 {
-   if(ec) return fail(ec, "handshake");
+   if(ec) return fail_and_close(ec, "handshake");
    LOG_INFO << "websocket handshake successful";
+   if (compression_.enabled) {
+      const bool deflate = handshake_response_[http::field::sec_websocket_extensions]
+         .find("permessage-deflate") != beast::string_view::npos;
+      LOG_INFO << "websocket permessage-deflate " << (deflate ? "negotiated" : "declined by the monitor");
+   }
+   if (flight_) flight_->record(flight_log::event::ws_connected, flight_session_);
 
    if (handshakeCallback) handshakeCallback(beast::buffers_to_string(buffer_.data()));
 
@@ -121,62 +186,213 @@ void websocket_session::on_handshake(error_code ec)
          shared_from_this()));
 }
 
-void websocket_session::do_write(std::string message) {
-   if (!write_scheduled){
+void websocket_session::start_write(queued_message&& msg) {
+   // keep the message alive until on_write
+   in_flight_ = std::move(msg.data);
+   in_flight_cls_ = msg.cls;
+   queue_depth_.fetch_sub(1, std::memory_order_relaxed);
+   if (metrics_ || flight_) {
+      in_flight_origin_ = msg.origin;
+      in_flight_started_ = clock::now();
+      if (metrics_) metrics_->latency(msg.cls, latency_stage::queue).record(in_flight_started_ - msg.enqueued);
+      if (flight_) {
+         flight_->record(flight_log::event::ws_write_start, flight_session_, elapsed_us(msg.enqueued, in_flight_started_),
+                         nullptr, in_flight_->size(), static_cast<uint8_t>(msg.cls));
+      }
+   }
+   // the first frame is compressed and framed before async_write returns, so
+   // this is the compression cost (all of it for messages below the 4 KB write buffer)
+   std::chrono::nanoseconds cpu_started{0};
+   if (metrics_) {
+      in_flight_wire_ = beast::get_lowest_layer(ws_).rate_policy().written();
+      cpu_started = thread_cpu_now();
+   }
+   ws_.async_write(
+      net::buffer(*in_flight_),
+      beast::bind_front_handler(
+            &websocket_session::on_write,
+            shared_from_this()));
+   if (metrics_) metrics_->on_framed(in_flight_cls_, thread_cpu_now() - cpu_started);
+   write_scheduled = true;
+}
 
-      std::lock_guard<std::mutex> lock(qmutex);
-      
-      //LOG_DEBUG << "websocket writing message:" << message;
-      // Send the message
-      ws_.async_write(
-         net::buffer(message),
-         beast::bind_front_handler(
-               &websocket_session::on_write,
-               shared_from_this()));
-      write_scheduled = true;
+bool websocket_session::do_write(shared_message message, message_class cls, clock::time_point origin) {
+   std::size_t depth = queue_depth_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+   queued_message msg{std::move(message), cls, origin, clock::time_point()};
+   if (metrics_ || flight_) {
+      msg.enqueued = clock::now();
+      if (msg.origin == clock::time_point()) msg.origin = msg.enqueued;
+      if (metrics_) metrics_->latency(cls, latency_stage::build).record(msg.enqueued - msg.origin);
+      if (flight_) {
+         flight_->record(flight_log::event::ws_enqueue, flight_session_, static_cast<uint32_t>(depth),
+                         msg.data->data(), msg.data->size(), static_cast<uint8_t>(cls));
+      }
+   }
+   if (!overflow_.load(std::memory_order_acquire) && ingress_.try_push(std::move(msg))) {
+      schedule_drain();
    } else {
-      //LOG_DEBUG << "websocket queuing message:" << message;
-      message_queue.push(message);
-      if ( verbose_ )
-         LOG_DEBUG << "websocket queuing message. Queue size: " << message_queue.size();
+      // ring full: this and every later message wait behind the ring, so each
+      // producer's messages stay in order; never drop, block or take a lock here
+      overflow_node* node = new overflow_node{std::move(msg), overflow_.load(std::memory_order_relaxed)};
+      while (!overflow_.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+      }
+      schedule_drain();
    }
+   return depth < high_water_.load(std::memory_order_relaxed);
+}
+
+void websocket_session::schedule_drain() {
+   // one pending drain is enough, it empties the whole ring
+   if (drain_scheduled_.exchange(true, std::memory_order_acq_rel)) return;
+   net::post(ws_.get_executor(),
+      beast::bind_front_handler(
+            &websocket_session::drain,
+            shared_from_this()));
+}
+
+void websocket_session::drain() {
+   // clear the flag first so a push racing with this drain schedules another
+   drain_scheduled_.store(false, std::memory_order_release);
+
+   queued_message msg;
+   while (ingress_.try_pop(msg)) {
+      enqueue(std::move(msg));
+   }
+   if (overflow_.load(std::memory_order_acquire)) {
+      if (ingress_.empty()) {
+         // take the whole stack; producers go back to the ring once it is empty
+         overflow_node* node = overflow_.exchange(nullptr, std::memory_order_acquire);
+         overflow_node* oldest = nullptr;
+         while (node) {
+            overflow_node* next = node->next;
+            node->next = oldest;
+            oldest = node;
+            node = next;
+         }
+         while (oldest) {
+            overflow_node* next = oldest->next;
+            enqueue(std::move(oldest->msg));
+            delete oldest;
+            oldest = next;
+         }
+      } else {
+         // a producer is still writing a cell ahead of the overflow, come back for it
+         schedule_drain();
+      }
+   }
+
+   if (!write_scheduled && !message_queue.empty() && !closed_.load(std::memory_order_acquire)) {
+      queued_message next = std::move(message_queue.front());
+      message_queue.pop_front();
+      //LOG_DEBUG << "websocket writing message:" << message;
+      start_write(std::move(next));
+   }
+}
+
+void websocket_session::enqueue(queued_message&& msg) {
+   if (closed_.load(std::memory_order_acquire)) {
+      // nothing is written after a close
+      queue_depth_.fetch_sub(1, std::memory_order_relaxed);
+      return;
+   }
+   if (msg.cls != message_class::control) {
+      // latest value wins: replace a queued message of the same class
+      for (auto& queued : message_queue) {
+         if (queued.cls == msg.cls && msg.cls != message_class::waveform) {
+            queued.data = std::move(msg.data);
+            queued.origin = msg.origin;
+            queued.enqueued = msg.enqueued;
+            queue_depth_.fetch_sub(1, std::memory_order_relaxed);
+            coalesced_.fetch_add(1, std::memory_order_relaxed);
+            if (flight_) flight_->record(flight_log::event::ws_coalesced, flight_session_, 0, nullptr, 0, static_cast<uint8_t>(msg.cls));
+            return;
+         }
+      }
+      if (message_queue.size() >= capacity_.load(std::memory_order_relaxed)) {
+         queue_depth_.fetch_sub(1, std::memory_order_relaxed);
+         dropped_.fetch_add(1, std::memory_order_relaxed);
+         if (flight_) flight_->record(flight_log::event::ws_dropped, flight_session_, 0, nullptr, 0, static_cast<uint8_t>(msg.cls));
+         if ( verbose_ )
+            LOG_DEBUG << "websocket queue full, message dropped. Queue size: " << message_queue.size();
+         return;
+      }
+   }
+
+   //LOG_DEBUG << "websocket queuing message:" << message;
+   message_queue.push_back(std::move(msg));
+   if ( verbose_ && write_scheduled )
+      LOG_DEBUG << "websocket queuing message. Queue size: " << message_queue.size();
 }
 
 void websocket_session::on_write(
       error_code ec,
       std::size_t bytes_transferred) {
 
-   std::lock_guard<std::mutex> lock(qmutex);
-
    boost::ignore_unused(bytes_transferred);
-   if(ec) return fail(ec, "write");
+   write_scheduled = false;
+   // the queues and other sessions may still share the bytes
+   in_flight_.reset();
+   if (ec) {
+      // the stream is unusable after a failed write: drop what is queued, close
+      // the socket (which also ends the pending read) and report the session closed
+      queue_depth_.fetch_sub(message_queue.size(), std::memory_order_relaxed);
+      message_queue.clear();
+      error_code ignored;
+      beast::get_lowest_layer(ws_).socket().close(ignored);
+      return fail_and_close(ec, "write");
+   }
    if ( verbose_ )
       LOG_DEBUG << "websocket message written: " << bytes_transferred << "bytes. queue size: " << message_queue.size();
-   write_scheduled = false;
+   if (metrics_ || flight_) {
+      const clock::time_point done = clock::now();
+      if (metrics_) {
+         metrics_->latency(in_flight_cls_, latency_stage::write).record(done - in_flight_started_);
+         metrics_->latency(in_flight_cls_, latency_stage::total).record(done - in_flight_origin_);
+         metrics_->on_written(in_flight_cls_, bytes_transferred);
+         metrics_->on_wire(in_flight_cls_, beast::get_lowest_layer(ws_).rate_policy().written() - in_flight_wire_);
+      }
+      if (flight_) {
+         flight_->record(flight_log::event::ws_write_done, flight_session_, elapsed_us(in_flight_started_, done),
+                         nullptr, bytes_transferred, static_cast<uint8_t>(in_flight_cls_));
+      }
+   }
+   if (writeCallback) writeCallback(in_flight_cls_, bytes_transferred);
 
-   if (!message_queue.empty()){
-      std::string message = message_queue.front();
-      message_queue.pop();
+   if (!message_queue.empty() && !closed_.load(std::memory_order_acquire)) {
+      queued_message next = std::move(message_queue.front());
+      message_queue.pop_front();
       if ( verbose_ )
          LOG_DEBUG << "websocket writing message from queue";
       // Send the message
-      ws_.async_write(
-         net::buffer(message),
-         beast::bind_front_handler(
-               &websocket_session::on_write,
-               shared_from_this()));
-      write_scheduled = true;
+      start_write(std::move(next));
    }
 }
 
+void websocket_session::set_queue_limits(std::size_t high_water, std::size_t capacity) {
+   high_water_.store(high_water, std::memory_order_relaxed);
+   capacity_.store(capacity < high_water ? high_water : capacity, std::memory_order_relaxed);
+}
+
 void websocket_session::registerHandshakeCallback(std::function<void(std::string)> cb)
 {
    handshakeCallback = std::bind(cb, std::placeholders::_1);
 }
 
-void websocket_session::registerReadCallback(std::function<void(std::string)> cb)
+void websocket_session::registerCloseCallback(std::function<void()> cb)
+{
+   closeCallback = std::move(cb);
+}
+
+void websocket_session::registerWriteCallback(std::function<void(message_class, std::size_t)> cb)
+{
+   writeCallback = std::move(cb);
+}
+
+void websocket_session::registerReadCallback(std::function<void(char*, std::size_t)> cb)
 {
-   readCallback = std::bind(cb, std::placeholders::_1);
+   readCallback = std::move(cb);
 }
 
 void websocket_session::on_read(
@@ -188,13 +404,23 @@ void websocket_session::on_read(
    // errors?
    if( ec == net::error::eof ) {
       LOG_ERROR << "read: end-of-file " << ec.message();
-      return;
-   } else if (ec) return fail(ec, "read");
+      return notify_closed();
+   } else if (ec) return fail_and_close(ec, "read");
 
    //LOG_INFO << "read: " << ec.message();
 
    //LOG_INFO << "websocket message: " << beast::make_printable(buffer_.data());
-   if (readCallback) readCallback(beast::buffers_to_string(buffer_.data()));
+   if (flight_) {
+      flight_->record(flight_log::event::ws_read, flight_session_, 0,
+                      static_cast<const char*>(buffer_.data().data()), buffer_.size());
+   }
+   if (readCallback) {
+      // terminate the frame in place (outside the readable bytes) so the
+      // callback can parse it in situ without a copy
+      const std::size_t size = buffer_.size();
+      static_cast<char*>(buffer_.prepare(1).data())[0] = '\0';
+      readCallback(static_cast<char*>(buffer_.data().data()), size);
+   }
 
    // Clear the buffer
    buffer_.consume(buffer_.size());
@@ -209,14 +435,22 @@ void websocket_session::on_read(
 
 void websocket_session::do_close()
 {
-   // Close the WebSocket connection
-   LOG_INFO << "websocket closing";
-
-   ws_.async_close(websocket::close_code::normal,
-      beast::bind_front_handler(
-         &websocket_session::on_close,
-         shared_from_this()));
-
+   // may be called from any thread, the close runs on the strand
+   net::dispatch(ws_.get_executor(), [self = shared_from_this()]() {
+      // Close the WebSocket connection
+      LOG_INFO << "websocket closing";
+
+      if (!self->ws_.is_open()) {
+         // still resolving or connecting, cancel that instead
+         self->resolver_.cancel();
+         beast::get_lowest_layer(self->ws_).cancel();
+         return;
+      }
+      self->ws_.async_close(websocket::close_code::normal,
+         beast::bind_front_handler(
+            &websocket_session::on_close,
+            self));
+   });
 }
 
 void websocket_session::on_close(error_code ec)
@@ -1,12 +1,18 @@
 // Copyright (c) 2023 Rainer Leuschke
 // University of Washington, CREST lab
 
+#ifndef WEBSOCKET_SESSION_HPP
+#define WEBSOCKET_SESSION_HPP
+
+#include <chrono>
 #include <cstdlib>
 #include <memory>
 #include <string>
 #include <iostream>
 #include <functional>
-#include <queue>
+#include <deque>
+#include <atomic>
+#include <limits>
 #include <stdbool.h>
 
 #include <boost/asio.hpp>
@@ -17,44 +23,188 @@ using error_code = boost::system::error_code;   // from <boost/system/error_code
 
 #include <boost/beast.hpp>
 
+#include "mpsc_ring.hpp"
+
 namespace beast = boost::beast;
 namespace http = boost::beast::http;            // from <boost/beast/http.hpp>
 namespace websocket = boost::beast::websocket;  // from <boost/beast/websocket.hpp>
 
+class bridge_metrics;
+class flight_recorder;
+
+/**
+ * @brief Outbound message classes, each with its own queueing policy
+ */
+enum class message_class {
+   control,    // never dropped or merged, delivered in order
+   vitals,     // latest value wins, replaces a queued vitals message
+   sync,       // latest value wins, replaces a queued sync message
+   waveform    // never merged, dropped when the queue is full
+};
+
+/**
+ * @brief Immutable outbound message. Rendered once, then shared by every
+ * session, queue and in-flight write it goes to without copying.
+ */
+using shared_message = std::shared_ptr<const std::string>;
+
+inline shared_message make_shared_message(std::string data) {
+   return std::make_shared<const std::string>(std::move(data));
+}
+
+/**
+ * @brief permessage-deflate (RFC 7692) settings of the monitor link.
+ * Offered in the handshake, the monitor may decline; both directions keep
+ * their compression context from message to message.
+ */
+struct compression_options {
+   bool enabled = false;
+   int window_bits = 15;            // LZ77 window offered in both directions, 9..15
+   int mem_level = 4;               // zlib memory level, 1..9
+   std::size_t threshold = 0;       // messages smaller than this are sent uncompressed
+};
+
+/**
+ * @brief Wire_Counter Class is a rate policy that never limits the stream,
+ * it counts the bytes the socket moves after compression and framing.
+ * Updated and read on the session strand.
+ */
+class wire_counter
+{
+   friend class beast::rate_policy_access;
+
+   uint64_t read_ = 0;
+   uint64_t written_ = 0;
+
+   std::size_t available_read_bytes() const noexcept { return (std::numeric_limits<std::size_t>::max)(); }
+   std::size_t available_write_bytes() const noexcept { return (std::numeric_limits<std::size_t>::max)(); }
+   void transfer_read_bytes(std::size_t n) noexcept { read_ += n; }
+   void transfer_write_bytes(std::size_t n) noexcept { written_ += n; }
+   void on_timer() noexcept {}
+
+public:
+   uint64_t read() const { return read_; }
+   uint64_t written() const { return written_; }
+};
+
+using wire_stream = beast::basic_stream<tcp, net::any_io_executor, wire_counter>;
+
 /**
  * @brief Websocket_Session Class is a websocket client handling a connection
  * to a websocket server
+ *
+ * do_write() may be called from any thread. Messages are pushed into a
+ * lock-free ring and drained on the session's strand, which owns the
+ * outbound queue and issues all writes (at most one in flight).
  */
 class websocket_session : public std::enable_shared_from_this<websocket_session>
 {
+public:
+   using clock = std::chrono::steady_clock;
+
+private:
    tcp::resolver resolver_;
-   websocket::stream<beast::tcp_stream> ws_;
+   websocket::stream<wire_stream> ws_;
+   websocket::response_type handshake_response_;
+   compression_options compression_;
    beast::flat_buffer buffer_;
    std::string host_;
    std::string target_;
-   std::function<void(std::string)> readCallback;
+   std::function<void(char*, std::size_t)> readCallback;
    std::function<void(std::string)> handshakeCallback;
-   std::queue<std::string> message_queue;
+   std::function<void()> closeCallback;
+   std::function<void(message_class, std::size_t)> writeCallback;
+   std::atomic<bool> closed_{false};
+   struct queued_message {
+      shared_message data;
+      message_class cls;
+      clock::time_point origin;     // when the data it carries arrived, for the latency metrics
+      clock::time_point enqueued;
+   };
+   // producer -> strand handoff
+   mpsc_ring<queued_message> ingress_;
+   std::atomic<bool> drain_scheduled_{false};
+   // ring full: messages wait on a lock-free stack, newest first; producers skip
+   // the ring while it is not empty, the strand takes it whole and reverses it
+   struct overflow_node {
+      queued_message msg;
+      overflow_node* next;
+   };
+   std::atomic<overflow_node*> overflow_{nullptr};
+
+   // strand only
+   std::deque<queued_message> message_queue;
+   shared_message in_flight_;       // message being written, must outlive async_write
+   message_class in_flight_cls_ = message_class::control;
+   clock::time_point in_flight_origin_;
+   clock::time_point in_flight_started_;
+   uint64_t in_flight_wire_ = 0;    // socket bytes written before the in-flight message
+   bridge_metrics* metrics_ = nullptr;
+   flight_recorder* flight_ = nullptr;
+   uint16_t flight_session_ = 0;
    bool write_scheduled = false;
    bool verbose_ = false;
 
+   // queue limits: backpressure is reported at high_water_, droppable
+   // messages are discarded beyond capacity_
+   std::atomic<std::size_t> high_water_{8};
+   std::atomic<std::size_t> capacity_{64};
+   // messages accepted by do_write and not yet handed to async_write
+   std::atomic<std::size_t> queue_depth_{0};
+   std::atomic<uint64_t> dropped_{0};
+   std::atomic<uint64_t> coalesced_{0};
+
+   void schedule_drain();
+   void drain();
+   void enqueue(queued_message&& msg);
+   void start_write(queued_message&& msg);
+
    void fail(error_code ec, char const* what);
+   void fail_and_close(error_code ec, char const* what);
+   void notify_closed();
    void on_resolve(error_code ec, tcp::resolver::results_type results);
    void on_connect(error_code ec, tcp::resolver::results_type::endpoint_type ep);
    void on_handshake(error_code ec);
    void on_write(error_code ec, std::size_t bytes_transferred);
    void on_read(error_code ec, std::size_t bytes_transferred);
    void on_close(error_code ec);
-   mutable std::mutex qmutex;
+
+   explicit websocket_session(net::strand<net::io_context::executor_type> strand);
 
 public:
    explicit websocket_session(net::io_context& ioc);
    ~websocket_session();
 
    void run(std::string host, std::string port, std::string target);
-   void registerReadCallback(std::function<void(std::string)> cb);
+   // cb receives a mutable, null terminated view of the frame in the read buffer.
+   // it is valid only for the duration of the call and may be parsed in place.
+   void registerReadCallback(std::function<void(char*, std::size_t)> cb);
    void registerHandshakeCallback(std::function<void(std::string)> cb);
-   void do_write(std::string message);
+   // called once when the session ends: connect failure, read error or eof
+   void registerCloseCallback(std::function<void()> cb);
+   // called on the strand after each completed write with its class and size
+   void registerWriteCallback(std::function<void(message_class, std::size_t)> cb);
+   // queue a message from any thread, returns false if the queue is at or above the high-water mark.
+   // origin is when the data the message carries arrived, the time of the call if not given
+   bool do_write(shared_message message, message_class cls = message_class::control,
+                 clock::time_point origin = clock::time_point());
    void do_close();
    void set_verbose(bool flag);
+   bool is_closed() const { return closed_.load(std::memory_order_acquire); }
+   void set_queue_limits(std::size_t high_water, std::size_t capacity);
+   // offer permessage-deflate in the handshake, set before run()
+   void set_compression(const compression_options& options) { compression_ = options; }
+   // record write latencies and bytes, set before run()
+   void set_metrics(bridge_metrics* metrics) { metrics_ = metrics; }
+   // record frames and state changes under the given session id, set before run()
+   void set_flight_recorder(flight_recorder* recorder, uint16_t session) {
+      flight_ = recorder;
+      flight_session_ = session;
+   }
+
+   std::size_t queue_depth() const { return queue_depth_.load(std::memory_order_relaxed); }
+   uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+   uint64_t coalesced() const { return coalesced_.load(std::memory_order_relaxed); }
 };
+
+#endif
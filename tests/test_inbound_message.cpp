@@ -0,0 +1,50 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// scan_message_type: only the "type" member of the message object routes a message
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "inbound_message.hpp"
+
+namespace {
+
+int failures = 0;
+
+void expect(const char* message, inbound_type expected) {
+   const inbound_type type = scan_message_type(message, std::strlen(message));
+   if (type != expected) {
+      std::fprintf(stderr, "%s: got %s, expected %s\n", message, to_string(type), to_string(expected));
+      ++failures;
+   }
+}
+
+}
+
+int main() {
+   // as the monitor sends them
+   expect("{\"type\":\"SettingsRequestPacket\"}", inbound_type::settings_request);
+   expect("{\"type\": \"ScenarioCurrentStatePacket\",\"scenarioState\": 2}", inbound_type::scenario_current_state);
+   expect(" { \"type\" : \"DisconnectPacket\" }", inbound_type::disconnect);
+   expect("{\"type\":\"NibpPacket\"}", inbound_type::other);
+
+   // a nested "type" comes first, the message type follows
+   expect("{\"data\":{\"type\":1},\"type\":\"SimControlPacket\"}", inbound_type::other);
+   expect("{\"data\":{\"type\":\"DebriefPacket\"},\"type\":\"ScenarioRequestPacket\"}", inbound_type::scenario_request);
+   expect("{\"events\":[{\"type\":\"DisconnectPacket\"}],\"type\":\"DebriefPacket\"}", inbound_type::debrief);
+
+   // "type" as a string value, or escaped quotes in front of the member
+   expect("{\"name\":\"type\",\"type\":\"SettingsRequestPacket\"}", inbound_type::settings_request);
+   expect("{\"note\":\"\\\"type\\\":\\\"DebriefPacket\\\"\",\"type\":\"DisconnectPacket\"}", inbound_type::disconnect);
+
+   // no "type" member of the message object
+   expect("{\"data\":{\"type\":\"SettingsRequestPacket\"}}", inbound_type::none);
+   expect("[{\"type\":\"SettingsRequestPacket\"}]", inbound_type::none);
+   expect("{\"type\"", inbound_type::none);
+   expect("", inbound_type::none);
+
+   if (failures) std::fprintf(stderr, "%d checks failed\n", failures);
+   return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
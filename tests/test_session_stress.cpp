@@ -0,0 +1,266 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// many producers against the outbound path: mpsc_ring on its own, then
+// websocket_session::do_write into a loopback monitor. Every message must
+// arrive exactly once and in order per producer, with one write in flight.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "flight_recorder.hpp"
+#include "mpsc_ring.hpp"
+#include "websocket_session.hpp"
+
+namespace {
+
+constexpr std::size_t producers = 8;
+constexpr uint32_t ring_messages = 200000;      // per producer
+constexpr uint32_t session_messages = 4000;     // per producer
+
+int failures = 0;
+
+#define CHECK(cond) \
+   do { \
+      if (!(cond)) { \
+         std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+         ++failures; \
+      } \
+   } while (0)
+
+// per producer sequence numbers, each must follow the previous one
+class order_check
+{
+   std::vector<uint32_t> next_ = std::vector<uint32_t>(producers, 0);
+   uint64_t received_ = 0;
+   uint64_t errors_ = 0;
+
+public:
+   void on_message(std::size_t producer, uint32_t seq) {
+      ++received_;
+      if (producer >= producers || seq != next_[producer]) {
+         if (errors_++ < 10) std::fprintf(stderr, "producer %zu: got %u\n", producer, seq);
+         return;
+      }
+      ++next_[producer];
+   }
+
+   uint64_t received() const { return received_; }
+   uint64_t errors() const { return errors_; }
+   bool complete(uint32_t per_producer) const {
+      return std::all_of(next_.begin(), next_.end(), [per_producer](uint32_t n) { return n == per_producer; });
+   }
+};
+
+void ring_stress() {
+   struct item {
+      std::size_t producer = 0;
+      uint32_t seq = 0;
+   };
+   mpsc_ring<item> ring(1024);
+   std::atomic<std::size_t> running{producers};
+   std::vector<std::thread> threads;
+   for (std::size_t p = 0; p < producers; ++p) {
+      threads.emplace_back([&ring, &running, p] {
+         for (uint32_t i = 0; i < ring_messages; ++i) {
+            item v{p, i};
+            while (!ring.try_push(std::move(v))) std::this_thread::yield();
+         }
+         running.fetch_sub(1, std::memory_order_release);
+      });
+   }
+
+   order_check order;
+   item v;
+   for (;;) {
+      const bool done = running.load(std::memory_order_acquire) == 0;
+      while (ring.try_pop(v)) order.on_message(v.producer, v.seq);
+      if (done) break;
+   }
+   for (auto& t : threads) t.join();
+
+   CHECK(order.errors() == 0);
+   CHECK(order.received() == producers * ring_messages);
+   CHECK(order.complete(ring_messages));
+   std::printf("mpsc_ring: %llu messages from %zu producers\n",
+               static_cast<unsigned long long>(order.received()), producers);
+}
+
+/**
+ * @brief Loopback Class is a websocket server checking what a websocket_session writes
+ */
+class loopback
+{
+   net::io_context server_ioc_;
+   tcp::acceptor acceptor_;
+   std::thread thread_;
+
+   void accept() {
+      acceptor_.async_accept([this](error_code ec, tcp::socket socket) {
+         if (ec) return;
+         auto ws = std::make_shared<websocket::stream<beast::tcp_stream>>(std::move(socket));
+         ws->async_accept([this, ws](error_code ec) {
+            if (!ec) read(ws, std::make_shared<beast::flat_buffer>());
+         });
+      });
+   }
+
+   void read(std::shared_ptr<websocket::stream<beast::tcp_stream>> ws, std::shared_ptr<beast::flat_buffer> buffer) {
+      ws->async_read(*buffer, [this, ws, buffer](error_code ec, std::size_t) {
+         if (ec) return;
+         // "<producer> <seq>"
+         const std::string text = beast::buffers_to_string(buffer->data());
+         buffer->consume(buffer->size());
+         unsigned long producer = 0;
+         unsigned long seq = 0;
+         {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (std::sscanf(text.c_str(), "%lu %lu", &producer, &seq) == 2) {
+               order.on_message(producer, static_cast<uint32_t>(seq));
+            } else {
+               order.on_message(producers, 0);
+            }
+         }
+         read(ws, buffer);
+      });
+   }
+
+public:
+   std::mutex mutex;
+   order_check order;
+
+   loopback()
+      : acceptor_(server_ioc_, tcp::endpoint(net::ip::make_address("127.0.0.1"), 0))
+   {
+      accept();
+      thread_ = std::thread([this] { server_ioc_.run(); });
+   }
+
+   ~loopback() {
+      server_ioc_.stop();
+      thread_.join();
+   }
+
+   std::string port() const { return std::to_string(acceptor_.local_endpoint().port()); }
+};
+
+// write starts and completions from the flight recorder dump: never two starts
+// without a completion in between
+void check_single_write(const std::string& dump, uint64_t messages) {
+   std::FILE* f = std::fopen(dump.c_str(), "rb");
+   CHECK(f != nullptr);
+   if (!f) return;
+   flight_log::file_header h;
+   std::vector<flight_log::entry> entries;
+   if (std::fread(&h, sizeof(h), 1, f) == 1) {
+      entries.resize(h.capacity);
+      entries.resize(std::fread(entries.data(), sizeof(flight_log::entry), entries.size(), f));
+   }
+   std::fclose(f);
+   std::remove(dump.c_str());
+
+   entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                [](const flight_log::entry& e) { return e.seq == 0; }), entries.end());
+   std::sort(entries.begin(), entries.end(),
+             [](const flight_log::entry& a, const flight_log::entry& b) { return a.seq < b.seq; });
+   // the ring must have kept every event of the run
+   CHECK(!entries.empty() && entries.front().seq == 1);
+
+   int in_flight = 0;
+   int max_in_flight = 0;
+   uint64_t completed = 0;
+   for (const auto& e : entries) {
+      if (e.kind == static_cast<uint8_t>(flight_log::event::ws_write_start)) {
+         max_in_flight = std::max(max_in_flight, ++in_flight);
+      } else if (e.kind == static_cast<uint8_t>(flight_log::event::ws_write_done)) {
+         --in_flight;
+         ++completed;
+      }
+   }
+   CHECK(max_in_flight == 1);
+   CHECK(completed == messages);
+}
+
+void session_stress() {
+   loopback server;
+   flight_recorder recorder;
+   recorder.start("test_session_stress", 4 * producers * session_messages);
+
+   net::io_context client_ioc;
+   auto work = net::make_work_guard(client_ioc);
+   std::vector<std::thread> io_threads;
+   for (int i = 0; i < 4; ++i) io_threads.emplace_back([&client_ioc] { client_ioc.run(); });
+
+   auto ready = std::make_shared<std::promise<void>>();
+   auto session = std::make_shared<websocket_session>(client_ioc);
+   session->set_flight_recorder(&recorder, 1);
+   session->set_queue_limits(8, 64);
+   std::atomic<uint64_t> written{0};
+   session->registerWriteCallback([&written](message_class, std::size_t) {
+      written.fetch_add(1, std::memory_order_relaxed);
+   });
+   session->registerHandshakeCallback([ready](std::string) { ready->set_value(); });
+   session->run("127.0.0.1", server.port(), "/");
+   CHECK(ready->get_future().wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+
+   // control messages are never merged or dropped
+   std::vector<std::thread> threads;
+   for (std::size_t p = 0; p < producers; ++p) {
+      threads.emplace_back([&session, p] {
+         for (uint32_t i = 0; i < session_messages; ++i) {
+            session->do_write(make_shared_message(std::to_string(p) + " " + std::to_string(i)), message_class::control);
+         }
+      });
+   }
+   for (auto& t : threads) t.join();
+
+   const uint64_t expected = static_cast<uint64_t>(producers) * session_messages;
+   const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+   while (written.load() < expected && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   }
+   for (;;) {
+      {
+         std::lock_guard<std::mutex> lock(server.mutex);
+         if (server.order.received() >= expected) break;
+      }
+      if (std::chrono::steady_clock::now() > deadline) break;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   }
+
+   CHECK(written.load() == expected);
+   CHECK(session->dropped() == 0);
+   CHECK(session->coalesced() == 0);
+   {
+      std::lock_guard<std::mutex> lock(server.mutex);
+      CHECK(server.order.errors() == 0);
+      CHECK(server.order.received() == expected);
+      CHECK(server.order.complete(session_messages));
+      std::printf("websocket_session: %llu messages from %zu producers\n",
+                  static_cast<unsigned long long>(server.order.received()), producers);
+   }
+   check_single_write(recorder.dump(flight_log::dump_reason::signal), expected);
+
+   session->do_close();
+   work.reset();
+   client_ioc.stop();
+   for (auto& t : io_threads) t.join();
+}
+
+}
+
+int main() {
+   ring_stress();
+   session_stress();
+   if (failures) std::fprintf(stderr, "%d checks failed\n", failures);
+   return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,178 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// Decoder for flight recorder dumps of the iSimulate bridge (--flight-recorder).
+//
+//    flight_decode isimulate_bridge_flight-1234-1-disconnect.bin
+//    flight_decode --session 2 --last 200 dump.bin
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "flight_recorder.hpp"
+
+using namespace flight_log;
+
+namespace {
+
+const char* const class_names[] = {"control", "vitals", "sync", "waveform"};
+
+bool is_frame(uint8_t kind) {
+   return kind == static_cast<uint8_t>(event::ws_read) || kind == static_cast<uint8_t>(event::ws_enqueue);
+}
+
+bool has_class(uint8_t kind) {
+   return kind >= static_cast<uint8_t>(event::ws_enqueue) && kind <= static_cast<uint8_t>(event::ws_write_done);
+}
+
+// printable head of a frame, the rest is marked with its size
+std::string printable_head(const entry& e) {
+   std::string out;
+   const std::size_t n = std::min<std::size_t>(e.size, head_size);
+   for (std::size_t i = 0; i < n; ++i) {
+      const unsigned char c = static_cast<unsigned char>(e.head[i]);
+      if (c >= 0x20 && c < 0x7f) {
+         out += static_cast<char>(c);
+      } else {
+         char hex[8];
+         std::snprintf(hex, sizeof(hex), "\\x%02x", c);
+         out += hex;
+      }
+   }
+   if (e.size > head_size) out += "...";
+   return out;
+}
+
+std::string wall_time(int64_t system_us) {
+   const std::time_t seconds = static_cast<std::time_t>(system_us / 1000000);
+   std::tm tm;
+   localtime_r(&seconds, &tm);
+   char text[64];
+   const std::size_t n = std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+   std::snprintf(text + n, sizeof(text) - n, ".%06d", static_cast<int>(system_us % 1000000));
+   return text;
+}
+
+void describe(const entry& e) {
+   const uint8_t kind = e.kind;
+   if (has_class(kind)) std::printf(" %-8s", e.cls < 4 ? class_names[e.cls] : "?");
+   switch (static_cast<event>(kind)) {
+      case event::ws_enqueue:
+         std::printf(" depth %u %u B %s", e.arg, e.size, printable_head(e).c_str());
+         break;
+      case event::ws_read:
+         std::printf(" %u B %s", e.size, printable_head(e).c_str());
+         break;
+      case event::ws_write_start:
+         std::printf(" %u B queued %u us", e.size, e.arg);
+         break;
+      case event::ws_write_done:
+         std::printf(" %u B written in %u us", e.size, e.arg);
+         break;
+      case event::sim_control:
+         std::printf(" type %u", e.arg);
+         break;
+      case event::sim_state:
+         std::printf(" sim_status %u", e.arg);
+         break;
+      case event::monitor_initialized:
+         std::printf(" model %u", e.arg);
+         break;
+      case event::dump:
+         std::printf(" %s", reason_name(e.arg));
+         break;
+      default:
+         break;
+   }
+}
+
+void usage() {
+   std::cerr << "usage: flight_decode [--session ID] [--last N] [--frames] DUMP.bin" << std::endl;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+   const char* file = nullptr;
+   long session = -1;
+   std::size_t last = 0;
+   bool frames_only = false;
+   for (int i = 1; i < argc; ++i) {
+      if (!std::strcmp(argv[i], "--session") && i + 1 < argc) session = std::strtol(argv[++i], nullptr, 10);
+      else if (!std::strcmp(argv[i], "--last") && i + 1 < argc) last = std::strtoul(argv[++i], nullptr, 10);
+      else if (!std::strcmp(argv[i], "--frames")) frames_only = true;
+      else if (argv[i][0] != '-' && !file) file = argv[i];
+      else {
+         usage();
+         return EXIT_FAILURE;
+      }
+   }
+   if (!file) {
+      usage();
+      return EXIT_FAILURE;
+   }
+
+   std::ifstream in(file, std::ios::binary);
+   file_header header;
+   if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))
+       || std::memcmp(header.magic, magic, sizeof(magic)) != 0) {
+      std::cerr << file << " is not a flight recorder dump" << std::endl;
+      return EXIT_FAILURE;
+   }
+   if (header.version != version || header.entry_size != sizeof(entry)) {
+      std::cerr << file << ": unsupported version " << header.version << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   std::vector<entry> entries(header.capacity);
+   in.read(reinterpret_cast<char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(entry)));
+   entries.resize(static_cast<std::size_t>(in.gcount()) / sizeof(entry));
+
+   // keep the entries that belong to their slot, a crash dump may hold torn ones
+   std::vector<entry> valid;
+   valid.reserve(entries.size());
+   uint64_t torn = 0;
+   for (std::size_t i = 0; i < entries.size(); ++i) {
+      const entry& e = entries[i];
+      if (e.seq == 0) continue;
+      if ((e.seq - 1) % header.capacity != i) {
+         ++torn;
+         continue;
+      }
+      valid.push_back(e);
+   }
+   std::sort(valid.begin(), valid.end(), [](const entry& a, const entry& b) { return a.seq < b.seq; });
+
+   const uint64_t first = valid.empty() ? 0 : valid.front().seq;
+   std::printf("# %s dump of pid %u at %s\n", reason_name(header.reason), header.pid, wall_time(header.dump_system_us).c_str());
+   std::printf("# %llu events recorded, %zu in the dump, %llu older ones overwritten, %llu torn\n",
+               static_cast<unsigned long long>(header.next), valid.size(),
+               static_cast<unsigned long long>(first ? first - 1 : 0), static_cast<unsigned long long>(torn));
+
+   std::vector<const entry*> shown;
+   for (const entry& e : valid) {
+      if (session >= 0 && e.session != session) continue;
+      if (frames_only && !is_frame(e.kind)) continue;
+      shown.push_back(&e);
+   }
+   if (last && shown.size() > last) shown.erase(shown.begin(), shown.end() - last);
+
+   int64_t previous_ns = shown.empty() ? 0 : shown.front()->time_ns;
+   for (const entry* e : shown) {
+      // entries use the steady clock, the header maps it to wall time
+      const int64_t system_us = header.dump_system_us - (header.dump_steady_ns - e->time_ns) / 1000;
+      std::printf("%s %+10.3f ms #%-8llu %2u %-19s", wall_time(system_us).c_str(), (e->time_ns - previous_ns) / 1e6,
+                  static_cast<unsigned long long>(e->seq - 1), e->session, event_name(e->kind));
+      describe(*e);
+      std::printf("\n");
+      previous_ns = e->time_ns;
+   }
+   return EXIT_SUCCESS;
+}
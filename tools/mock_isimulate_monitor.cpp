@@ -0,0 +1,533 @@
+/// AMM iSimulate Bridge
+/// (c) 2023 University of Washington, CREST lab
+
+// Mock iSimulate monitor: a websocket server playing the tablet's side of the
+// protocol, for load and latency tests of the bridge without a real device.
+//
+//    mock_isimulate_monitor --advertise "Mock Monitor"     found by the bridge via mDNS
+//    mock_isimulate_monitor --port 50000                   add "Mock<TAB>127.0.0.1<TAB>50000" to
+//                                                          the bridge's endpoint cache instead
+
+#include <argp.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include <avahi-client/client.h>
+#include <avahi-client/publish.h>
+#include <avahi-common/alternative.h>
+#include <avahi-common/error.h>
+#include <avahi-common/malloc.h>
+
+#include "avahi_asio_poll.hpp"
+
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace websocket = boost::beast::websocket;
+using tcp = net::ip::tcp;
+using error_code = boost::system::error_code;
+using clock_type = std::chrono::steady_clock;
+
+// command line
+struct mock_arguments {
+   const char* address = "0.0.0.0";
+   int port = 50000;
+   const char* advertise = nullptr;    // mDNS service name
+   int scenario_state = -1;            // -1: fresh monitor, else report this running state
+   int read_delay = 0;                 // ms between reads, simulates a slow tablet
+   int drop_every = 0;                 // s until the connection is dropped
+   bool drop_hard = false;             // drop without DisconnectPacket / close handshake
+   int debrief_every = 0;              // s between DebriefPackets
+   int debrief_events = 256;
+   int report_every = 10;              // s between reports
+   const char* csv = nullptr;          // per packet log
+} arguments;
+
+enum {
+   OPT_SCENARIO_STATE = 1000,
+   OPT_READ_DELAY,
+   OPT_DROP_EVERY,
+   OPT_DROP_HARD,
+   OPT_DEBRIEF_EVERY,
+   OPT_DEBRIEF_EVENTS,
+   OPT_REPORT_EVERY,
+   OPT_CSV
+};
+
+static char doc[] = "Mock iSimulate monitor for end-to-end tests of the iSimulate bridge.";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+   { "address", 'a', "ADDRESS", 0, "Listen address (default 0.0.0.0)"},
+   { "port", 'p', "PORT", 0, "Listen port (default 50000)"},
+   { "advertise", 'n', "NAME", 0, "Publish the monitor as _realiti_v1._tcp service NAME"},
+   { "scenario-state", OPT_SCENARIO_STATE, "STATE", 0, "Act as an initialized monitor in STATE (1 running, 2 paused)"},
+   { "read-delay", OPT_READ_DELAY, "MS", 0, "Delay between reads, simulates a slow consumer"},
+   { "drop-every", OPT_DROP_EVERY, "S", 0, "Drop each connection after S seconds"},
+   { "drop-hard", OPT_DROP_HARD, 0, 0, "Drop by closing the socket, without DisconnectPacket"},
+   { "debrief-every", OPT_DEBRIEF_EVERY, "S", 0, "Send a DebriefPacket every S seconds"},
+   { "debrief-events", OPT_DEBRIEF_EVENTS, "COUNT", 0, "Events per DebriefPacket (default 256)"},
+   { "report-every", OPT_REPORT_EVERY, "S", 0, "Seconds between statistics reports (default 10)"},
+   { "csv", OPT_CSV, "FILE", 0, "Log every received packet to FILE"},
+   { 0 }
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+   auto args = static_cast<mock_arguments*>(state->input);
+   char* out = nullptr;
+   long value = 0;
+   if (arg) value = strtol(arg, &out, 10);
+   const bool numeric = arg && !*out && value >= 0;
+
+   switch (key) {
+      case 'a': args->address = arg; break;
+      case 'n': args->advertise = arg; break;
+      case OPT_CSV: args->csv = arg; break;
+      case OPT_DROP_HARD: args->drop_hard = true; break;
+      case 'p':
+      case OPT_SCENARIO_STATE:
+      case OPT_READ_DELAY:
+      case OPT_DROP_EVERY:
+      case OPT_DEBRIEF_EVERY:
+      case OPT_DEBRIEF_EVENTS:
+      case OPT_REPORT_EVERY:
+         if (!numeric) {
+            argp_usage(state);
+            return ARGP_ERR_UNKNOWN;
+         }
+         if (key == 'p') args->port = static_cast<int>(value);
+         else if (key == OPT_SCENARIO_STATE) args->scenario_state = static_cast<int>(value);
+         else if (key == OPT_READ_DELAY) args->read_delay = static_cast<int>(value);
+         else if (key == OPT_DROP_EVERY) args->drop_every = static_cast<int>(value);
+         else if (key == OPT_DEBRIEF_EVERY) args->debrief_every = static_cast<int>(value);
+         else if (key == OPT_DEBRIEF_EVENTS) args->debrief_events = static_cast<int>(value);
+         else args->report_every = value > 0 ? static_cast<int>(value) : 1;
+         break;
+      case ARGP_KEY_ARG:
+         argp_usage(state);
+         break;
+      default:
+         return ARGP_ERR_UNKNOWN;
+   }
+   return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc };
+
+namespace {
+
+// value of the "type" member, without parsing the rest
+std::string packet_type(const char* data, std::size_t size) {
+   static const char key[] = "\"type\"";
+   const char* end = data + size;
+   const char* p = std::search(data, end, key, key + sizeof(key) - 1);
+   if (p == end) return "(none)";
+   p += sizeof(key) - 1;
+   while (p < end && (*p == ' ' || *p == ':' || *p == '\t')) ++p;
+   if (p == end || *p != '"') return "(none)";
+   const char* q = std::find(++p, end, '"');
+   return std::string(p, q);
+}
+
+double to_ms(clock_type::duration d) {
+   return std::chrono::duration<double, std::milli>(d).count();
+}
+
+/**
+ * @brief Sample_Stats Class keeps samples (ms) for mean, jitter and percentiles
+ */
+class sample_stats
+{
+   std::vector<double> samples_;
+   static constexpr std::size_t max_samples = 1 << 20;
+
+public:
+   void add(double ms) { if (samples_.size() < max_samples) samples_.push_back(ms); }
+   std::size_t count() const { return samples_.size(); }
+
+   void print(std::ostream& os) const {
+      if (samples_.empty()) {
+         os << "-";
+         return;
+      }
+      std::vector<double> s(samples_);
+      std::sort(s.begin(), s.end());
+      double sum = 0, sq = 0;
+      for (double v : s) sum += v;
+      const double mean = sum / s.size();
+      for (double v : s) sq += (v - mean) * (v - mean);
+      auto pct = [&](double p) { return s[std::min(s.size() - 1, static_cast<std::size_t>(p * s.size()))]; };
+      os << std::fixed << std::setprecision(2)
+         << "mean " << mean << " jitter " << std::sqrt(sq / s.size())
+         << " min " << s.front() << " p50 " << pct(0.5) << " p99 " << pct(0.99) << " max " << s.back() << " ms";
+   }
+};
+
+/**
+ * @brief Statistics over all connections: packet intervals per type and protocol latencies
+ */
+struct mock_stats {
+   struct type_stats {
+      uint64_t count = 0;
+      uint64_t bytes = 0;
+      clock_type::time_point last;
+      sample_stats interval;       // inter-arrival time, its deviation is the jitter
+   };
+   std::map<std::string, type_stats> types;
+   sample_stats settings_rtt;      // SettingsRequestPacket -> SettingsPacket
+   sample_stats scenario_rtt;      // ScenarioRequestPacket -> ScenarioCurrentStatePacket
+   sample_stats first_vitals;      // connection accepted -> first ChangeActionPacket
+   uint64_t connections = 0;
+   uint64_t drops = 0;
+   std::ofstream csv;
+
+   void record(std::size_t connection, const std::string& type, std::size_t bytes, clock_type::time_point now) {
+      type_stats& t = types[type];
+      double interval = 0;
+      if (t.count) {
+         interval = to_ms(now - t.last);
+         t.interval.add(interval);
+      }
+      t.last = now;
+      ++t.count;
+      t.bytes += bytes;
+      if (csv.is_open()) {
+         csv << std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count() << ','
+             << connection << ',' << type << ',' << bytes << ',' << interval << '\n';
+      }
+   }
+
+   void report(std::ostream& os) const {
+      os << "--- connections " << connections << " drops " << drops << '\n';
+      os << "settings round trip: "; settings_rtt.print(os); os << '\n';
+      os << "scenario round trip: "; scenario_rtt.print(os); os << '\n';
+      os << "connect to first vitals: "; first_vitals.print(os); os << '\n';
+      for (const auto& t : types) {
+         os << t.first << ": " << t.second.count << " packets " << t.second.bytes << " bytes, interval ";
+         t.second.interval.print(os);
+         os << '\n';
+      }
+      os << std::flush;
+   }
+} stats;
+
+std::string debrief_packet(int events) {
+   std::string m = "{\"type\": \"DebriefPacket\",\"scenarioId\": \"\",\"events\": [";
+   for (int i = 0; i < events; ++i) {
+      if (i) m += ',';
+      m += "{\"time\": " + std::to_string(i) + ",\"eventType\": \"ChangeAction\",\"description\": \"mock event\"}";
+   }
+   m += "]}";
+   return m;
+}
+
+/**
+ * @brief Monitor_Connection Class is one bridge connected to the mock monitor
+ */
+class monitor_connection : public std::enable_shared_from_this<monitor_connection>
+{
+   websocket::stream<beast::tcp_stream> ws_;
+   beast::flat_buffer buffer_;
+   net::steady_timer read_timer_;
+   net::steady_timer drop_timer_;
+   net::steady_timer debrief_timer_;
+   std::deque<std::string> queue_;
+   bool writing_ = false;
+   bool closed_ = false;
+   bool closing_ = false;     // close handshake once the queue is written
+   std::size_t id_;
+   clock_type::time_point accepted_;
+   clock_type::time_point settings_requested_;
+   clock_type::time_point scenario_requested_;
+   bool got_vitals_ = false;
+
+public:
+   monitor_connection(tcp::socket&& socket, std::size_t id)
+      : ws_(std::move(socket))
+      , read_timer_(ws_.get_executor())
+      , drop_timer_(ws_.get_executor())
+      , debrief_timer_(ws_.get_executor())
+      , id_(id)
+   {
+   }
+
+   void start() {
+      net::dispatch(ws_.get_executor(), [self = shared_from_this()]() {
+         self->ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+         self->ws_.async_accept([self](error_code ec) { self->on_accept(ec); });
+      });
+   }
+
+private:
+   void on_accept(error_code ec) {
+      if (ec) {
+         std::cerr << "accept: " << ec.message() << std::endl;
+         return;
+      }
+      accepted_ = clock_type::now();
+      ++stats.connections;
+      std::cout << "connection " << id_ << " from " << beast::get_lowest_layer(ws_).socket().remote_endpoint(ec) << std::endl;
+
+      if (arguments.drop_every > 0) {
+         drop_timer_.expires_after(std::chrono::seconds(arguments.drop_every));
+         drop_timer_.async_wait([self = shared_from_this()](error_code ec) { if (!ec) self->drop(); });
+      }
+      if (arguments.debrief_every > 0) schedule_debrief();
+      read();
+   }
+
+   void read() {
+      ws_.async_read(buffer_, [self = shared_from_this()](error_code ec, std::size_t) { self->on_read(ec); });
+   }
+
+   void on_read(error_code ec) {
+      if (ec) return finish(ec);
+      const auto now = clock_type::now();
+      const std::string data = beast::buffers_to_string(buffer_.data());
+      buffer_.consume(buffer_.size());
+      const std::string type = packet_type(data.data(), data.size());
+      stats.record(id_, type, data.size(), now);
+      respond(type, now);
+
+      if (arguments.read_delay > 0) {
+         read_timer_.expires_after(std::chrono::milliseconds(arguments.read_delay));
+         read_timer_.async_wait([self = shared_from_this()](error_code ec) { if (!ec) self->read(); });
+      } else {
+         read();
+      }
+   }
+
+   // the monitor's side of the handshake
+   void respond(const std::string& type, clock_type::time_point now) {
+      if (type == "ConnectionTypePacket") {
+         if (arguments.scenario_state < 0) {
+            settings_requested_ = scenario_requested_ = now;
+            send("{\"type\":\"SettingsRequestPacket\"}");
+            send("{\"type\":\"ScenarioRequestPacket\"}");
+         } else {
+            // already initialized: report the scenario state instead of requesting one
+            send("{\"type\": \"ScenarioCurrentStatePacket\",\"scenarioState\": " + std::to_string(arguments.scenario_state) + "}");
+         }
+      } else if (type == "SettingsPacket" && settings_requested_ != clock_type::time_point()) {
+         stats.settings_rtt.add(to_ms(now - settings_requested_));
+         settings_requested_ = clock_type::time_point();
+      } else if (type == "ScenarioCurrentStatePacket" && scenario_requested_ != clock_type::time_point()) {
+         stats.scenario_rtt.add(to_ms(now - scenario_requested_));
+         scenario_requested_ = clock_type::time_point();
+      } else if (type == "ChangeActionPacket" && !got_vitals_) {
+         got_vitals_ = true;
+         stats.first_vitals.add(to_ms(now - accepted_));
+      }
+   }
+
+   void send(std::string message) {
+      if (closed_) return;
+      queue_.push_back(std::move(message));
+      if (!writing_) write_next();
+   }
+
+   void write_next() {
+      if (closed_) return;
+      if (queue_.empty()) {
+         if (closing_) ws_.async_close(websocket::close_code::normal, [self = shared_from_this()](error_code) {});
+         return;
+      }
+      writing_ = true;
+      ws_.async_write(net::buffer(queue_.front()), [self = shared_from_this()](error_code ec, std::size_t) {
+         self->writing_ = false;
+         self->queue_.pop_front();
+         if (ec) return self->finish(ec);
+         self->write_next();
+      });
+   }
+
+   void schedule_debrief() {
+      debrief_timer_.expires_after(std::chrono::seconds(arguments.debrief_every));
+      debrief_timer_.async_wait([self = shared_from_this()](error_code ec) {
+         if (ec || self->closed_ || self->closing_) return;
+         self->send(debrief_packet(arguments.debrief_events));
+         self->schedule_debrief();
+      });
+   }
+
+   void drop() {
+      if (closed_) return;
+      ++stats.drops;
+      std::cout << "connection " << id_ << " dropping" << (arguments.drop_hard ? " (hard)" : "") << std::endl;
+      if (arguments.drop_hard) {
+         error_code ec;
+         beast::get_lowest_layer(ws_).socket().close(ec);
+         return;
+      }
+      closing_ = true;
+      send("{\"type\":\"DisconnectPacket\"}");
+   }
+
+   void finish(error_code ec) {
+      if (closed_) return;
+      closed_ = true;
+      drop_timer_.cancel();
+      debrief_timer_.cancel();
+      read_timer_.cancel();
+      std::cout << "connection " << id_ << " closed: " << ec.message() << std::endl;
+   }
+};
+
+/**
+ * @brief Monitor_Server Class accepts bridge connections
+ */
+class monitor_server
+{
+   net::io_context& ioc_;
+   tcp::acceptor acceptor_;
+   std::size_t next_id_ = 0;
+
+public:
+   monitor_server(net::io_context& ioc, const tcp::endpoint& endpoint)
+      : ioc_(ioc)
+      , acceptor_(ioc, endpoint)
+   {
+   }
+
+   unsigned short port() const { return acceptor_.local_endpoint().port(); }
+
+   void accept() {
+      acceptor_.async_accept(net::make_strand(ioc_), [this](error_code ec, tcp::socket socket) {
+         if (ec) return;
+         std::make_shared<monitor_connection>(std::move(socket), ++next_id_)->start();
+         accept();
+      });
+   }
+
+   void stop() {
+      error_code ec;
+      acceptor_.close(ec);
+   }
+};
+
+/**
+ * @brief Service_Publisher Class advertises the mock monitor like the iSimulate app does
+ */
+class service_publisher
+{
+   avahi_asio_poll poll_;
+   std::string name_;
+   uint16_t port_;
+   AvahiClient* client_ = nullptr;
+   AvahiEntryGroup* group_ = nullptr;
+
+   static void client_callback(AvahiClient* c, AvahiClientState state, void* userdata) {
+      auto self = static_cast<service_publisher*>(userdata);
+      if (state == AVAHI_CLIENT_S_RUNNING) self->publish(c);
+      else if (state == AVAHI_CLIENT_FAILURE) std::cerr << "avahi: " << avahi_strerror(avahi_client_errno(c)) << std::endl;
+   }
+
+   static void group_callback(AvahiEntryGroup* g, AvahiEntryGroupState state, void* userdata) {
+      auto self = static_cast<service_publisher*>(userdata);
+      if (state == AVAHI_ENTRY_GROUP_ESTABLISHED) {
+         std::cout << "advertising '" << self->name_ << "' as _realiti_v1._tcp on port " << self->port_ << std::endl;
+      } else if (state == AVAHI_ENTRY_GROUP_COLLISION) {
+         char* alt = avahi_alternative_service_name(self->name_.c_str());
+         self->name_ = alt;
+         avahi_free(alt);
+         avahi_entry_group_reset(g);
+         self->publish(avahi_entry_group_get_client(g));
+      }
+   }
+
+   void publish(AvahiClient* c) {
+      if (!group_) group_ = avahi_entry_group_new(c, group_callback, this);
+      if (!group_) return;
+      int ret = avahi_entry_group_add_service(group_, AVAHI_IF_UNSPEC, AVAHI_PROTO_UNSPEC, static_cast<AvahiPublishFlags>(0),
+                                              name_.c_str(), "_realiti_v1._tcp", nullptr, nullptr, port_, nullptr);
+      if (ret == AVAHI_ERR_COLLISION) {
+         char* alt = avahi_alternative_service_name(name_.c_str());
+         name_ = alt;
+         avahi_free(alt);
+         return publish(c);
+      }
+      if (ret < 0 || (ret = avahi_entry_group_commit(group_)) < 0) {
+         std::cerr << "avahi: failed to publish: " << avahi_strerror(ret) << std::endl;
+      }
+   }
+
+public:
+   service_publisher(net::io_context& ioc, std::string name, uint16_t port)
+      : poll_(ioc)
+      , name_(std::move(name))
+      , port_(port)
+   {
+   }
+
+   ~service_publisher() {
+      if (group_) avahi_entry_group_free(group_);
+      if (client_) avahi_client_free(client_);
+   }
+
+   void start() {
+      net::dispatch(poll_.strand(), [this]() {
+         int error;
+         client_ = avahi_client_new(poll_.get(), static_cast<AvahiClientFlags>(0), client_callback, this, &error);
+         if (!client_) std::cerr << "avahi: " << avahi_strerror(error) << std::endl;
+      });
+   }
+};
+
+void schedule_report(net::steady_timer& timer) {
+   timer.expires_after(std::chrono::seconds(arguments.report_every));
+   timer.async_wait([&timer](error_code ec) {
+      if (ec) return;
+      stats.report(std::cout);
+      schedule_report(timer);
+   });
+}
+
+}
+
+int main(int argc, char* argv[]) {
+   argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+   if (arguments.csv) {
+      stats.csv.open(arguments.csv);
+      stats.csv << "time_us,connection,type,bytes,interval_ms\n";
+   }
+
+   // one thread: all connections and statistics share it without locking
+   net::io_context ioc(1);
+   monitor_server server(ioc, tcp::endpoint(net::ip::make_address(arguments.address), static_cast<unsigned short>(arguments.port)));
+   server.accept();
+   std::cout << "mock iSimulate monitor listening on " << arguments.address << ":" << server.port() << std::endl;
+
+   std::unique_ptr<service_publisher> publisher;
+   if (arguments.advertise) {
+      publisher.reset(new service_publisher(ioc, arguments.advertise, server.port()));
+      publisher->start();
+   }
+
+   net::steady_timer reportTimer(ioc);
+   schedule_report(reportTimer);
+
+   net::signal_set signals(ioc, SIGINT, SIGTERM);
+   signals.async_wait([&](error_code, int) {
+      server.stop();
+      reportTimer.cancel();
+      ioc.stop();
+   });
+
+   ioc.run();
+   stats.report(std::cout);
+   return EXIT_SUCCESS;
+}